@@ -38,7 +38,7 @@ public:
             // send a bare “ping”
             olc::net::message<CustomMsgTypes> msg;
             msg.header.id = CustomMsgTypes::ServerPing;
-            Send(msg);
+            Send(std::move(msg));
             sent_count.fetch_add(1, std::memory_order_relaxed);
 
             // immediately pull in all echoes
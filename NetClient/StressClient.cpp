@@ -18,7 +18,7 @@ public:
         olc::net::message<StressMsg> msg;
         msg.header.id = StressMsg::Ping;
         msg << timestamp_us;
-        Send(msg);
+        Send(std::move(msg));
     }
 };
 
@@ -0,0 +1,161 @@
+// CompressionBench.cpp
+//
+// Measures what payload compression does to bytes on the wire and to round
+// trip latency. A client sends state snapshots (arrays of entity records
+// whose values change a little from one snapshot to the next) to a server
+// that echoes them back, one at a time, and records every round trip.
+//
+// The run is done twice over loopback, with compression off and then on,
+// and prints the bytes the client wrote and read and the p50/p99/max round
+// trip for each. Loopback has next to no transfer cost, so this shows the
+// CPU cost of compressing; on a real link the smaller frames also save
+// transfer time.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "olc_net.h"
+
+enum class BenchMsg : uint32_t
+{
+    Snapshot
+};
+
+class EchoServer : public olc::net::server_interface<BenchMsg>
+{
+public:
+    EchoServer(uint16_t port) : server_interface<BenchMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsg>> client) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<BenchMsg>> client, const olc::net::message<BenchMsg>& msg) override
+    {
+        client->Send(msg);
+    }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsg>
+{
+public:
+    uint64_t BytesWritten() const { return m_connection->GetBytesWritten(); }
+    uint64_t BytesRead() const { return m_connection->GetBytesRead(); }
+    bool Compressing() const { return m_connection->IsCompressing(); }
+};
+
+struct Entity
+{
+    uint32_t id;
+    uint32_t flags;
+    float x, y, z;
+    float yaw;
+    uint16_t health;
+    uint16_t ammo;
+};
+
+// Snapshot n of nEntities entities: most fields repeat, positions drift
+olc::net::message<BenchMsg> MakeSnapshot(int n, size_t nEntities)
+{
+    std::vector<Entity> entities(nEntities);
+    for (size_t i = 0; i < nEntities; i++)
+    {
+        Entity& e = entities[i];
+        e.id = uint32_t(i);
+        e.flags = (i % 7 == 0) ? 1 : 0;
+        e.x = float(i % 64) * 8.0f + float(n % 16) * 0.25f;
+        e.y = 0.0f;
+        e.z = float(i / 64) * 8.0f;
+        e.yaw = float((i * 37) % 360);
+        e.health = 100;
+        e.ammo = uint16_t(30 - (n + i) % 4);
+    }
+
+    olc::net::message<BenchMsg> msg;
+    msg.header.id = BenchMsg::Snapshot;
+    olc::net::message_writer writer(msg, entities.size() * sizeof(Entity) + sizeof(uint32_t));
+    writer << entities;
+    return msg;
+}
+
+bool Run(const char* name, uint16_t port, size_t nCompressMin, int count, size_t nEntities)
+{
+    EchoServer server(port);
+    server.SetCompression(nCompressMin);
+    if (!server.Start())
+        return false;
+
+    std::atomic<bool> running{ true };
+    std::thread update([&]()
+    {
+        while (running.load())
+            server.Update(-1, true);
+    });
+
+    BenchClient client;
+    client.SetCompression(nCompressMin);
+    client.Connect("127.0.0.1", port);
+    while (!client.IsConnected())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<double> rtts;
+    rtts.reserve(count);
+    size_t nBody = 0;
+    for (int i = 0; i < count; i++)
+    {
+        olc::net::message<BenchMsg> msg = MakeSnapshot(i, nEntities);
+        nBody = msg.body.size();
+
+        auto t0 = std::chrono::steady_clock::now();
+        client.Send(std::move(msg));
+        client.Incoming().pop_front();
+        rtts.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+
+    std::sort(rtts.begin(), rtts.end());
+    std::cout << std::fixed << std::setprecision(1)
+        << name << (client.Compressing() ? " (negotiated)" : " (not negotiated)")
+        << "  Snapshots: " << count << " x " << nBody << " bytes"
+        << "  Wrote: " << client.BytesWritten()
+        << "  Read: " << client.BytesRead()
+        << "  RTT us p50: " << rtts[rtts.size() / 2]
+        << "  p99: " << rtts[rtts.size() * 99 / 100]
+        << "  max: " << rtts.back() << std::endl;
+
+    // One more message wakes the update thread so it sees running is false
+    running.store(false);
+    client.Send(MakeSnapshot(0, 1));
+    update.join();
+    client.Disconnect();
+    server.Stop();
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60200;
+    int count = 2000;
+    size_t entities = 512;
+    if (argc == 4)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        count = std::stoi(argv[2]);
+        entities = std::stoul(argv[3]);
+    }
+    else
+    {
+        std::cout << "Usage: CompressionBench [port] [snapshots] [entities per snapshot]\n"
+            << "Using defaults " << port << " " << count << " " << entities << std::endl;
+    }
+
+    bool ok = Run("compression off", port, 0, count, entities);
+    ok = Run("compression on ", port + 1, 256, count, entities) && ok;
+    return ok ? 0 : 1;
+}
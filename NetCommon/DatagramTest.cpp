@@ -0,0 +1,241 @@
+// DatagramTest.cpp
+//
+// Exercises the datagram channel that runs alongside each connection
+// (EnableDatagrams / SendUnreliable). Two clients stream numbered position
+// updates to a server over UDP, with loss injected on both sides, and the
+// server echoes each one back the same way.
+//
+// Checks that datagrams reach the right connection by their token, that
+// each client only gets its own echoes back, that a client which did not
+// ask for datagrams can't send them, and that a lost update costs only
+// itself: the round trip of the updates after it stays where it was with
+// no loss, where on a TCP stream they would wait for the retransmission.
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "olc_net.h"
+
+enum class TestMsg : uint32_t
+{
+    Position
+};
+
+struct Position
+{
+    uint32_t nClient;
+    uint32_t nSeq;
+    int64_t nSentNs;
+    float x, y, z;
+};
+
+class EchoServer : public olc::net::server_interface<TestMsg>
+{
+public:
+    EchoServer(uint16_t port) : server_interface<TestMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<TestMsg>> client) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<TestMsg>> client, const olc::net::message<TestMsg>& msg) override
+    {
+        client->SendUnreliable(msg);
+    }
+};
+
+class TestClient : public olc::net::client_interface<TestMsg>
+{
+public:
+    bool HasDatagrams() const { return m_connection && m_connection->HasDatagrams(); }
+};
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result
+{
+    int nReceived = 0;
+    int nForeign = 0;
+    std::vector<double> vecRtt;
+};
+
+// Stream count updates from every client, one every interval, and collect the echoes
+std::vector<Result> Stream(std::vector<std::unique_ptr<TestClient>>& clients, int count, std::chrono::microseconds interval)
+{
+    std::vector<Result> results(clients.size());
+    auto Collect = [&]()
+    {
+        for (size_t c = 0; c < clients.size(); c++)
+        {
+            olc::net::owned_message<TestMsg> msg;
+            while (clients[c]->Incoming().try_pop(msg))
+            {
+                Position p;
+                olc::net::message_reader reader(msg.msg);
+                if (!reader.read(p))
+                    continue;
+                if (p.nClient != c)
+                {
+                    results[c].nForeign++;
+                    continue;
+                }
+                results[c].nReceived++;
+                results[c].vecRtt.push_back(double(NowNs() - p.nSentNs) / 1000.0);
+            }
+        }
+    };
+
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        for (size_t c = 0; c < clients.size(); c++)
+        {
+            olc::net::message<TestMsg> msg;
+            msg.header.id = TestMsg::Position;
+            olc::net::message_writer writer(msg);
+            writer << Position{ uint32_t(c), uint32_t(i), NowNs(), float(i), 0.0f, float(c) };
+            writer.finish();
+            clients[c]->SendUnreliable(std::move(msg));
+        }
+
+        next += interval;
+        while (std::chrono::steady_clock::now() < next)
+        {
+            Collect();
+            std::this_thread::yield();
+        }
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        Collect();
+        std::this_thread::yield();
+    }
+    return results;
+}
+
+bool Report(const char* name, std::vector<Result>& results, int count, double fLoss)
+{
+    bool ok = true;
+    for (size_t c = 0; c < results.size(); c++)
+    {
+        Result& r = results[c];
+        std::sort(r.vecRtt.begin(), r.vecRtt.end());
+        const double fDelivered = double(r.nReceived) / double(count);
+        const double fExpected = (1.0 - fLoss) * (1.0 - fLoss);
+
+        std::cout << std::fixed << std::setprecision(1)
+            << name << " client " << c
+            << "  Echoed: " << r.nReceived << "/" << count
+            << " (" << fDelivered * 100.0 << "%, expect ~" << fExpected * 100.0 << "%)";
+        if (!r.vecRtt.empty())
+        {
+            std::cout << "  RTT us p50: " << r.vecRtt[r.vecRtt.size() / 2]
+                << "  p99: " << r.vecRtt[r.vecRtt.size() * 99 / 100]
+                << "  max: " << r.vecRtt.back();
+        }
+        std::cout << std::endl;
+
+        if (r.nForeign != 0)
+        {
+            std::cout << "FAIL: client " << c << " got " << r.nForeign << " echoes meant for another client" << std::endl;
+            ok = false;
+        }
+        if (fDelivered < fExpected - 0.1 || fDelivered > 1.0)
+        {
+            std::cout << "FAIL: client " << c << " delivery rate out of range" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60400;
+    int count = 2000;
+    double loss = 0.1;
+    if (argc == 4)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        count = std::stoi(argv[2]);
+        loss = std::stod(argv[3]);
+    }
+    else
+    {
+        std::cout << "Usage: DatagramTest [port] [updates] [loss]\n"
+            << "Using defaults " << port << " " << count << " " << loss << std::endl;
+    }
+
+    bool ok = true;
+    for (double fLoss : { 0.0, loss })
+    {
+        EchoServer server(port);
+        if (!server.EnableDatagrams())
+            return 1;
+        server.SetSimulatedLoss(fLoss);
+        server.Start();
+
+        std::atomic<bool> running{ true };
+        std::thread update([&]()
+        {
+            while (running.load())
+                server.Update(-1, true);
+        });
+
+        std::vector<std::unique_ptr<TestClient>> clients;
+        for (int c = 0; c < 2; c++)
+        {
+            clients.push_back(std::make_unique<TestClient>());
+            clients.back()->EnableDatagrams();
+            clients.back()->SetSimulatedLoss(fLoss);
+            clients.back()->Connect("127.0.0.1", port);
+        }
+
+        // A client that did not ask for datagrams gets no channel
+        TestClient plain;
+        plain.Connect("127.0.0.1", port);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < deadline
+            && !(clients[0]->HasDatagrams() && clients[1]->HasDatagrams() && plain.IsConnected()))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        if (!clients[0]->HasDatagrams() || !clients[1]->HasDatagrams())
+        {
+            std::cout << "FAIL: datagram channel not negotiated" << std::endl;
+            ok = false;
+        }
+        if (plain.SendUnreliable(olc::net::message<TestMsg>()))
+        {
+            std::cout << "FAIL: client without datagrams could send one" << std::endl;
+            ok = false;
+        }
+
+        std::vector<Result> results = Stream(clients, count, std::chrono::microseconds(500));
+        ok = Report(fLoss > 0.0 ? "lossy   " : "lossless", results, count, fLoss) && ok;
+
+        // One more message wakes the update thread so it sees running is false
+        running.store(false);
+        clients[0]->Send(olc::net::message<TestMsg>());
+        update.join();
+        for (auto& client : clients)
+            client->Disconnect();
+        plain.Disconnect();
+        server.Stop();
+        port++;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// MessageIoTest.cpp
+//
+// Checks the message_writer and message_reader cursors of net_message_io.h.
+// A mix of scalars, strings, arrays and nested containers is written and
+// must read back in the same order, equal. A body cut short at every
+// possible length must turn ok() false without reading past its end. And
+// element counts the rest of the body could not possibly hold must be
+// refused before the container is resized, so a forged count costs no
+// allocation; for containers of containers that bound comes from each
+// element's smallest encoding, not one byte. A container whose size
+// doesn't fit the 32-bit count must throw rather than write a corrupt one.
+
+#include <iostream>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "olc_net.h"
+
+enum class TestMsg : uint32_t
+{
+    Data
+};
+
+struct Vec2
+{
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+struct Record
+{
+    uint32_t nEntity = 0;
+    double fTime = 0.0;
+    std::string sName;
+    std::vector<Vec2> vecPath;
+    std::vector<std::string> vecTags;
+    std::array<std::string, 2> vPair;
+    std::vector<std::vector<uint16_t>> vecNested;
+    std::array<int16_t, 3> vSmall = {};
+};
+
+void Write(olc::net::message<TestMsg>& msg, const Record& r)
+{
+    olc::net::message_writer w(msg, 256);
+    w << r.nEntity << r.fTime << r.sName << r.vecPath << r.vecTags << r.vPair << r.vecNested << r.vSmall;
+}
+
+bool Read(std::span<const uint8_t> body, Record& r)
+{
+    olc::net::message_reader rd(body);
+    rd >> r.nEntity >> r.fTime >> r.sName >> r.vecPath >> r.vecTags >> r.vPair >> r.vecNested >> r.vSmall;
+    return rd.ok() && rd.remaining() == 0;
+}
+
+bool Same(const Record& a, const Record& b)
+{
+    if (a.vecPath.size() != b.vecPath.size())
+        return false;
+    for (size_t i = 0; i < a.vecPath.size(); i++)
+        if (a.vecPath[i].x != b.vecPath[i].x || a.vecPath[i].y != b.vecPath[i].y)
+            return false;
+    return a.nEntity == b.nEntity && a.fTime == b.fTime && a.sName == b.sName && a.vecTags == b.vecTags
+        && a.vPair == b.vPair && a.vecNested == b.vecNested && a.vSmall == b.vSmall;
+}
+
+Record Sample()
+{
+    Record r;
+    r.nEntity = 42;
+    r.fTime = 1234.5;
+    r.sName = "player one";
+    r.vecPath = { { 1.0f, 2.0f }, { 3.5f, -4.0f } };
+    r.vecTags = { "a", "", "tag three" };
+    r.vPair = { "left", "right" };
+    r.vecNested = { { 1, 2, 3 }, {}, { 65535 } };
+    r.vSmall = { -1, 0, 1 };
+    return r;
+}
+
+bool Report(const char* name, bool ok)
+{
+    std::cout << name << "  " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+bool RoundTrip()
+{
+    const Record in = Sample();
+    olc::net::message<TestMsg> msg;
+    Write(msg, in);
+
+    Record out;
+    const bool ok = msg.header.size == msg.body.size()
+        && Read(std::span<const uint8_t>(msg.body.data(), msg.body.size()), out) && Same(in, out);
+    return Report("round trip                ", ok);
+}
+
+bool Truncated()
+{
+    olc::net::message<TestMsg> msg;
+    Write(msg, Sample());
+
+    // Every proper prefix of the body must fail, and nothing may read past it
+    bool ok = true;
+    for (size_t n = 0; n < msg.body.size(); n++)
+    {
+        std::vector<uint8_t> vecCut(msg.body.data(), msg.body.data() + n);
+        Record out;
+        olc::net::message_reader rd(std::span<const uint8_t>(vecCut.data(), vecCut.size()));
+        rd >> out.nEntity >> out.fTime >> out.sName >> out.vecPath >> out.vecTags >> out.vPair >> out.vecNested >> out.vSmall;
+        if (rd.ok())
+            ok = false;
+
+        // And stays failed
+        uint8_t c = 0;
+        if (rd.read(c) || rd.ok())
+            ok = false;
+    }
+    return Report("truncated input fails     ", ok);
+}
+
+// A body holding only a count, and nPad more bytes
+std::vector<uint8_t> Forged(uint32_t nCount, size_t nPad)
+{
+    std::vector<uint8_t> vecBody(sizeof(nCount) + nPad, 0);
+    std::memcpy(vecBody.data(), &nCount, sizeof(nCount));
+    return vecBody;
+}
+
+template <typename V>
+bool Refused(uint32_t nCount, size_t nPad)
+{
+    const std::vector<uint8_t> vecBody = Forged(nCount, nPad);
+    olc::net::message_reader rd(std::span<const uint8_t>(vecBody.data(), vecBody.size()));
+    V value;
+    return !rd.read(value) && !rd.ok() && value.size() == 0 && value.capacity() == V().capacity();
+}
+
+bool Bounds()
+{
+    // Far more elements than could ever fit
+    bool ok = Refused<std::vector<uint32_t>>(0xFFFFFFFFu, 64);
+    ok = Refused<std::string>(0x7FFFFFFFu, 64) && ok;
+
+    // Just too many: 16 bytes hold four uint32_t, not five
+    ok = Refused<std::vector<uint32_t>>(5, 16) && ok;
+
+    // Each string or inner vector takes at least its own 4-byte count, so
+    // 16 bytes can't hold five of them, let alone sixteen
+    ok = Refused<std::vector<std::string>>(16, 16) && ok;
+    ok = Refused<std::vector<std::string>>(5, 16) && ok;
+    ok = Refused<std::vector<std::vector<uint16_t>>>(5, 16) && ok;
+
+    // An array of two strings takes at least 8 bytes
+    ok = Refused<std::vector<std::array<std::string, 2>>>(3, 16) && ok;
+
+    // At the bound itself the count is allowed: four empty strings
+    const std::vector<uint8_t> vecBody = Forged(4, 16);
+    olc::net::message_reader rd(std::span<const uint8_t>(vecBody.data(), vecBody.size()));
+    std::vector<std::string> vecStrings;
+    ok = rd.read(vecStrings) && rd.ok() && vecStrings.size() == 4 && rd.remaining() == 0 && ok;
+
+    return Report("length bounds             ", ok);
+}
+
+// Claims more elements than a uint32_t count can hold, without owning any
+struct Huge
+{
+    const uint8_t* data() const { return nullptr; }
+    size_t size() const { return size_t(1) << 32; }
+};
+
+bool Overflow()
+{
+    olc::net::message<TestMsg> msg;
+    bool bThrown = false;
+    try
+    {
+        olc::net::message_writer w(msg);
+        w << uint32_t(7) << Huge();
+    }
+    catch (const std::length_error&)
+    {
+        bThrown = true;
+    }
+
+    // Nothing of the oversized container made it into the body
+    return Report("oversized count throws    ", bThrown && msg.body.size() == sizeof(uint32_t));
+}
+
+int main()
+{
+    bool ok = RoundTrip();
+    ok = Truncated() && ok;
+    ok = Bounds() && ok;
+    ok = Overflow() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+// PoolAlignTest.cpp
+//
+// Checks that pool_allocator hands out memory aligned for the type it
+// allocates. Ordinary types come from the slab pool's size classes, which
+// are aligned to max_align_t; over-aligned types (such as the cache-line
+// padded records the lock-free queue keeps) must bypass the pool and still
+// come back on their own alignment, singly, in arrays, through
+// allocate_shared and from a container.
+
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "net_pool.h"
+
+struct alignas(64) CacheLine
+{
+    uint64_t value = 0;
+};
+
+struct alignas(256) Wide
+{
+    uint8_t bytes[300];
+};
+
+template <typename U>
+bool Aligned(const U* p)
+{
+    return reinterpret_cast<uintptr_t>(p) % alignof(U) == 0;
+}
+
+// Allocate and free nCount arrays of every length up to nMaxLength, keeping
+// them all live at once so the allocations can't just reuse one block
+template <typename U>
+bool CheckArrays(const char* name, int nCount, size_t nMaxLength)
+{
+    olc::net::pool_allocator<U> alloc;
+    std::vector<std::pair<U*, size_t>> vecLive;
+    int nMisaligned = 0;
+    for (int i = 0; i < nCount; i++)
+    {
+        for (size_t n = 1; n <= nMaxLength; n++)
+        {
+            U* p = alloc.allocate(n);
+            if (!Aligned(p))
+                nMisaligned++;
+            vecLive.push_back({ p, n });
+        }
+    }
+    for (auto& [p, n] : vecLive)
+        alloc.deallocate(p, n);
+
+    const bool ok = nMisaligned == 0;
+    std::cout << name << " alignof " << alignof(U) << "  Allocations: " << vecLive.size()
+        << "  Misaligned: " << nMisaligned << "  " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = CheckArrays<uint8_t>("uint8_t      ", 100, 40) && ok;
+    ok = CheckArrays<std::max_align_t>("max_align_t  ", 100, 40) && ok;
+    ok = CheckArrays<CacheLine>("alignas(64)  ", 100, 40) && ok;
+    ok = CheckArrays<Wide>("alignas(256) ", 100, 8) && ok;
+
+    // Rebound from an ordinary allocator, as containers and allocate_shared do
+    int nMisaligned = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        auto p = std::allocate_shared<CacheLine>(olc::net::pool_allocator<uint8_t>());
+        if (!Aligned(p.get()))
+            nMisaligned++;
+
+        std::vector<CacheLine, olc::net::pool_allocator<CacheLine>> vec(size_t(i + 1));
+        if (!Aligned(vec.data()))
+            nMisaligned++;
+    }
+    const bool rebound_ok = nMisaligned == 0;
+    std::cout << "rebound      alignof 64  Misaligned: " << nMisaligned << "  " << (rebound_ok ? "PASS" : "FAIL") << std::endl;
+    ok = rebound_ok && ok;
+
+    return ok ? 0 : 1;
+}
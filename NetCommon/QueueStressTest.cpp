@@ -0,0 +1,137 @@
+// QueueStressTest.cpp
+//
+// Hammers lockfree_queue with several producers and several consumers at
+// once and checks that every item comes out exactly once, and that each
+// consumer sees any one producer's items in the order they were pushed.
+// It runs once with std::allocator and once with the slab pool's
+// pool_allocator, which is what tsqueue hands the queue by default.
+// The same check then runs against a deliberately small mpsc_ring_queue
+// with a single consumer, so producers keep hitting the full-ring path.
+// Items carry a shared_ptr so a use-after-free or double destroy shows up
+// as a bad refcount (or, better, under AddressSanitizer).
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <string>
+#include "net_pool.h"
+#include "lockfree_tsqueue.h"
+#include "mpsc_ring_queue.h"
+
+struct Item
+{
+    uint32_t producer = 0;
+    uint32_t seq = 0;
+    std::shared_ptr<uint64_t> payload;
+};
+
+template<typename Queue>
+bool RunStress(const char* name, Queue& queue, int producers, int consumers, int items_per_producer)
+{
+    std::vector<std::atomic<uint8_t>> seen(size_t(producers) * items_per_producer);
+    std::atomic<uint64_t> popped{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+    std::atomic<bool> go{ false };
+
+    const uint64_t total = uint64_t(producers) * items_per_producer;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&, p]()
+        {
+            while (!go.load()) std::this_thread::yield();
+            for (int i = 0; i < items_per_producer; i++)
+            {
+                Item item;
+                item.producer = p;
+                item.seq = i;
+                item.payload = std::make_shared<uint64_t>(uint64_t(p) << 32 | uint32_t(i));
+                queue.push(std::move(item));
+            }
+        });
+    }
+
+    for (int c = 0; c < consumers; c++)
+    {
+        threads.emplace_back([&]()
+        {
+            std::vector<int64_t> last(producers, -1);
+            while (!go.load()) std::this_thread::yield();
+            Item item;
+            while (popped.load(std::memory_order_relaxed) < total)
+            {
+                if (!queue.pop(item))
+                    continue;
+
+                popped.fetch_add(1, std::memory_order_relaxed);
+
+                if (!item.payload || *item.payload != (uint64_t(item.producer) << 32 | item.seq) || item.payload.use_count() != 1)
+                    errors.fetch_add(1);
+
+                if (int64_t(item.seq) <= last[item.producer])
+                    errors.fetch_add(1); // out of order for this producer
+                last[item.producer] = item.seq;
+
+                if (seen[size_t(item.producer) * items_per_producer + item.seq].fetch_add(1) != 0)
+                    errors.fetch_add(1); // delivered twice
+
+                item.payload.reset();
+            }
+        });
+    }
+
+    go.store(true);
+    for (auto& t : threads) t.join();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    uint64_t missing = 0;
+    for (auto& s : seen)
+        if (s.load() != 1) missing++;
+
+    std::cout << name << " Pushed: " << total
+        << "  Popped: " << popped.load()
+        << "  Errors: " << errors.load()
+        << "  Missing/duplicated: " << missing
+        << "  Ops/sec: " << (2 * total / elapsed)
+        << std::endl;
+
+    bool ok = errors.load() == 0 && missing == 0 && queue.empty();
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    int producers = 4;
+    int consumers = 4;
+    int items_per_producer = 1000000;
+
+    if (argc == 4)
+    {
+        producers = std::stoi(argv[1]);
+        consumers = std::stoi(argv[2]);
+        items_per_producer = std::stoi(argv[3]);
+    }
+    else
+    {
+        std::cout << "Usage: QueueStressTest [producers] [consumers] [items per producer]\n"
+            << "Using defaults " << producers << " " << consumers << " " << items_per_producer << std::endl;
+    }
+
+    olc::net::lockfree_queue<Item> queue;
+    bool ok = RunStress("lockfree_queue", queue, producers, consumers, items_per_producer);
+
+    olc::net::lockfree_queue<Item, olc::net::pool_allocator<Item>> pooled;
+    ok = RunStress("lockfree_queue (pool_allocator)", pooled, producers, consumers, items_per_producer) && ok;
+
+    olc::net::mpsc_ring_queue<Item> ring(256);
+    ok = RunStress("mpsc_ring_queue", ring, producers, 1, items_per_producer) && ok;
+
+    return ok ? 0 : 1;
+}
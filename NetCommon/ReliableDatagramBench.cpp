@@ -0,0 +1,252 @@
+// ReliableDatagramBench.cpp
+//
+// Compares round trip latency over the TCP stream with the reliable
+// datagram channels of net_reliable.h. A client sends numbered messages at
+// a steady rate and the server echoes each one back the same way it came:
+//
+//   tcp            Send() over the stream, on a clean loopback
+//   udp ordered    Send() with SetTransport(transport::datagram): channel 0,
+//                  reliable and ordered
+//   udp 4 ordered  SendDatagram() round robin over four ordered channels
+//   udp unordered  SendDatagram() on a reliable, unordered channel
+//
+// The datagram runs repeat with the given fraction of datagrams lost and
+// reordered, both ways. Every run must deliver every message exactly once,
+// and the ordered ones in order per channel.
+//
+// The stream can't be given loss here without netem; with it, a lost
+// segment stalls everything behind it for TCP's retransmission timeout,
+// 200ms at least on Linux, which is what these channels avoid.
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "olc_net.h"
+
+enum class BenchMsg : uint32_t
+{
+    Echo
+};
+
+// How a message travels, carried in it so the server echoes it back the same way
+constexpr uint8_t nViaSend = 0xFF;
+
+struct Probe
+{
+    uint8_t nChannel;
+    uint32_t nSeq;
+    int64_t nSentNs;
+};
+
+constexpr uint8_t nUnorderedChannel = 8;
+
+class EchoServer : public olc::net::server_interface<BenchMsg>
+{
+public:
+    EchoServer(uint16_t port) : server_interface<BenchMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsg>> client) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<BenchMsg>> client, const olc::net::message<BenchMsg>& msg) override
+    {
+        Probe p;
+        olc::net::message_reader reader(msg);
+        if (!reader.read(p))
+            return;
+        if (p.nChannel == nViaSend)
+            client->Send(msg);
+        else
+            client->SendDatagram(p.nChannel, msg);
+    }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsg>
+{
+public:
+    bool HasDatagrams() const { return m_connection && m_connection->HasDatagrams(); }
+    uint64_t Retransmits() const { return m_connection->GetRetransmitCount(); }
+};
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum class Mode
+{
+    Tcp,
+    Ordered,
+    FourOrdered,
+    Unordered
+};
+
+bool Run(uint16_t port, Mode mode, int count, double fLoss, double fReorder)
+{
+    const bool bDatagram = mode != Mode::Tcp;
+
+    EchoServer server(port);
+    BenchClient client;
+    if (bDatagram)
+    {
+        if (!server.EnableDatagrams())
+            return false;
+        server.SetTransport(olc::net::transport::datagram);
+        server.SetChannel(nUnorderedChannel, olc::net::delivery::reliable);
+        server.SetSimulatedLoss(fLoss, fReorder);
+
+        client.EnableDatagrams();
+        client.SetTransport(olc::net::transport::datagram);
+        client.SetChannel(nUnorderedChannel, olc::net::delivery::reliable);
+        client.SetSimulatedLoss(fLoss, fReorder);
+    }
+    server.Start();
+
+    std::atomic<bool> running{ true };
+    std::thread update([&]()
+    {
+        while (running.load())
+            server.Update(-1, true);
+    });
+
+    client.Connect("127.0.0.1", port);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline && !(client.IsConnected() && (!bDatagram || client.HasDatagrams())))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<double> vecRtt;
+    std::vector<int> vecSeen(count, 0);
+    std::vector<int64_t> vecLastSeq(olc::net::nReliableChannels + 1, -1);
+    int nOutOfOrder = 0;
+    int nBad = 0;
+
+    auto Collect = [&]()
+    {
+        olc::net::owned_message<BenchMsg> msg;
+        while (client.Incoming().try_pop(msg))
+        {
+            Probe p;
+            olc::net::message_reader reader(msg.msg);
+            if (!reader.read(p) || p.nSeq >= uint32_t(count))
+            {
+                nBad++;
+                continue;
+            }
+            vecSeen[p.nSeq]++;
+            vecRtt.push_back(double(NowNs() - p.nSentNs) / 1000.0);
+
+            const size_t nSlot = p.nChannel == nViaSend ? olc::net::nReliableChannels : p.nChannel;
+            if (int64_t(p.nSeq) < vecLastSeq[nSlot])
+                nOutOfOrder++;
+            vecLastSeq[nSlot] = p.nSeq;
+        }
+    };
+
+    const auto interval = std::chrono::microseconds(500);
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        olc::net::message<BenchMsg> msg;
+        msg.header.id = BenchMsg::Echo;
+        olc::net::message_writer writer(msg);
+        uint8_t nChannel = nViaSend;
+        if (mode == Mode::FourOrdered)
+            nChannel = uint8_t(i % 4);
+        else if (mode == Mode::Unordered)
+            nChannel = nUnorderedChannel;
+        writer << Probe{ nChannel, uint32_t(i), NowNs() };
+        writer.finish();
+
+        if (nChannel == nViaSend)
+            client.Send(std::move(msg));
+        else
+            client.SendDatagram(nChannel, std::move(msg));
+
+        next += interval;
+        while (std::chrono::steady_clock::now() < next)
+        {
+            Collect();
+            std::this_thread::yield();
+        }
+    }
+
+    const auto drain = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (std::chrono::steady_clock::now() < drain && vecRtt.size() < size_t(count))
+    {
+        Collect();
+        std::this_thread::yield();
+    }
+
+    int nMissing = 0;
+    int nDuplicated = 0;
+    for (int nSeen : vecSeen)
+    {
+        nMissing += nSeen == 0;
+        nDuplicated += nSeen > 1;
+    }
+    const bool bOrdered = mode != Mode::Unordered;
+    const bool ok = nMissing == 0 && nDuplicated == 0 && nBad == 0 && (!bOrdered || nOutOfOrder == 0);
+
+    static const char* vNames[] = { "tcp          ", "udp ordered  ", "udp 4 ordered", "udp unordered" };
+    std::sort(vecRtt.begin(), vecRtt.end());
+    std::cout << std::fixed << std::setprecision(1)
+        << vNames[int(mode)] << "  loss " << std::setw(4) << fLoss * 100.0 << "%  reorder " << std::setw(4) << fReorder * 100.0 << "%"
+        << "  Echoed: " << vecRtt.size() << "/" << count;
+    if (!vecRtt.empty())
+    {
+        std::cout << "  RTT us p50: " << std::setw(7) << vecRtt[vecRtt.size() / 2]
+            << "  p99: " << std::setw(8) << vecRtt[vecRtt.size() * 99 / 100]
+            << "  max: " << std::setw(8) << vecRtt.back();
+    }
+    if (bDatagram)
+        std::cout << "  Resent: " << client.Retransmits();
+    std::cout << std::endl;
+
+    if (!ok)
+    {
+        std::cout << "FAIL: missing " << nMissing << ", duplicated " << nDuplicated
+            << ", malformed " << nBad << ", out of order " << nOutOfOrder << std::endl;
+    }
+
+    running.store(false);
+    client.Send(olc::net::message<BenchMsg>());
+    update.join();
+    client.Disconnect();
+    server.Stop();
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60500;
+    int count = 4000;
+    double loss = 0.05;
+    double reorder = 0.05;
+    if (argc == 5)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        count = std::stoi(argv[2]);
+        loss = std::stod(argv[3]);
+        reorder = std::stod(argv[4]);
+    }
+    else
+    {
+        std::cout << "Usage: ReliableDatagramBench [port] [messages] [loss] [reorder]\n"
+            << "Using defaults " << port << " " << count << " " << loss << " " << reorder << std::endl;
+    }
+
+    bool ok = Run(port++, Mode::Tcp, count, 0.0, 0.0);
+    ok = Run(port++, Mode::Ordered, count, 0.0, 0.0) && ok;
+    for (Mode mode : { Mode::Ordered, Mode::FourOrdered, Mode::Unordered })
+        ok = Run(port++, mode, count, loss, reorder) && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
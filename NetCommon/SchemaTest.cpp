@@ -0,0 +1,150 @@
+// SchemaTest.cpp
+//
+// Checks the typed payloads of net_schema.h. A plain struct and a struct
+// with an explicit field list are each encoded and decoded again, and the
+// field list is checked to pack with no padding. Decoding must refuse a
+// body of the wrong size or a message with another ID. handler_table must
+// route each ID to its own OnPayload overload, and refuse IDs it has no
+// payload for, IDs past its end, and bodies that don't decode.
+
+#include <iostream>
+#include "olc_net.h"
+
+enum class TestMsg : uint32_t
+{
+    Ping,
+    Move,
+    Unused,
+    Chat,
+    Beyond = 100
+};
+
+// Sent as its own bytes
+struct Ping
+{
+    static constexpr TestMsg id = TestMsg::Ping;
+    uint64_t nStamp = 0;
+};
+
+// Sent field by field, without the padding after cTeam
+struct Move
+{
+    static constexpr TestMsg id = TestMsg::Move;
+    uint8_t cTeam = 0;
+    uint32_t nEntity = 0;
+    float x = 0.0f;
+    float y = 0.0f;
+
+    using schema = olc::net::fields<&Move::cTeam, &Move::nEntity, &Move::x, &Move::y>;
+};
+
+struct Chat
+{
+    static constexpr TestMsg id = TestMsg::Chat;
+    char sText[16] = {};
+};
+
+struct Handler
+{
+    int nPings = 0;
+    int nMoves = 0;
+    int nChats = 0;
+    Move lastMove;
+
+    void OnPayload(const std::shared_ptr<olc::net::connection<TestMsg>>&, const Ping&) { nPings++; }
+    void OnPayload(const std::shared_ptr<olc::net::connection<TestMsg>>&, const Move& move) { nMoves++; lastMove = move; }
+    void OnPayload(const std::shared_ptr<olc::net::connection<TestMsg>>&, const Chat&) { nChats++; }
+};
+
+using Table = olc::net::handler_table<TestMsg, Ping, Move, Chat>;
+
+bool Report(const char* name, bool ok)
+{
+    std::cout << name << "  " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+bool SameMove(const Move& a, const Move& b)
+{
+    return a.cTeam == b.cTeam && a.nEntity == b.nEntity && a.x == b.x && a.y == b.y;
+}
+
+bool RoundTrip()
+{
+    Ping ping;
+    ping.nStamp = 0x0123456789ABCDEFull;
+    auto msg = olc::net::make_message(ping);
+    Ping pingOut;
+    const bool bPing = msg.header.id == TestMsg::Ping && msg.header.size == sizeof(Ping)
+        && olc::net::decode(msg, pingOut) && pingOut.nStamp == ping.nStamp;
+
+    Move move;
+    move.cTeam = 3;
+    move.nEntity = 77;
+    move.x = 1.5f;
+    move.y = -2.25f;
+    olc::net::message<TestMsg> msgMove;
+    olc::net::encode(msgMove, move);
+    Move moveOut;
+    const bool bMove = msgMove.header.size == 13 && msgMove.body.size() == 13
+        && olc::net::decode(msgMove, moveOut) && SameMove(move, moveOut);
+
+    static_assert(olc::net::payload_size<Move> == 13, "fields pack back to back");
+    static_assert(olc::net::payload_size<Ping> == sizeof(Ping), "plain payloads go as their own bytes");
+    return Report("round trip                ", bPing && bMove);
+}
+
+bool Rejects()
+{
+    Move move;
+    move.nEntity = 5;
+    auto msg = olc::net::make_message(move);
+    Move moveOut;
+    Ping pingOut;
+
+    // Another payload's ID
+    bool ok = !olc::net::decode(msg, pingOut);
+
+    // One byte short and one byte over
+    msg.body.resize(12);
+    ok = !olc::net::decode(std::span<const uint8_t>(msg.body.data(), msg.body.size()), moveOut) && ok;
+    msg.body.resize(14);
+    ok = !olc::net::decode(std::span<const uint8_t>(msg.body.data(), msg.body.size()), moveOut) && ok;
+    msg.body.resize(0);
+    ok = !olc::net::decode(msg, moveOut) && ok;
+    return Report("bad id / size rejected    ", ok);
+}
+
+bool Dispatch()
+{
+    Handler handler;
+    const std::shared_ptr<olc::net::connection<TestMsg>> client;
+
+    Move move;
+    move.cTeam = 1;
+    move.nEntity = 9;
+    move.x = 4.0f;
+    move.y = 8.0f;
+    bool ok = Table::dispatch(handler, client, olc::net::make_message(Ping{}));
+    ok = Table::dispatch(handler, client, olc::net::make_message(move)) && ok;
+    ok = Table::dispatch(handler, client, olc::net::make_message(Chat{})) && ok;
+    ok = Table::dispatch(handler, client, olc::net::make_message(Chat{})) && ok;
+    ok = handler.nPings == 1 && handler.nMoves == 1 && handler.nChats == 2 && SameMove(handler.lastMove, move) && ok;
+
+    // An ID inside the table with no payload, one past its end, and a
+    // known ID whose body is the wrong size
+    const uint8_t vBody[4] = {};
+    ok = !Table::dispatch(handler, client, TestMsg::Unused, std::span<const uint8_t>()) && ok;
+    ok = !Table::dispatch(handler, client, TestMsg::Beyond, std::span<const uint8_t>()) && ok;
+    ok = !Table::dispatch(handler, client, TestMsg::Move, std::span<const uint8_t>(vBody, sizeof(vBody))) && ok;
+    ok = handler.nPings == 1 && handler.nMoves == 1 && handler.nChats == 2 && ok;
+    return Report("handler_table dispatch    ", ok);
+}
+
+int main()
+{
+    bool ok = RoundTrip();
+    ok = Rejects() && ok;
+    ok = Dispatch() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+// SendAllocTest.cpp
+//
+// Checks that a message body is allocated once by the sender and once by
+// the receiver, and never copied in between. Bodies are made larger than
+// the slab pool's biggest size class, so every body allocation shows up in
+// the pool's oversize counter and nothing else does.
+//
+// Each case sends messages over loopback and expects exactly two oversize
+// allocations per message: the body the sender builds and the buffer the
+// receiver reads it into. The const& case is the exception: it has to copy
+// the caller's message, so it is expected to cost three.
+//
+// A second client then connects in view receive mode and has the server
+// forward its messages straight back. The forwarded view shares the
+// server's receive buffer, so that costs three: the sender's body, the
+// server's receive buffer and the client's.
+//
+// Finally small pings are echoed back and forth. Their bodies fit in the
+// message's inline storage, so a round trip must not reach operator new at
+// all, which the test counts by replacing it.
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <cstdlib>
+#include "olc_net.h"
+
+std::atomic<uint64_t> g_news{ 0 };
+
+// Every form of new and delete is replaced, and all of them go through the
+// same counting pair, so no allocation escapes the count. The unsized
+// delete is kept out of line: inlined, GCC sees free() called on what
+// operator new returned and warns of a mismatch (-Wmismatched-new-delete)
+void* operator new(size_t size)
+{
+    g_news.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return ::operator new(size);
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+enum class TestMsg : uint32_t
+{
+    Data,
+    Ping,
+    Forward
+};
+
+constexpr size_t BODY_SIZE = 100 * 1024;
+
+std::atomic<uint64_t> g_received{ 0 };
+
+class TestServer : public olc::net::server_interface<TestMsg>
+{
+public:
+    TestServer(uint16_t port) : server_interface<TestMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<TestMsg>>) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<TestMsg>> client, const olc::net::message<TestMsg>& msg) override
+    {
+        if (msg.header.id == TestMsg::Ping)
+            client->Send(msg);
+        else if (msg.body.size() == BODY_SIZE)
+            g_received.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnMessageView(std::shared_ptr<olc::net::connection<TestMsg>> client, const olc::net::message_view<TestMsg>& msg) override
+    {
+        if (msg.header.id == TestMsg::Forward)
+            MessageClient(client, msg);
+    }
+};
+
+class TestClient : public olc::net::client_interface<TestMsg> {};
+
+olc::net::message<TestMsg> MakeMessage()
+{
+    olc::net::message<TestMsg> msg;
+    msg.header.id = TestMsg::Data;
+    msg.body.resize(BODY_SIZE);
+    msg.header.size = uint32_t(msg.body.size());
+    return msg;
+}
+
+template<typename SendFn, typename DoneFn>
+bool RunCase(const char* name, int count, uint64_t expected_per_message, SendFn&& send, DoneFn&& done)
+{
+    const uint64_t before = olc::net::GetPoolStats().nOversize;
+
+    for (int i = 0; i < count; i++)
+        send();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const uint64_t allocs = olc::net::GetPoolStats().nOversize - before;
+    const bool ok = done() && allocs == expected_per_message * count;
+
+    std::cout << name << " Messages: " << count
+        << "  Body allocations: " << allocs
+        << "  Expected: " << expected_per_message * count
+        << "  " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60100;
+    int count = 1000;
+    if (argc == 3)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        count = std::stoi(argv[2]);
+    }
+    else
+    {
+        std::cout << "Usage: SendAllocTest [port] [messages per case]\n"
+            << "Using defaults " << port << " " << count << std::endl;
+    }
+
+    TestServer server(port);
+    if (!server.Start())
+        return 1;
+
+    std::atomic<bool> running{ true };
+    std::thread update([&]()
+    {
+        while (running.load())
+            server.Update(-1, false);
+    });
+
+    TestClient client;
+    client.Connect("127.0.0.1", port);
+    while (!client.IsConnected())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // Let the handshake finish
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    bool ok = true;
+    uint64_t target = 0;
+    auto server_done = [&]() { return g_received.load() == target; };
+
+    target += count;
+    ok = RunCase("client Send(message&&)", count, 2,
+        [&]() { client.Send(MakeMessage()); }, server_done) && ok;
+
+    target += count;
+    ok = RunCase("client EmplaceSend", count, 2,
+        [&]()
+        {
+            client.EmplaceSend([](olc::net::message<TestMsg>& msg)
+            {
+                msg.header.id = TestMsg::Data;
+                msg.body.resize(BODY_SIZE);
+                msg.header.size = uint32_t(msg.body.size());
+            });
+        }, server_done) && ok;
+
+    target += count;
+    ok = RunCase("client Send(const message&)", count, 3,
+        [&]()
+        {
+            const olc::net::message<TestMsg> msg = MakeMessage();
+            client.Send(msg);
+        }, server_done) && ok;
+
+    int received = 0;
+    ok = RunCase("server MessageAllClients(message&&)", count, 2,
+        [&]() { server.MessageAllClients(MakeMessage()); },
+        [&]()
+        {
+            while (!client.Incoming().empty())
+            {
+                auto msg = client.Incoming().pop_front();
+                if (msg.msg.body.size() == BODY_SIZE)
+                    received++;
+            }
+            return received == count;
+        }) && ok;
+
+    server.SetReceiveMode(olc::net::receive_mode::view);
+    TestClient forwarder;
+    forwarder.Connect("127.0.0.1", port);
+    while (!forwarder.IsConnected())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    int forwarded = 0;
+    ok = RunCase("server forwards message_view", count, 3,
+        [&]()
+        {
+            olc::net::message<TestMsg> msg = MakeMessage();
+            msg.header.id = TestMsg::Forward;
+            forwarder.Send(std::move(msg));
+        },
+        [&]()
+        {
+            while (!forwarder.Incoming().empty())
+            {
+                auto msg = forwarder.Incoming().pop_front();
+                if (msg.msg.body.size() == BODY_SIZE)
+                    forwarded++;
+            }
+            return forwarded == count;
+        }) && ok;
+
+    // Ping round trips: warm up the pool and asio's handler caches first
+    auto ping = [&](uint64_t seq)
+    {
+        olc::net::message<TestMsg> msg;
+        msg.header.id = TestMsg::Ping;
+        msg << seq;
+        msg.header.size = uint32_t(msg.body.size());
+        client.Send(std::move(msg));
+
+        auto reply = client.Incoming().pop_front();
+        return reply.msg.body.is_inline() && reply.msg.body.size() == sizeof(seq);
+    };
+
+    for (int i = 0; i < 1000; i++)
+        ping(i);
+
+    const uint64_t news_before = g_news.load();
+    bool inline_bodies = true;
+    for (int i = 0; i < count; i++)
+        inline_bodies = ping(i) && inline_bodies;
+    const uint64_t news = g_news.load() - news_before;
+
+    const bool ping_ok = inline_bodies && news == 0;
+    std::cout << "ping round trips Messages: " << count
+        << "  operator new calls: " << news
+        << "  Bodies inline: " << (inline_bodies ? "yes" : "no")
+        << "  " << (ping_ok ? "PASS" : "FAIL") << std::endl;
+    ok = ping_ok && ok;
+
+    running.store(false);
+    update.join();
+
+    return ok ? 0 : 1;
+}
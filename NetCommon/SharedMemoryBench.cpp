@@ -0,0 +1,192 @@
+// SharedMemoryBench.cpp
+//
+// Compares a client on the same host connecting over loopback TCP, through
+// the server's Unix domain socket (ListenLocal / Connect(path)) and through
+// its shared memory segment (ListenShared / ConnectShared). The server
+// echoes every message back from OnMessage().
+//
+// For each transport it prints the round trip of single messages sent one
+// at a time, then the rate and process CPU time per message of a pipelined
+// stream, and checks every echo arrived intact. The shared memory run is
+// repeated with the readers never parking, where both readers and the
+// server's Update() loop each want a core of their own; it is skipped on
+// machines with fewer than four.
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include "olc_net.h"
+
+enum class BenchMsg : uint32_t
+{
+    Echo
+};
+
+enum class Via
+{
+    Tcp,
+    Unix,
+    Shared
+};
+
+class EchoServer : public olc::net::server_interface<BenchMsg>
+{
+public:
+    EchoServer(uint16_t port) : server_interface<BenchMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsg>> client) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<BenchMsg>> client, const olc::net::message<BenchMsg>& msg) override
+    {
+        client->Send(msg);
+    }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsg>
+{
+};
+
+olc::net::message<BenchMsg> MakeMessage(uint32_t nSeq, size_t nBody)
+{
+    olc::net::message<BenchMsg> msg;
+    msg.header.id = BenchMsg::Echo;
+    msg.body.resize(nBody);
+    for (size_t i = 0; i < nBody; i++)
+        msg.body[i] = uint8_t(nSeq + i);
+    std::memcpy(msg.body.data(), &nSeq, sizeof(nSeq));
+    return msg;
+}
+
+bool Check(const olc::net::message<BenchMsg>& msg, uint32_t nSeq, size_t nBody)
+{
+    const auto expected = MakeMessage(nSeq, nBody);
+    return msg.body.size() == nBody && std::memcmp(msg.body.data(), expected.body.data(), nBody) == 0;
+}
+
+bool Run(const char* name, Via via, std::chrono::nanoseconds spin, uint16_t port, int nPings, int nStream, size_t nBody)
+{
+    const std::string sPath = "/tmp/olc_net_bench_" + std::to_string(port) + ".sock";
+    const std::string sShared = "/olc_net_bench_" + std::to_string(port);
+
+    EchoServer server(port);
+    if (via == Via::Unix && !server.ListenLocal(sPath))
+        return false;
+    if (via == Via::Shared)
+    {
+        server.SetSharedSpin(spin);
+        if (!server.ListenShared(sShared))
+            return false;
+    }
+    if (!server.Start())
+        return false;
+
+    std::atomic<bool> running{ true };
+    std::thread update([&]()
+    {
+        while (running.load())
+            server.Update(-1, true);
+    });
+
+    BenchClient client;
+    client.SetSharedSpin(spin);
+    bool bConnected = false;
+    if (via == Via::Tcp)
+        bConnected = client.Connect("127.0.0.1", port);
+    else if (via == Via::Unix)
+        bConnected = client.Connect(sPath);
+    else
+        bConnected = client.ConnectShared(sShared);
+    if (!bConnected)
+        return false;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline && !client.IsConnected())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    bool ok = true;
+
+    // One message at a time
+    std::vector<double> vecRtt;
+    for (int i = 0; i < nPings; i++)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        client.Send(MakeMessage(uint32_t(i), nBody));
+        auto echo = client.Incoming().pop_front();
+        vecRtt.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        ok = Check(echo.msg, uint32_t(i), nBody) && ok;
+    }
+    std::sort(vecRtt.begin(), vecRtt.end());
+
+    // Pipelined: keep up to nWindow messages in flight
+    const int nWindow = 64;
+    const std::clock_t tCpu0 = std::clock();
+    const auto t0 = std::chrono::steady_clock::now();
+    int nSent = 0;
+    for (int nReceived = 0; nReceived < nStream; nReceived++)
+    {
+        while (nSent < nStream && nSent - nReceived < nWindow)
+        {
+            client.Send(MakeMessage(uint32_t(nSent), nBody));
+            nSent++;
+        }
+        auto echo = client.Incoming().pop_front();
+        ok = Check(echo.msg, uint32_t(nReceived), nBody) && ok;
+    }
+    const double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const double fCpuUs = double(std::clock() - tCpu0) * 1e6 / CLOCKS_PER_SEC;
+
+    std::cout << std::fixed << std::setprecision(1) << name
+        << "  RTT us p50: " << std::setw(6) << vecRtt[vecRtt.size() / 2]
+        << "  p99: " << std::setw(7) << vecRtt[vecRtt.size() * 99 / 100]
+        << "  Stream msgs/sec: " << std::setw(9) << double(nStream) / fSeconds
+        << "  CPU us/msg: " << std::setw(5) << fCpuUs / double(nStream)
+        << "  " << (ok ? "ok" : "CORRUPT") << std::endl;
+
+    running.store(false);
+    client.Send(olc::net::message<BenchMsg>());
+    update.join();
+    client.Disconnect();
+    server.Stop();
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60800;
+    int pings = 20000;
+    int stream = 200000;
+    size_t body = 64;
+    if (argc == 5)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        pings = std::stoi(argv[2]);
+        stream = std::stoi(argv[3]);
+        body = std::stoul(argv[4]);
+    }
+    else
+    {
+        std::cout << "Usage: SharedMemoryBench [port] [pings] [stream] [body bytes]\n"
+            << "Using defaults " << port << " " << pings << " " << stream << " " << body << std::endl;
+    }
+
+    const auto spin = olc::net::shm_default_spin();
+    const auto forever = std::chrono::hours(1);
+    bool ok = Run("tcp        ", Via::Tcp, spin, port++, pings, stream, body);
+    ok = Run("unix       ", Via::Unix, spin, port++, pings, stream, body) && ok;
+    ok = Run("shm        ", Via::Shared, spin, port++, pings, stream, body) && ok;
+    if (std::thread::hardware_concurrency() >= 4)
+        ok = Run("shm no park", Via::Shared, forever, port++, pings, stream, body) && ok;
+    else
+        std::cout << "shm no park  skipped: needs 4 cores, have " << std::thread::hardware_concurrency() << std::endl;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
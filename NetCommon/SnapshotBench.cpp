@@ -0,0 +1,204 @@
+// SnapshotBench.cpp
+//
+// Compares broadcasting the whole world state every tick with
+// MessageAllClients against the delta snapshot stream (EnableSnapshots /
+// BroadcastSnapshot). A server holds an array of entity records and changes
+// a given fraction of them each tick; several clients on loopback rebuild
+// the state with snapshot_receiver and acknowledge every frame.
+//
+// For each change rate it prints the bytes the clients read per tick and
+// the server CPU time per broadcast call, and checks that every client ends
+// up holding exactly the server's state.
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "olc_net.h"
+
+enum class BenchMsg : uint32_t
+{
+    FullState,
+    Snapshot,
+    SnapshotAck
+};
+
+class BenchServer : public olc::net::server_interface<BenchMsg>
+{
+public:
+    BenchServer(uint16_t port) : server_interface<BenchMsg>(port) {}
+
+    size_t ClientCount()
+    {
+        std::scoped_lock lock(m_muxConnections);
+        return m_mapConnections.size();
+    }
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsg>> client) override
+    {
+        return true;
+    }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsg>
+{
+public:
+    uint64_t BytesRead() const { return m_connection->GetBytesRead(); }
+
+    olc::net::snapshot_receiver<BenchMsg> receiver{ BenchMsg::SnapshotAck };
+    std::vector<uint8_t> vecFull;
+    uint32_t nTicks = 0;
+};
+
+struct Entity
+{
+    uint32_t id;
+    uint32_t flags;
+    float x, y, z;
+    float yaw;
+    uint16_t health;
+    uint16_t ammo;
+};
+
+bool Run(uint16_t port, bool bDelta, double fChange, int nTicks, size_t nEntities, size_t nClients)
+{
+    BenchServer server(port);
+    if (bDelta)
+        server.EnableSnapshots(BenchMsg::Snapshot, BenchMsg::SnapshotAck);
+    if (!server.Start())
+        return false;
+
+    std::atomic<bool> running{ true };
+    std::thread update([&]()
+    {
+        while (running.load())
+            server.Update(-1, true);
+    });
+
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    for (size_t i = 0; i < nClients; i++)
+    {
+        clients.push_back(std::make_unique<BenchClient>());
+        clients.back()->Connect("127.0.0.1", port);
+    }
+    while (server.ClientCount() < nClients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<Entity> world(nEntities);
+    for (size_t i = 0; i < nEntities; i++)
+        world[i] = Entity{ uint32_t(i), 0, float(i % 64) * 8.0f, 0.0f, float(i / 64) * 8.0f, 0.0f, 100, 30 };
+
+    std::mt19937 rng(1);
+    const size_t nChanged = size_t(fChange * double(nEntities));
+    std::vector<uint64_t> vecBytesBefore;
+    for (auto& client : clients)
+        vecBytesBefore.push_back(client->BytesRead());
+
+    double fServerUs = 0.0;
+    for (int tick = 0; tick < nTicks; tick++)
+    {
+        for (size_t n = 0; n < nChanged; n++)
+        {
+            Entity& e = world[rng() % nEntities];
+            e.x += 0.25f;
+            e.yaw = float(rng() % 360);
+            e.ammo = uint16_t(rng() % 31);
+        }
+
+        const std::span<const uint8_t> state(reinterpret_cast<const uint8_t*>(world.data()), world.size() * sizeof(Entity));
+        auto t0 = std::chrono::steady_clock::now();
+        if (bDelta)
+        {
+            server.BroadcastSnapshot(state);
+        }
+        else
+        {
+            olc::net::message<BenchMsg> msg;
+            msg.header.id = BenchMsg::FullState;
+            olc::net::message_writer writer(msg, state.size());
+            writer.write_bytes(state.data(), state.size());
+            writer.finish();
+            server.MessageAllClients(std::move(msg));
+        }
+        fServerUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+
+        // Every client takes this tick in and acknowledges it before the next
+        for (auto& client : clients)
+        {
+            while (client->nTicks <= uint32_t(tick))
+            {
+                auto msg = client->Incoming().pop_front();
+                if (msg.msg.header.id == BenchMsg::FullState)
+                {
+                    client->vecFull.assign(msg.msg.body.begin(), msg.msg.body.end());
+                    client->nTicks++;
+                }
+                else
+                {
+                    if (client->receiver.Apply(msg.msg))
+                        client->nTicks++;
+                    client->Send(client->receiver.Ack());
+                }
+            }
+        }
+    }
+
+    uint64_t nBytes = 0;
+    bool ok = true;
+    const uint8_t* pWorld = reinterpret_cast<const uint8_t*>(world.data());
+    const size_t nState = world.size() * sizeof(Entity);
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        nBytes += clients[i]->BytesRead() - vecBytesBefore[i];
+        std::span<const uint8_t> held = bDelta ? clients[i]->receiver.State() : std::span<const uint8_t>(clients[i]->vecFull);
+        ok = ok && held.size() == nState && std::memcmp(held.data(), pWorld, nState) == 0;
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+        << (bDelta ? "delta " : "full  ")
+        << "  Changed/tick: " << std::setw(5) << nChanged << " of " << nEntities
+        << "  Bytes/tick/client: " << std::setw(8) << double(nBytes) / double(nTicks) / double(nClients)
+        << "  Server us/tick: " << std::setw(7) << fServerUs / double(nTicks)
+        << "  State " << (ok ? "matches" : "MISMATCH") << std::endl;
+
+    running.store(false);
+    clients[0]->Send(olc::net::message<BenchMsg>());
+    update.join();
+    for (auto& client : clients)
+        client->Disconnect();
+    server.Stop();
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 60300;
+    int ticks = 600;
+    size_t entities = 4096;
+    size_t clients = 8;
+    if (argc == 5)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        ticks = std::stoi(argv[2]);
+        entities = std::stoul(argv[3]);
+        clients = std::stoul(argv[4]);
+    }
+    else
+    {
+        std::cout << "Usage: SnapshotBench [port] [ticks] [entities] [clients]\n"
+            << "Using defaults " << port << " " << ticks << " " << entities << " " << clients << std::endl;
+    }
+
+    bool ok = true;
+    for (double fChange : { 0.0, 0.01, 0.1, 1.0 })
+    {
+        ok = Run(port++, false, fChange, ticks, entities, clients) && ok;
+        ok = Run(port++, true, fChange, ticks, entities, clients) && ok;
+    }
+    return ok ? 0 : 1;
+}
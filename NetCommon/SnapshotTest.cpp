@@ -0,0 +1,186 @@
+// SnapshotTest.cpp
+//
+// Checks the delta snapshots of net_snapshot.h. delta_encode and
+// delta_decode must round trip random states against random baselines,
+// the same length, grown, shrunk and empty, within delta_bound, and a
+// delta whose runs overrun the state must be refused. A snapshot_channel
+// feeding a snapshot_receiver must rebuild every frame, keyframes and
+// deltas alike. And a snapshot whose length field is over the receiver's
+// limit must be dropped before anything is allocated for it, leaving the
+// state it holds alone and asking for a keyframe.
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "olc_net.h"
+
+enum class TestMsg : uint32_t
+{
+    Snapshot,
+    SnapshotAck
+};
+
+bool Report(const char* name, bool ok)
+{
+    std::cout << name << "  " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+// nBase random bytes, then the state: the baseline with about one byte in
+// nEvery changed, cut or grown to nState
+void MakePair(std::mt19937& rng, size_t nBase, size_t nState, size_t nEvery, std::vector<uint8_t>& vecBase, std::vector<uint8_t>& vecState)
+{
+    vecBase.resize(nBase);
+    for (auto& b : vecBase)
+        b = uint8_t(rng());
+
+    vecState.assign(vecBase.begin(), vecBase.begin() + std::min(nBase, nState));
+    vecState.resize(nState, 0);
+    for (size_t i = 0; i < nState; i++)
+    {
+        if (rng() % nEvery == 0)
+            vecState[i] = uint8_t(rng());
+    }
+}
+
+bool RoundTrip()
+{
+    std::mt19937 rng(7);
+    const size_t vSizes[] = { 0, 1, 7, 8, 9, 64, 1000, 4096 };
+    const size_t vEvery[] = { 1, 3, 16, 200 };
+
+    bool ok = true;
+    std::vector<uint8_t> vecBase, vecState, vecDelta, vecOut;
+    for (size_t nBase : vSizes)
+    {
+        for (size_t nState : vSizes)
+        {
+            for (size_t nEvery : vEvery)
+            {
+                MakePair(rng, nBase, nState, nEvery, vecBase, vecState);
+
+                vecDelta.resize(olc::net::delta_bound(nState));
+                const size_t nDelta = olc::net::delta_encode(vecBase.data(), nBase, vecState.data(), nState, vecDelta.data());
+                ok = ok && nDelta <= olc::net::delta_bound(nState);
+
+                vecOut.assign(nState, 0xCD);
+                ok = ok && olc::net::delta_decode(vecBase.data(), nBase, vecDelta.data(), nDelta, vecOut.data(), nState);
+                ok = ok && vecOut == vecState;
+            }
+        }
+    }
+
+    // An unchanged state needs no delta at all
+    MakePair(rng, 1000, 1000, 1, vecBase, vecState);
+    vecDelta.resize(olc::net::delta_bound(1000));
+    ok = ok && olc::net::delta_encode(vecBase.data(), 1000, vecBase.data(), 1000, vecDelta.data()) == 0;
+
+    return Report("delta round trip          ", ok);
+}
+
+bool Corrupt()
+{
+    const uint8_t vBase[16] = {};
+    uint8_t vOut[16];
+    bool ok = true;
+
+    // 10 unchanged bytes, then 10 literals: past the end of a 16 byte state
+    uint8_t vOverrun[2 + 10] = { 10, 10 };
+    ok = ok && !olc::net::delta_decode(vBase, 16, vOverrun, sizeof(vOverrun), vOut, 16);
+
+    // Promises 4 literals and carries 2
+    const uint8_t vShort[] = { 0, 4, 1, 2 };
+    ok = ok && !olc::net::delta_decode(vBase, 16, vShort, sizeof(vShort), vOut, 16);
+
+    // A varint cut off in the middle
+    const uint8_t vCut[] = { 0x80 };
+    ok = ok && !olc::net::delta_decode(vBase, 16, vCut, sizeof(vCut), vOut, 16);
+
+    return Report("corrupt delta refused     ", ok);
+}
+
+bool ChannelToReceiver()
+{
+    olc::net::snapshot_channel<TestMsg> channel(TestMsg::Snapshot, TestMsg::SnapshotAck, 10, 8);
+    olc::net::snapshot_receiver<TestMsg> receiver(TestMsg::SnapshotAck, 8);
+
+    std::mt19937 rng(11);
+    std::vector<uint8_t> vecWorld(2000);
+    bool ok = true;
+    for (int nTick = 0; nTick < 50; nTick++)
+    {
+        // Change a little, and now and then grow or shrink
+        for (int i = 0; i < 20; i++)
+            vecWorld[rng() % vecWorld.size()] = uint8_t(rng());
+        if (nTick % 7 == 3)
+            vecWorld.resize(vecWorld.size() + 100, uint8_t(nTick));
+        if (nTick % 11 == 5)
+            vecWorld.resize(vecWorld.size() - 300);
+
+        channel.Publish(vecWorld);
+        const olc::net::message_view<TestMsg> msg = channel.MessageFor(1);
+        ok = ok && receiver.Apply(msg);
+        ok = ok && receiver.State().size() == vecWorld.size() && std::equal(vecWorld.begin(), vecWorld.end(), receiver.State().begin());
+
+        // Ack only every other frame, so baselines lag behind
+        if (nTick % 2 == 0)
+        {
+            const olc::net::message<TestMsg> ack = receiver.Ack();
+            channel.Acknowledge(1, std::span<const uint8_t>(ack.body.data(), ack.body.size()));
+        }
+    }
+
+    return Report("channel to receiver       ", ok);
+}
+
+olc::net::message<TestMsg> Forge(uint32_t nFrame, uint32_t nBaseline, uint32_t nState, std::span<const uint8_t> payload)
+{
+    olc::net::message<TestMsg> msg;
+    msg.header.id = TestMsg::Snapshot;
+    olc::net::message_writer w(msg);
+    w << nFrame << nBaseline << nState;
+    for (uint8_t b : payload)
+        w << b;
+    return msg;
+}
+
+bool Oversized()
+{
+    olc::net::snapshot_receiver<TestMsg> receiver(TestMsg::SnapshotAck, 8, 4096);
+    const std::vector<uint8_t> vecState(100, 0x5A);
+    bool ok = receiver.Apply(Forge(1, 0, uint32_t(vecState.size()), vecState));
+
+    // An empty delta on a good baseline that claims a 4GB state
+    ok = ok && !receiver.Apply(Forge(2, 1, 0xFFFFFFFF, {}));
+    // Just over the limit, as a delta and as a keyframe
+    ok = ok && !receiver.Apply(Forge(2, 1, 4097, {}));
+    const std::vector<uint8_t> vecBig(4097, 1);
+    ok = ok && !receiver.Apply(Forge(2, 0, uint32_t(vecBig.size()), vecBig));
+
+    // Nothing changed, and the next ack asks for a keyframe
+    ok = ok && receiver.Frame() == 1 && receiver.State().size() == vecState.size()
+        && std::equal(vecState.begin(), vecState.end(), receiver.State().begin());
+    uint32_t nAck = 1;
+    olc::net::message_reader rd(receiver.Ack());
+    ok = ok && rd.read(nAck) && nAck == 0;
+
+    // Up to the limit is fine
+    const std::vector<uint8_t> vecMax(4096, 2);
+    ok = ok && receiver.Apply(Forge(3, 0, uint32_t(vecMax.size()), vecMax)) && receiver.State().size() == 4096;
+
+    // A corrupt delta leaves the current state alone even when its frame
+    // lands in the same history slot
+    const uint8_t vBad[] = { 0, 200 };
+    ok = ok && !receiver.Apply(Forge(3 + 8, 3, 4096, vBad)) && receiver.State().size() == 4096 && receiver.State()[0] == 2;
+
+    return Report("oversized state refused   ", ok);
+}
+
+int main()
+{
+    bool ok = RoundTrip();
+    ok = Corrupt() && ok;
+    ok = ChannelToReceiver() && ok;
+    ok = Oversized() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+// UringEchoBench.cpp
+//
+// Compares a server driving its TCP connections through asio's epoll
+// reactor with one using the io_uring backend of net_uring.h. The server
+// runs as a child process and echoes every message; clients in this
+// process each keep a window of messages in flight.
+//
+// Each backend is run twice: untraced, for messages per second, and then
+// with this process tracing every syscall the server makes (with ptrace,
+// as strace does) for syscalls per echoed message, by name. Tracing slows
+// the server down, so more messages pile up per read in that run than in
+// the first; both backends are measured the same way.
+//
+// Linux only.
+
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include "olc_net.h"
+
+enum class BenchMsg : uint32_t
+{
+    Echo
+};
+
+class EchoServer : public olc::net::server_interface<BenchMsg>
+{
+public:
+    EchoServer(uint16_t port) : server_interface<BenchMsg>(port) {}
+
+protected:
+    bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsg>> client) override
+    {
+        return true;
+    }
+
+    void OnMessage(std::shared_ptr<olc::net::connection<BenchMsg>> client, const olc::net::message<BenchMsg>& msg) override
+    {
+        client->Send(msg);
+    }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsg>
+{
+};
+
+// Child: serve until killed, after writing the backend in use to fdReady
+int RunServer(olc::net::io_backend backend, uint16_t port, int fdReady)
+{
+    // Connection logging would only add to the count
+    std::cout.setstate(std::ios::failbit);
+
+    EchoServer server(port);
+    server.SetIoBackend(backend);
+    if (!server.Start())
+        return 1;
+
+    const char cBackend = server.GetIoBackend() == olc::net::io_backend::uring ? 'u' : 'e';
+    if (::write(fdReady, &cBackend, 1) != 1)
+        return 1;
+    ::close(fdReady);
+
+    while (true)
+        server.Update(-1, true);
+}
+
+struct Child
+{
+    pid_t pid;
+    int fdReady;
+};
+
+// Run this program as the server; a traced one stops at exec for the
+// caller, which must be the thread that traces it
+Child Spawn(const char* sSelf, const char* sBackend, uint16_t port, bool bTraced)
+{
+    int vPipe[2];
+    if (::pipe(vPipe) != 0)
+        return { -1, -1 };
+
+    const std::string sPort = std::to_string(port);
+    const std::string sReady = std::to_string(vPipe[1]);
+    const pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::close(vPipe[0]);
+        if (bTraced)
+            ::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        ::execl(sSelf, sSelf, "server", sBackend, sPort.c_str(), sReady.c_str(), nullptr);
+        ::_exit(127);
+    }
+    ::close(vPipe[1]);
+    return { pid, vPipe[0] };
+}
+
+// The backend the server reported, or 0 if it died first
+char WaitReady(const Child& child)
+{
+    char cBackend = 0;
+    if (::read(child.fdReady, &cBackend, 1) != 1)
+        cBackend = 0;
+    ::close(child.fdReady);
+    return cBackend;
+}
+
+struct SyscallCounts
+{
+    std::atomic<bool> bCounting{ false };
+    std::array<std::atomic<uint64_t>, 512> vCounts{};
+};
+
+// Follow every thread of the traced server, counting syscall entries while
+// bCounting is set, until it exits
+void Trace(pid_t pid, SyscallCounts& counts)
+{
+    int status;
+    if (::waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+        return;
+    ::ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ::ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+
+    while (true)
+    {
+        const pid_t tid = ::waitpid(-1, &status, __WALL);
+        if (tid < 0)
+            break;
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            if (tid == pid)
+                break;
+            continue;
+        }
+
+        int nSignal = 0;
+        const int nStop = WSTOPSIG(status);
+        if (nStop == (SIGTRAP | 0x80))
+        {
+            __ptrace_syscall_info info{};
+            if (counts.bCounting.load(std::memory_order_relaxed)
+                && ::ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0
+                && info.op == PTRACE_SYSCALL_INFO_ENTRY && info.entry.nr < counts.vCounts.size())
+                counts.vCounts[info.entry.nr].fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (nStop != SIGTRAP && nStop != SIGSTOP)
+        {
+            // Thread creation and new threads stop with these; pass anything else on
+            nSignal = nStop;
+        }
+        ::ptrace(PTRACE_SYSCALL, tid, nullptr, reinterpret_cast<void*>(intptr_t(nSignal)));
+    }
+}
+
+std::string SyscallName(size_t nr)
+{
+    switch (nr)
+    {
+    case __NR_read: return "read";
+    case __NR_write: return "write";
+    case __NR_readv: return "readv";
+    case __NR_writev: return "writev";
+    case __NR_recvmsg: return "recvmsg";
+    case __NR_sendmsg: return "sendmsg";
+    case __NR_recvfrom: return "recvfrom";
+    case __NR_sendto: return "sendto";
+#ifdef __NR_epoll_wait
+    case __NR_epoll_wait: return "epoll_wait";
+#endif
+    case __NR_epoll_pwait: return "epoll_pwait";
+    case __NR_epoll_ctl: return "epoll_ctl";
+    case __NR_io_uring_enter: return "io_uring_enter";
+    case __NR_futex: return "futex";
+    case __NR_sched_yield: return "sched_yield";
+    default: return "#" + std::to_string(nr);
+    }
+}
+
+// nClients connections, each with up to nWindow messages in flight until
+// nMessages have come back. onStart runs once they are connected and warm.
+// Returns messages per second, or 0 if anything went wrong.
+template <typename OnStart, typename OnEnd>
+double RunClients(uint16_t port, int nClients, int nMessages, int nWindow, size_t nBody, OnStart onStart, OnEnd onEnd)
+{
+    olc::net::message<BenchMsg> msg;
+    msg.header.id = BenchMsg::Echo;
+    msg.body.resize(nBody);
+
+    std::vector<std::unique_ptr<BenchClient>> vecClients;
+    for (int i = 0; i < nClients; i++)
+    {
+        vecClients.push_back(std::make_unique<BenchClient>());
+        if (!vecClients.back()->Connect("127.0.0.1", port))
+            return 0.0;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (auto& client : vecClients)
+    {
+        while (!client->IsConnected() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int i = 0; i < 100; i++)
+        {
+            client->Send(msg);
+            client->Incoming().pop_front();
+        }
+    }
+
+    std::atomic<bool> ok{ true };
+    onStart();
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> vecThreads;
+    for (auto& client : vecClients)
+    {
+        vecThreads.emplace_back([&, pClient = client.get()]()
+        {
+            int nSent = 0;
+            for (int nReceived = 0; nReceived < nMessages; nReceived++)
+            {
+                while (nSent < nMessages && nSent - nReceived < nWindow)
+                {
+                    pClient->Send(msg);
+                    nSent++;
+                }
+                if (pClient->Incoming().pop_front().msg.body.size() != nBody)
+                    ok.store(false);
+            }
+        });
+    }
+    for (auto& thread : vecThreads)
+        thread.join();
+    const double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    onEnd();
+
+    for (auto& client : vecClients)
+        client->Disconnect();
+    return ok.load() ? double(nClients) * nMessages / fSeconds : 0.0;
+}
+
+bool Run(const char* sSelf, const char* sBackend, uint16_t port, int nClients, int nMessages, int nTraced, int nWindow, size_t nBody)
+{
+    // Untraced, for throughput
+    Child child = Spawn(sSelf, sBackend, port, false);
+    const char cBackend = WaitReady(child);
+    const double fRate = cBackend ? RunClients(port, nClients, nMessages, nWindow, nBody, []() {}, []() {}) : 0.0;
+    ::kill(child.pid, SIGKILL);
+    ::waitpid(child.pid, nullptr, 0);
+
+    const char* sUsing = cBackend == 'u' ? "uring" : "epoll";
+    std::cout << std::fixed << std::setprecision(0) << std::setw(5) << sBackend
+        << " (running " << sUsing << ")  msgs/sec: " << std::setw(8) << fRate << std::endl;
+    if (fRate == 0.0)
+        return false;
+
+    // Traced, for syscalls per message
+    port++;
+    SyscallCounts counts;
+    std::atomic<pid_t> pidTraced{ 0 };
+    std::atomic<int> fdReady{ -1 };
+    std::thread tracer([&]()
+    {
+        const Child traced = Spawn(sSelf, sBackend, port, true);
+        fdReady.store(traced.fdReady);
+        pidTraced.store(traced.pid);
+        Trace(traced.pid, counts);
+    });
+    while (pidTraced.load() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    bool ok = WaitReady({ pidTraced.load(), fdReady.load() }) != 0;
+    if (ok)
+    {
+        ok = RunClients(port, nClients, nTraced, nWindow, nBody,
+            [&]() { counts.bCounting.store(true); },
+            [&]() { counts.bCounting.store(false); }) > 0.0;
+    }
+    ::kill(pidTraced.load(), SIGKILL);
+    tracer.join();
+    ::waitpid(pidTraced.load(), nullptr, 0);
+
+    const double fMessages = double(nClients) * nTraced;
+    std::vector<std::pair<uint64_t, size_t>> vecTop;
+    uint64_t nTotal = 0;
+    for (size_t nr = 0; nr < counts.vCounts.size(); nr++)
+    {
+        const uint64_t n = counts.vCounts[nr].load();
+        nTotal += n;
+        if (n)
+            vecTop.push_back({ n, nr });
+    }
+    std::sort(vecTop.rbegin(), vecTop.rend());
+
+    std::cout << std::setprecision(3) << "      syscalls/msg: " << double(nTotal) / fMessages << "  (";
+    for (size_t i = 0; i < vecTop.size() && i < 5; i++)
+        std::cout << (i ? ", " : "") << SyscallName(vecTop[i].second) << " " << double(vecTop[i].first) / fMessages;
+    std::cout << ")" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 5 && std::string(argv[1]) == "server")
+    {
+        const auto backend = std::string(argv[2]) == "uring" ? olc::net::io_backend::uring : olc::net::io_backend::epoll;
+        return RunServer(backend, static_cast<uint16_t>(std::stoi(argv[3])), std::stoi(argv[4]));
+    }
+
+    uint16_t port = 61000;
+    int clients = 4;
+    int messages = 50000;
+    int traced = 5000;
+    if (argc == 5)
+    {
+        port = static_cast<uint16_t>(std::stoi(argv[1]));
+        clients = std::stoi(argv[2]);
+        messages = std::stoi(argv[3]);
+        traced = std::stoi(argv[4]);
+    }
+    else
+    {
+        std::cout << "Usage: UringEchoBench [port] [clients] [messages per client] [traced messages per client]\n"
+            << "Using defaults " << port << " " << clients << " " << messages << " " << traced << std::endl;
+    }
+
+    const int nWindow = 32;
+    const size_t nBody = 64;
+    bool ok = Run("/proc/self/exe", "epoll", port, clients, messages, traced, nWindow, nBody);
+    ok = Run("/proc/self/exe", "uring", port + 2, clients, messages, traced, nWindow, nBody) && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -1,89 +1,329 @@
 #pragma once
-#pragma once
 
 #include <atomic>
 #include <memory>
+#include <new>
+#include <span>
 #include <utility>
+#include <vector>
+#include <algorithm>
 
 // A lock-free MPMC queue based on Michael & Scott (1996)
 // Supports multiple producers and multiple consumers.
 // Requires C++17 for std::atomic<>
+//
+// Elements are stored inline in the nodes. A node that leaves the queue is
+// not freed: it is retired, and once no hazard pointer refers to it any
+// more it goes onto a free list and is reused by a later push. Nodes are
+// only released to Alloc when the queue itself is destroyed, so the
+// steady state does no allocation and no consumer ever touches freed
+// memory, however many threads are popping at once.
 
 namespace olc {
     namespace net {
 
-        template<typename T>
+        template<typename T, typename Alloc = std::allocator<T>>
         class lockfree_queue {
         private:
             struct Node {
-                std::shared_ptr<T> data;
-                std::atomic<Node*> next;
-                Node() : next(nullptr) {}
-                Node(const T& value) : data(std::make_shared<T>(value)), next(nullptr) {}
-                Node(T&& value) : data(std::make_shared<T>(std::move(value))), next(nullptr) {}
+                std::atomic<Node*> next{ nullptr };
+                alignas(T) unsigned char storage[sizeof(T)];
+
+                T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+            };
+
+            // Every push/pop borrows one of these for its duration. Records are
+            // never freed before the queue, so a scan can walk them at any time.
+            // Retired nodes are parked on whichever record retired them.
+            struct alignas(64) HazardRecord {
+                std::atomic<Node*> hazard[2] = { nullptr, nullptr };
+                std::atomic<bool> active{ false };
+                HazardRecord* next = nullptr; // fixed once the record is published
+                std::vector<Node*, typename std::allocator_traits<Alloc>::template rebind_alloc<Node*>> retired;
+                std::vector<Node*, typename std::allocator_traits<Alloc>::template rebind_alloc<Node*>> scratch;
+
+                explicit HazardRecord(const Alloc& alloc) : retired(alloc), scratch(alloc) {}
             };
 
+            using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+            using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+            class HazardGuard {
+            public:
+                explicit HazardGuard(lockfree_queue& q) : rec(q.acquire_record()) {}
+                ~HazardGuard() {
+                    rec->hazard[0].store(nullptr, std::memory_order_release);
+                    rec->hazard[1].store(nullptr, std::memory_order_release);
+                    rec->active.store(false, std::memory_order_release);
+                }
+                HazardRecord* rec;
+            };
+
+            Alloc m_alloc;
+
             // Head: points to dummy node; consumers advance head
-            std::atomic<Node*> head;
+            alignas(64) std::atomic<Node*> head;
             // Tail: points to last node; producers advance tail
-            std::atomic<Node*> tail;
+            alignas(64) std::atomic<Node*> tail;
+            // Recycled nodes, linked through Node::next
+            alignas(64) std::atomic<Node*> m_free{ nullptr };
+            std::atomic<HazardRecord*> m_records{ nullptr };
+            std::atomic<size_t> m_nRecords{ 0 };
 
         public:
-            lockfree_queue() {
-                Node* dummy = new Node;
+            explicit lockfree_queue(const Alloc& alloc = Alloc()) : m_alloc(alloc) {
+                Node* dummy = allocate_node();
                 head.store(dummy, std::memory_order_relaxed);
                 tail.store(dummy, std::memory_order_relaxed);
             }
 
+            lockfree_queue(const lockfree_queue&) = delete;
+            lockfree_queue& operator=(const lockfree_queue&) = delete;
+
+            // Not safe to call while other threads are still using the queue
             ~lockfree_queue() {
-                // Drain & delete remaining nodes
-                while (pop());
-                delete head.load();
+                Node* n = head.load(std::memory_order_relaxed);
+                Node* nx = n->next.load(std::memory_order_relaxed);
+                free_node(n);
+                for (n = nx; n; n = nx) {
+                    nx = n->next.load(std::memory_order_relaxed);
+                    n->value()->~T();
+                    free_node(n);
+                }
+
+                for (n = m_free.load(std::memory_order_relaxed); n; n = nx) {
+                    nx = n->next.load(std::memory_order_relaxed);
+                    free_node(n);
+                }
+
+                HazardRecord* r = m_records.load(std::memory_order_relaxed);
+                while (r) {
+                    HazardRecord* rn = r->next;
+                    for (Node* retired : r->retired)
+                        free_node(retired);
+                    delete r;
+                    r = rn;
+                }
             }
 
             // Enqueue a new item (copy)
             void push(const T& value) {
-                Node* new_node = new Node(value);
-                Node* prev_tail = tail.exchange(new_node, std::memory_order_acq_rel);
-                prev_tail->next.store(new_node, std::memory_order_release);
+                emplace(value);
             }
 
             // Enqueue a new item (move)
             void push(T&& value) {
-                Node* new_node = new Node(std::move(value));
-                Node* prev_tail = tail.exchange(new_node, std::memory_order_acq_rel);
-                prev_tail->next.store(new_node, std::memory_order_release);
-            }
-
-            // Try to dequeue an item. Returns nullptr if empty.
-            std::shared_ptr<T> pop() {
-                Node* old_head = head.load(std::memory_order_acquire);
-                Node* next = old_head->next.load(std::memory_order_acquire);
-                if (!next) {
-                    // queue is empty
-                    return nullptr;
+                emplace(std::move(value));
+            }
+
+            // Enqueue an item constructed in place
+            template<typename... Args>
+            void emplace(Args&&... args) {
+                HazardGuard guard(*this);
+                Node* node = take_node(guard.rec);
+                try {
+                    ::new (static_cast<void*>(node->storage)) T(std::forward<Args>(args)...);
+                }
+                catch (...) {
+                    retire(guard.rec, node);
+                    throw;
+                }
+                node->next.store(nullptr, std::memory_order_relaxed);
+
+                while (true) {
+                    Node* t = protect(tail, guard.rec->hazard[0]);
+                    Node* next = t->next.load(std::memory_order_acquire);
+                    if (t != tail.load(std::memory_order_acquire))
+                        continue;
+
+                    if (next == nullptr) {
+                        if (t->next.compare_exchange_weak(next, node, std::memory_order_release, std::memory_order_relaxed)) {
+                            tail.compare_exchange_strong(t, node, std::memory_order_release, std::memory_order_relaxed);
+                            return;
+                        }
+                    }
+                    else {
+                        // Another producer linked a node but has not swung tail yet; help it
+                        tail.compare_exchange_weak(t, next, std::memory_order_release, std::memory_order_relaxed);
+                    }
                 }
-                // Advance head
-                if (head.compare_exchange_strong(old_head, next, std::memory_order_acq_rel)) {
-                    std::shared_ptr<T> res = next->data;
-                    delete old_head;
-                    return res;
+            }
+
+            // Try to dequeue an item into out. Returns false if empty.
+            bool pop(T& out) {
+                HazardGuard guard(*this);
+                while (true) {
+                    Node* h = protect(head, guard.rec->hazard[0]);
+                    Node* t = tail.load(std::memory_order_acquire);
+                    Node* next = h->next.load(std::memory_order_acquire);
+                    guard.rec->hazard[1].store(next, std::memory_order_seq_cst);
+                    if (h != head.load(std::memory_order_seq_cst))
+                        continue;
+
+                    if (next == nullptr) {
+                        // queue is empty
+                        return false;
+                    }
+
+                    if (h == t) {
+                        tail.compare_exchange_weak(t, next, std::memory_order_release, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    // Advance head. The winner owns next's value; next itself becomes
+                    // the new dummy and stays protected until we are done with it.
+                    if (head.compare_exchange_strong(h, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        T* value = next->value();
+                        out = std::move(*value);
+                        value->~T();
+                        retire(guard.rec, h);
+                        return true;
+                    }
                 }
-                return nullptr;
             }
 
-            std::shared_ptr<T> peek() const {
-                // Head is a dummy; the real first item is head->next
-                Node* h = head.load(std::memory_order_acquire);
+            // Pop up to out.size() items into out, returning how many were taken
+            size_t pop_batch(std::span<T> out) {
+                size_t n = 0;
+                while (n < out.size() && pop(out[n]))
+                    n++;
+                return n;
+            }
+
+            // Hand up to nMax items to fn(T&&) in order, returning how many were handled
+            template<typename Fn>
+            size_t drain(Fn&& fn, size_t nMax = size_t(-1)) {
+                size_t n = 0;
+                T item;
+                while (n < nMax && pop(item)) {
+                    fn(std::move(item));
+                    n++;
+                }
+                return n;
+            }
+
+            // Pointer to the front element, or nullptr if empty. The element stays
+            // valid until it is popped, so this is only safe to use from the one
+            // thread that pops.
+            T* peek() {
+                HazardGuard guard(*this);
+                Node* h = protect(head, guard.rec->hazard[0]);
                 Node* nx = h->next.load(std::memory_order_acquire);
-                return nx ? nx->data : nullptr;
+                return nx ? nx->value() : nullptr;
             }
 
             // Non-blocking test for emptiness
             bool empty() const {
-                Node* hd = head.load(std::memory_order_acquire);
-                Node* nx = hd->next.load(std::memory_order_acquire);
-                return (nx == nullptr);
+                // Nodes are never freed while the queue lives, so an unprotected read
+                // is safe; retry if head moved underneath us so next is not stale.
+                while (true) {
+                    Node* hd = head.load(std::memory_order_acquire);
+                    Node* nx = hd->next.load(std::memory_order_acquire);
+                    if (hd == head.load(std::memory_order_acquire))
+                        return (nx == nullptr);
+                }
+            }
+
+        private:
+            // Publish p in the hazard slot and confirm src still points to it, so
+            // it cannot be recycled while we use it.
+            static Node* protect(const std::atomic<Node*>& src, std::atomic<Node*>& hazard) {
+                Node* p = src.load(std::memory_order_relaxed);
+                while (true) {
+                    hazard.store(p, std::memory_order_seq_cst);
+                    Node* q = src.load(std::memory_order_seq_cst);
+                    if (q == p)
+                        return p;
+                    p = q;
+                }
+            }
+
+            HazardRecord* acquire_record() {
+                for (HazardRecord* r = m_records.load(std::memory_order_acquire); r; r = r->next) {
+                    bool expected = false;
+                    if (!r->active.load(std::memory_order_relaxed)
+                        && r->active.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                        return r;
+                }
+
+                // Plain (aligned) new rather than Alloc: there are only ever
+                // a few records, and their cache-line padding must hold
+                // whatever alignment Alloc gives
+                HazardRecord* r = new HazardRecord(m_alloc);
+                r->active.store(true, std::memory_order_relaxed);
+
+                HazardRecord* first = m_records.load(std::memory_order_relaxed);
+                do {
+                    r->next = first;
+                } while (!m_records.compare_exchange_weak(first, r, std::memory_order_release, std::memory_order_relaxed));
+                m_nRecords.fetch_add(1, std::memory_order_relaxed);
+                return r;
+            }
+
+            // Pop a recycled node, or allocate a new one if none are free. The
+            // hazard pointer stops a node we are looking at from being popped,
+            // reused and pushed back underneath us (ABA).
+            Node* take_node(HazardRecord* rec) {
+                while (true) {
+                    Node* top = protect(m_free, rec->hazard[0]);
+                    if (!top)
+                        break;
+                    Node* next = top->next.load(std::memory_order_relaxed);
+                    if (m_free.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        rec->hazard[0].store(nullptr, std::memory_order_release);
+                        return top;
+                    }
+                }
+                rec->hazard[0].store(nullptr, std::memory_order_release);
+                return allocate_node();
+            }
+
+            void retire(HazardRecord* rec, Node* node) {
+                rec->retired.push_back(node);
+                if (rec->retired.size() >= 2 * 2 * m_nRecords.load(std::memory_order_relaxed) + 32)
+                    scan(rec);
+            }
+
+            // Recycle every retired node that no hazard pointer refers to
+            void scan(HazardRecord* rec) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                rec->scratch.clear();
+                for (HazardRecord* r = m_records.load(std::memory_order_acquire); r; r = r->next) {
+                    for (auto& hp : r->hazard) {
+                        Node* p = hp.load(std::memory_order_seq_cst);
+                        if (p)
+                            rec->scratch.push_back(p);
+                    }
+                }
+                std::sort(rec->scratch.begin(), rec->scratch.end());
+
+                size_t nKept = 0;
+                for (Node* node : rec->retired) {
+                    if (std::binary_search(rec->scratch.begin(), rec->scratch.end(), node)) {
+                        rec->retired[nKept++] = node;
+                    }
+                    else {
+                        Node* top = m_free.load(std::memory_order_relaxed);
+                        do {
+                            node->next.store(top, std::memory_order_relaxed);
+                        } while (!m_free.compare_exchange_weak(top, node, std::memory_order_release, std::memory_order_relaxed));
+                    }
+                }
+                rec->retired.resize(nKept);
+            }
+
+            Node* allocate_node() {
+                NodeAlloc na(m_alloc);
+                Node* n = NodeTraits::allocate(na, 1);
+                ::new (static_cast<void*>(n)) Node();
+                return n;
+            }
+
+            void free_node(Node* n) {
+                NodeAlloc na(m_alloc);
+                n->~Node();
+                NodeTraits::deallocate(na, n, 1);
             }
         };
 
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <span>
+#include <thread>
+#include <utility>
+
+// A bounded multi-producer, single-consumer ring buffer (after Vyukov's
+// bounded queue). Producers claim a slot with one CAS on the enqueue
+// position; each slot carries a sequence number that says whether it is
+// free, full, or still being written, so the consumer never takes a lock
+// or performs an atomic RMW, and can walk many full slots in one go.
+//
+// When the ring is full:
+//   * try_push() returns false and leaves the value untouched.
+//   * push() waits for the consumer to free a slot: it spins briefly,
+//     then yields, then sleeps in short steps.
+// Connections feed the inbound message queue with try_push(), and stop
+// reading the one socket that found it full until there is room, so a
+// consumer that falls behind pushes back on the peers through TCP flow
+// control instead of growing memory without bound, and without stalling
+// the other connections on the same io thread.
+//
+// pop/pop_batch/drain must only ever be called from one thread at a time.
+
+namespace olc {
+    namespace net {
+
+        template<typename T, typename Alloc = std::allocator<T>>
+        class mpsc_ring_queue {
+        public:
+            static constexpr size_t nDefaultCapacity = 16384;
+
+            // Capacity is rounded up to a power of two
+            explicit mpsc_ring_queue(size_t nCapacity = nDefaultCapacity, const Alloc& alloc = Alloc())
+                : m_alloc(alloc) {
+                m_nCapacity = 2;
+                while (m_nCapacity < nCapacity)
+                    m_nCapacity <<= 1;
+                m_nMask = m_nCapacity - 1;
+
+                m_pCells = CellTraits::allocate(m_alloc, m_nCapacity);
+                for (size_t i = 0; i < m_nCapacity; i++)
+                    ::new (static_cast<void*>(&m_pCells[i])) Cell(i);
+            }
+
+            mpsc_ring_queue(const mpsc_ring_queue&) = delete;
+            mpsc_ring_queue& operator=(const mpsc_ring_queue&) = delete;
+
+            ~mpsc_ring_queue() {
+                T item;
+                while (pop(item));
+                for (size_t i = 0; i < m_nCapacity; i++)
+                    m_pCells[i].~Cell();
+                CellTraits::deallocate(m_alloc, m_pCells, m_nCapacity);
+            }
+
+            size_t capacity() const {
+                return m_nCapacity;
+            }
+
+            // Enqueue, waiting for space if the ring is full
+            void push(const T& value) {
+                emplace(value);
+            }
+
+            void push(T&& value) {
+                emplace(std::move(value));
+            }
+
+            template<typename... Args>
+            void emplace(Args&&... args) {
+                for (size_t nSpins = 0; !try_emplace(std::forward<Args>(args)...); nSpins++) {
+                    if (nSpins < 64)
+                        continue;
+                    else if (nSpins < 1024)
+                        std::this_thread::yield();
+                    else
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+
+            // Enqueue if there is room; returns false if the ring is full. The
+            // arguments are only consumed on success.
+            bool try_push(const T& value) {
+                return try_emplace(value);
+            }
+
+            bool try_push(T&& value) {
+                return try_emplace(std::move(value));
+            }
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args) {
+                size_t pos = m_nEnqueue.load(std::memory_order_relaxed);
+                Cell* cell;
+                while (true) {
+                    cell = &m_pCells[pos & m_nMask];
+                    size_t seq = cell->seq.load(std::memory_order_acquire);
+                    intptr_t dif = intptr_t(seq) - intptr_t(pos);
+                    if (dif == 0) {
+                        if (m_nEnqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (dif < 0) {
+                        return false; // full
+                    }
+                    else {
+                        pos = m_nEnqueue.load(std::memory_order_relaxed);
+                    }
+                }
+
+                ::new (static_cast<void*>(cell->storage)) T(std::forward<Args>(args)...);
+                cell->seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Single consumer: dequeue one item, false if empty
+            bool pop(T& out) {
+                Cell& cell = m_pCells[m_nDequeue & m_nMask];
+                if (cell.seq.load(std::memory_order_acquire) != m_nDequeue + 1)
+                    return false;
+
+                T* value = cell.value();
+                out = std::move(*value);
+                value->~T();
+                cell.seq.store(m_nDequeue + m_nCapacity, std::memory_order_release);
+                m_nDequeue++;
+                return true;
+            }
+
+            // Single consumer: move up to out.size() items into out, returning how
+            // many were taken
+            size_t pop_batch(std::span<T> out) {
+                size_t n = 0;
+                while (n < out.size() && pop(out[n]))
+                    n++;
+                return n;
+            }
+
+            // Single consumer: hand up to nMax items to fn(T&&) in order, returning
+            // how many were handled. Each slot is released as soon as fn returns.
+            template<typename Fn>
+            size_t drain(Fn&& fn, size_t nMax = size_t(-1)) {
+                size_t n = 0;
+                while (n < nMax) {
+                    Cell& cell = m_pCells[m_nDequeue & m_nMask];
+                    if (cell.seq.load(std::memory_order_acquire) != m_nDequeue + 1)
+                        break;
+
+                    T* value = cell.value();
+                    fn(std::move(*value));
+                    value->~T();
+                    cell.seq.store(m_nDequeue + m_nCapacity, std::memory_order_release);
+                    m_nDequeue++;
+                    n++;
+                }
+                return n;
+            }
+
+            // Single consumer: pointer to the front item, or nullptr if empty
+            T* peek() {
+                Cell& cell = m_pCells[m_nDequeue & m_nMask];
+                if (cell.seq.load(std::memory_order_acquire) != m_nDequeue + 1)
+                    return nullptr;
+                return cell.value();
+            }
+
+            bool empty() const {
+                const Cell& cell = m_pCells[m_nDequeue & m_nMask];
+                return cell.seq.load(std::memory_order_acquire) != m_nDequeue + 1;
+            }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> seq;
+                alignas(T) unsigned char storage[sizeof(T)];
+
+                explicit Cell(size_t s) : seq(s) {}
+                T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+            };
+
+            using CellAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Cell>;
+            using CellTraits = std::allocator_traits<CellAlloc>;
+
+            CellAlloc m_alloc;
+            Cell* m_pCells = nullptr;
+            size_t m_nCapacity = 0;
+            size_t m_nMask = 0;
+
+            // Producers and the consumer each get their own cache line
+            alignas(64) std::atomic<size_t> m_nEnqueue{ 0 };
+            alignas(64) size_t m_nDequeue = 0;
+            char m_pad[64 - sizeof(size_t)];
+        };
+
+    } // namespace net
+} // namespace olc
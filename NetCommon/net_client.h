@@ -1,5 +1,8 @@
 #pragma once
 #include "net_common.h"
+#include "net_tsqueue.h"
+#include "net_message.h"
+#include "net_connection.h"
 
 namespace olc
 {
@@ -30,7 +33,7 @@ namespace olc
 					asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
 
 					// Create connection
-					m_connection = std::make_unique<connection<T>>(connection<T>::owner::client, m_context, asio::ip::tcp::socket(m_context), m_qMessagesIn);
+					CreateConnection(asio::ip::tcp::socket(m_context));
 
 					// Tell the connection object to connect to server
 					m_connection->ConnectToServer(endpoints);
@@ -46,6 +49,61 @@ namespace olc
 				return true;
 			}
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+			// Connect to a server on this host through its Unix domain socket at
+			// sPath; see server_interface::ListenLocal. There is no datagram
+			// channel this way.
+			bool Connect(const std::string& sPath)
+			{
+				try
+				{
+					CreateConnection(asio::local::stream_protocol::socket(m_context));
+					m_connection->ConnectToServer(asio::local::stream_protocol::endpoint(sPath));
+
+					thrContext = std::thread([this]() { m_context.run(); });
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "Client Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+#endif
+
+#if defined(__linux__)
+			// Connect to a server on this host through its shared memory segment
+			// sName; see server_interface::ListenShared. Waits up to timeout for
+			// OnClientConnect(), and is connected on return if it succeeds.
+			bool ConnectShared(const std::string& sName, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+			{
+				try
+				{
+					auto segment = std::make_shared<shm_segment>(sName);
+					const int nSlot = shm_claim(*segment, timeout);
+					if (nSlot < 0)
+						return false;
+
+					auto link = std::make_shared<shm_link<T>>(std::move(segment), uint32_t(nSlot), false);
+					link->SetSpin(m_sharedSpin);
+					CreateConnection(stream_socket(m_context));
+					m_connection->AttachShared(std::move(link));
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "Client Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+
+			// See server_interface::SetSharedSpin; call before ConnectShared()
+			void SetSharedSpin(std::chrono::nanoseconds spin)
+			{
+				m_sharedSpin = spin;
+			}
+#endif
+
 			// Disconnect from server
 			void Disconnect()
 			{
@@ -83,12 +141,105 @@ namespace olc
 					m_connection->Send(msg);
 			}
 
+			// Takes over msg's body instead of copying it
+			void Send(message<T>&& msg)
+			{
+				if (IsConnected())
+					m_connection->Send(std::move(msg));
+			}
+
+			// Build the message in place; see connection::EmplaceSend
+			template<typename Build>
+			void EmplaceSend(Build&& build)
+			{
+				if (IsConnected())
+					m_connection->EmplaceSend(std::forward<Build>(build));
+			}
+
+			// Accept compact headers if the server offers them; call before Connect()
+			void SetFraming(framing mode)
+			{
+				m_nFraming = mode;
+			}
+
+			// Accept compression if the server offers it, compressing bodies of at
+			// least nMinBytes; call before Connect()
+			void SetCompression(size_t nMinBytes)
+			{
+				m_nCompressMin = nMinBytes;
+			}
+
+			// Accept a datagram channel if the server offers one; call before
+			// Connect(). See connection::SendUnreliable and SendDatagram.
+			void EnableDatagrams()
+			{
+				m_bDatagrams = true;
+			}
+
+			// For testing: lose fLoss of the datagrams sent, and delay fReorder of
+			// the rest by up to maxDelay; call before Connect()
+			void SetSimulatedLoss(double fLoss, double fReorder = 0.0, std::chrono::microseconds maxDelay = std::chrono::milliseconds(2))
+			{
+				m_fSimulatedLoss = fLoss;
+				m_fSimulatedReorder = fReorder;
+				m_simulatedDelay = maxDelay;
+			}
+
+			// See connection::SetChannel and connection::SetTransport; call before
+			// Connect()
+			void SetChannel(uint8_t nChannel, delivery mode)
+			{
+				if (nChannel < nReliableChannels)
+					m_vChannels[nChannel] = mode;
+			}
+
+			void SetTransport(transport mode)
+			{
+				m_nTransport = mode;
+			}
+
+			// Send a message as a datagram; false if there is no datagram channel
+			bool SendUnreliable(const message<T>& msg)
+			{
+				return IsConnected() && m_connection->SendUnreliable(msg);
+			}
+
+			bool SendUnreliable(message<T>&& msg)
+			{
+				return IsConnected() && m_connection->SendUnreliable(std::move(msg));
+			}
+
+			// Send a message on a datagram channel; false if there is none
+			bool SendDatagram(uint8_t nChannel, const message<T>& msg)
+			{
+				return IsConnected() && m_connection->SendDatagram(nChannel, msg);
+			}
+
+			bool SendDatagram(uint8_t nChannel, message<T>&& msg)
+			{
+				return IsConnected() && m_connection->SendDatagram(nChannel, std::move(msg));
+			}
+
 			// Retrieve queue of messages from server
-			tsqueue<owned_message<T>>& Incoming()
+			incoming_queue<T>& Incoming()
 			{
 				return m_qMessagesIn;
 			}
 
+		private:
+			void CreateConnection(stream_socket socket)
+			{
+				m_connection = std::make_unique<connection<T>>(connection<T>::owner::client, m_context, std::move(socket), m_qMessagesIn);
+				m_connection->SetFraming(m_nFraming);
+				m_connection->SetCompression(m_nCompressMin);
+				m_connection->SetSimulatedLoss(m_fSimulatedLoss, m_fSimulatedReorder, m_simulatedDelay);
+				m_connection->SetTransport(m_nTransport);
+				for (uint8_t nChannel = 0; nChannel < nReliableChannels; nChannel++)
+					m_connection->SetChannel(nChannel, m_vChannels[nChannel]);
+				if (m_bDatagrams)
+					m_connection->EnableDatagrams();
+			}
+
 		protected:
 			// asio context handles the data transfer...
 			asio::io_context m_context;
@@ -96,10 +247,21 @@ namespace olc
 			std::thread thrContext;
 			// The client has a single instance of a "connection" object, which handles data transfer
 			std::unique_ptr<connection<T>> m_connection;
+			framing m_nFraming = framing::fixed;
+			size_t m_nCompressMin = 0;
+			bool m_bDatagrams = false;
+			double m_fSimulatedLoss = 0.0;
+			double m_fSimulatedReorder = 0.0;
+			std::chrono::microseconds m_simulatedDelay{ 0 };
+			channel_modes m_vChannels = default_channels();
+			transport m_nTransport = transport::stream;
+#if defined(__linux__)
+			std::chrono::nanoseconds m_sharedSpin = shm_default_spin();
+#endif
 
 		private:
 			// This is the thread safe queue of incoming messages from server
-			tsqueue<owned_message<T>> m_qMessagesIn;
+			incoming_queue<T> m_qMessagesIn;
 		};
 	}
 }
\ No newline at end of file
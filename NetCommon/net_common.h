@@ -4,12 +4,16 @@
 #include <thread>
 #include <mutex>
 #include <deque>
+#include <unordered_map>
 #include <optional>
+#include <span>
 #include <vector>
 #include <iostream>
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <atomic>
 
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0601
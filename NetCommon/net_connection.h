@@ -3,6 +3,11 @@
 #include "net_common.h"
 #include "net_tsqueue.h"
 #include "net_message.h"
+#include "net_framing.h"
+#include "net_datagram.h"
+#include "net_reliable.h"
+#include "net_shm.h"
+#include "net_uring.h"
 
 namespace olc
 {
@@ -11,6 +16,43 @@ namespace olc
 		template<typename T>
 		class server_interface;
 
+		// Inbound messages are pushed by io threads and popped by the one thread
+		// that calls Update() or drains Incoming(), so they travel through a
+		// bounded MPSC ring. When it fills, a connection stops reading its own
+		// socket until there is room, and TCP flow control slows that peer.
+		template<typename T>
+		using incoming_queue = tsqueue<owned_message<T>, pool_allocator<owned_message<T>>,
+			mpsc_ring_queue<owned_message<T>, pool_allocator<owned_message<T>>>>;
+
+		// What Send() does once a connection's outbound queue is over one of its
+		// high-water marks
+		enum class backpressure_policy
+		{
+			block,       // wait until the queue drains (never on the connection's own io thread)
+			drop_oldest, // discard the oldest messages not yet being written
+			drop_new,    // discard the message being sent
+			coalesce,    // replace a queued message with the same key, else discard
+			disconnect   // close the connection
+		};
+
+		// What carries Send()'s messages once a datagram channel is up
+		enum class transport
+		{
+			stream,  // the TCP connection
+			datagram // datagram channel 0, reliable and ordered unless set otherwise
+		};
+
+		// A connection's socket: TCP, or a Unix domain socket for clients on the
+		// same host. Either carries the same handshake and framing.
+		using stream_socket = asio::generic::stream_protocol::socket;
+
+		// How received bodies reach the inbound queue
+		enum class receive_mode
+		{
+			copy, // copied out of the receive buffer into owned_message::msg
+			view  // owned_message::view points into the receive buffer itself
+		};
+
 		template<typename T>
 		class connection : public std::enable_shared_from_this<connection<T>>
 		{
@@ -21,8 +63,8 @@ namespace olc
 				client
 			};
 
-			connection(owner parent, asio::io_context& asioContext, asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn)
-				: m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+			connection(owner parent, asio::io_context& asioContext, stream_socket socket, incoming_queue<T>& qIn)
+				: m_asioContext(asioContext), m_socket(std::move(socket)), m_timerHello(asioContext), m_qMessagesIn(qIn), m_timerInbound(asioContext)
 			{
 				
 
@@ -42,23 +84,56 @@ namespace olc
 			}
 
 			virtual ~connection()
-			{}
+			{
+#if defined(__linux__)
+				if (m_pShared)
+					m_pShared->Close();
+				if (m_pUring)
+					m_pUring->Abandon();
+#endif
+			}
 
 			uint32_t GetID() const
 			{
 				return id;
 			}
 
+			// The io context this connection's handlers run on
+			asio::io_context& GetContext()
+			{
+				return m_asioContext;
+			}
+
 		public:
 			void ConnectToClient(olc::net::server_interface<T>* server, uint32_t uid = 0)
 			{
 				if (m_nOwnerType == owner::server)
 				{
-					if (m_socket.is_open())
+					if (IsConnected())
 					{
 						id = uid;
-						WriteValidation();
-						ReadValidation(server);
+						m_pServer = server;
+
+						// A datagram token stands in for the nonce, so the client learns it
+						if (m_nDatagramToken)
+							m_nHandshakeOut = m_nDatagramToken;
+
+						// Offer optional wire features in the top byte of the handshake.
+						// Its top bit is never set by a plain timestamp, so clients can
+						// tell an offer from an older server's handshake.
+						if (m_nWireFeatures)
+						{
+							m_nHandshakeOut = (m_nHandshakeOut & nHandshakeNonceMask) | (uint64_t(0x80 | m_nWireFeatures) << 56);
+							m_nHandshakeCheck = scramble(m_nHandshakeOut);
+						}
+
+						// The caller may be on another io thread (the acceptor's), so
+						// start the handshake on the connection's own context
+						asio::post(m_asioContext, [this, server]()
+							{
+								WriteValidation();
+								ReadValidation(server);
+							});
 					}
 				}
 			}
@@ -67,8 +142,13 @@ namespace olc
 			{
 				if (m_nOwnerType == owner::client)
 				{
-					asio::async_connect(m_socket, endpoints,
-						[this](std::error_code ec, asio::ip::tcp::endpoint endpoint)
+					// The socket takes any protocol, so it wants generic endpoints
+					std::vector<asio::generic::stream_protocol::endpoint> vecEndpoints;
+					for (const auto& entry : endpoints)
+						vecEndpoints.emplace_back(entry.endpoint());
+
+					asio::async_connect(m_socket, vecEndpoints,
+						[this](std::error_code ec, const asio::generic::stream_protocol::endpoint&)
 						{
 							if (!ec)
 							{
@@ -79,140 +159,1312 @@ namespace olc
 				}
 			}
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+			void ConnectToServer(const asio::local::stream_protocol::endpoint& endpoint)
+			{
+				if (m_nOwnerType == owner::client)
+				{
+					m_socket.async_connect(endpoint,
+						[this](std::error_code ec)
+						{
+							if (!ec)
+							{
+								ReadValidation();
+							}
+						});
+				}
+			}
+#endif
+
+			// True if the socket is TCP, so the peer has an IP address
+			bool IsNetworked() const
+			{
+#if defined(__linux__)
+				if (m_pUring)
+					return m_pUring->Family() == AF_INET || m_pUring->Family() == AF_INET6;
+#endif
+				asio::error_code ec;
+				const int nFamily = m_socket.local_endpoint(ec).protocol().family();
+				return !ec && (nFamily == AF_INET || nFamily == AF_INET6);
+			}
+
 			void Disconnect()
 
 			{
+#if defined(__linux__)
+				if (m_pShared)
+				{
+					m_pShared->Close();
+					return;
+				}
+#endif
 				if (IsConnected())
 				{
-					asio::post(m_asioContext, [this]() { m_socket.close(); });
+					asio::post(m_asioContext, [this]() { CloseSocket(); });
 				}
 			}
 
 			bool IsConnected() const
 			{
+#if defined(__linux__)
+				if (m_pShared)
+					return m_pShared->IsOpen();
+				if (m_pUring)
+					return m_pUring->IsOpen();
+#endif
 				return m_socket.is_open();
 			}
 
+#if defined(__linux__)
+			// Carry this connection over a shared memory slot instead of the
+			// socket, which stays closed; see net_shm.h. There is no handshake:
+			// the slot was already accepted, and frames need no negotiation.
+			void AttachShared(std::shared_ptr<shm_link<T>> pLink, olc::net::server_interface<T>* server = nullptr, uint32_t uid = 0)
+			{
+				id = uid;
+				m_pServer = server;
+				m_pShared = std::move(pLink);
+				m_pShared->Start([this](message<T>&& msg) { DeliverShared(std::move(msg)); });
+			}
+
+			bool IsShared() const
+			{
+				return m_pShared != nullptr;
+			}
+
+			// Read and write through an io_uring stream instead of the socket,
+			// which stays closed; see net_uring.h. Before ConnectToClient().
+			void AttachUring(std::shared_ptr<uring_stream> pStream)
+			{
+				m_pUring = std::move(pStream);
+			}
+#endif
+
 
 		public:
-			void Send(const message<T>& msg)
+			bool Send(const message<T>& msg, uint64_t nCoalesceKey = 0)
+			{
+				return Send(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), msg), nCoalesceKey);
+			}
+
+			// Takes over msg's body; nothing is copied on the way to the socket
+			bool Send(message<T>&& msg, uint64_t nCoalesceKey = 0)
+			{
+				return Send(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), std::move(msg)), nCoalesceKey);
+			}
+
+			// Build the message in place, in the allocation the write path then
+			// shares: build(message<T>&) fills in a fresh message
+			template<typename Build>
+			bool EmplaceSend(Build&& build, uint64_t nCoalesceKey = 0)
+			{
+				std::shared_ptr<message<T>> msg = std::allocate_shared<message<T>>(pool_allocator<message<T>>());
+				build(*msg);
+				return Send(shared_message<T>(std::move(msg)), nCoalesceKey);
+			}
+
+			bool Send(shared_message<T> msg, uint64_t nCoalesceKey = 0)
 			{
-				asio::post(m_asioContext,
-					[this, msg]()
+				return Send(message_view<T>(std::move(msg)), nCoalesceKey);
+			}
+
+			// Queue a message that may be shared with other connections, or a
+			// received view being forwarded; nothing is copied, the connection just
+			// holds a reference until it is written. Returns false if the
+			// backpressure policy discarded it. Under the coalesce policy a nonzero
+			// nCoalesceKey lets it replace a queued message with the same key.
+			bool Send(message_view<T> msg, uint64_t nCoalesceKey = 0)
+			{
+#if defined(__linux__)
+				if (m_pShared)
+					return SendShared(msg);
+#endif
+				if (m_nTransport == transport::datagram && m_bDatagrams.load(std::memory_order_acquire))
+					return SendDatagram(0, std::move(msg));
+
+				// The body decides the frame length, whatever header.size says
+				msg.header.size = uint32_t(msg.body.size());
+
+				const size_t nBytes = msg.size();
+				if (IsOverLimit(nBytes, 1))
+				{
+					switch (m_nBackpressurePolicy)
 					{
-						bool bWritingMessage = !m_qMessagesOut.empty();
-						m_qMessagesOut.push_back(msg);
-						if (!bWritingMessage)
+					case backpressure_policy::block:
+						// Reported before parking, while it can still be acted on.
+						// Waiting on the thread that has to drain the queue would never end.
+						RaiseBackpressure(backpressure_policy::block);
+						if (!m_asioContext.get_executor().running_in_this_thread())
+							m_ecDrained.wait([&]() { return !IsOverLimit(nBytes, 1) || !IsConnected(); });
+						break;
+
+					case backpressure_policy::drop_new:
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						RaiseBackpressure(backpressure_policy::drop_new);
+						return false;
+
+					case backpressure_policy::disconnect:
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						Disconnect();
+						RaiseBackpressure(backpressure_policy::disconnect);
+						return false;
+
+					default:
+						// drop_oldest and coalesce make room on the io thread. If
+						// senders outrun it by a whole second mark, drop here instead.
+						if (IsOverLimit(nBytes, 1, 2))
 						{
-							WriteHeader(); // If we weren't already writing a message, then start writing the header of this one
+							m_nDropped.fetch_add(1, std::memory_order_relaxed);
+							RaiseBackpressure(backpressure_policy::drop_new);
+							return false;
 						}
-					});
+						RaiseBackpressure(m_nBackpressurePolicy);
+						break;
+					}
+				}
+
+				m_nQueuedBytes.fetch_add(nBytes, std::memory_order_relaxed);
+				m_nQueuedMessages.fetch_add(1, std::memory_order_relaxed);
+
+				asio::post(m_asioContext, make_pooled_handler(
+					[this, msg = std::move(msg), nCoalesceKey]() mutable
+					{
+						QueueOutgoing(std::move(msg), nCoalesceKey);
+						if (!m_bWriting)
+						{
+							WriteMessages(); // If we weren't already writing, start a write with whatever is queued
+						}
+					}));
+				return true;
+			}
+
+			// Bound the outbound queue: messages accepted by Send() but not yet
+			// written, including the write in flight. 0 means no limit. One message
+			// is always let through however large, so an oversized send cannot
+			// wedge an empty queue. Over shared memory the ring is the queue and
+			// only the byte limit applies. The reliable datagram link is bounded
+			// by the same marks on its own; see SendDatagram(). Set before the
+			// connection starts sending.
+			void SetBackpressure(backpressure_policy policy, size_t nMaxQueuedBytes, size_t nMaxQueuedMessages)
+			{
+				m_nBackpressurePolicy = policy;
+				m_nMaxQueuedBytes = nMaxQueuedBytes;
+				m_nMaxQueuedMessages = nMaxQueuedMessages;
+			}
+
+			// Outbound queue statistics, safe to read from any thread
+			size_t GetQueuedBytes() const
+			{
+				return m_nQueuedBytes.load(std::memory_order_relaxed);
+			}
+
+			size_t GetQueuedMessages() const
+			{
+				return m_nQueuedMessages.load(std::memory_order_relaxed);
+			}
+
+			// Messages discarded or coalesced away by the backpressure policy
+			uint64_t GetDroppedCount() const
+			{
+				return m_nDropped.load(std::memory_order_relaxed);
+			}
+
+			// Limits on how much of the outbound queue is gathered into a single
+			// socket write. A write stops gathering once it holds nMaxBytes, so one
+			// large message may take it over; it always carries at least one message.
+			void SetWriteCoalescing(size_t nMaxBytes, size_t nMaxBuffers)
+			{
+				m_nMaxWriteBytes = std::max<size_t>(nMaxBytes, 1);
+				m_nMaxWriteBuffers = std::max<size_t>(nMaxBuffers, 2);
+			}
+
+			// Write statistics, safe to read from any thread
+			uint64_t GetWriteCount() const
+			{
+				return m_nWriteCount.load(std::memory_order_relaxed);
+			}
+
+			uint64_t GetMessagesWritten() const
+			{
+				return m_nMessagesWritten.load(std::memory_order_relaxed);
+			}
+
+			// Number of messages carried by the most recently completed write
+			size_t GetLastWriteMessageCount() const
+			{
+				return m_nLastWriteMessages.load(std::memory_order_relaxed);
+			}
+
+			// Size of the receive buffer; takes effect before the first read
+			void SetReadBufferSize(size_t nBytes)
+			{
+				m_nReadBufferSize = std::max(nBytes, frame_header<T>::nMax);
+			}
+
+			// Ask for compact headers (see net_framing.h). A server offers them to
+			// each client, a client accepts them if offered; otherwise, or with an
+			// older peer, the fixed framing is used. Set before connecting.
+			void SetFraming(framing mode)
+			{
+				if (mode == framing::compact)
+					m_nWireFeatures |= wire_compact_header;
+				else
+					m_nWireFeatures &= uint8_t(~wire_compact_header);
+			}
+
+			// Compress bodies of at least nMinBytes with net_lz.h; 0 turns it off.
+			// Negotiated like SetFraming: used only if both sides ask for it, and
+			// each side then compresses what it sends by its own threshold.
+			void SetCompression(size_t nMinBytes)
+			{
+				m_nCompressMin = nMinBytes;
+				if (nMinBytes)
+					m_nWireFeatures |= wire_compression;
+				else
+					m_nWireFeatures &= uint8_t(~wire_compression);
+			}
+
+			bool IsCompressing() const
+			{
+				return m_bCompression;
+			}
+
+			// Client: accept a datagram channel if the server offers one; see
+			// net_datagram.h. Set before connecting.
+			void EnableDatagrams()
+			{
+				m_nWireFeatures |= wire_datagram;
+			}
+
+			// Server: offer a datagram channel through pSocket, keyed by nToken,
+			// which must fit the handshake nonce. Set before ConnectToClient().
+			void SetDatagramSocket(datagram_socket<T>* pSocket, uint64_t nToken)
+			{
+				m_pDatagrams = pSocket;
+				m_nDatagramToken = nToken & nHandshakeNonceMask;
+				m_nWireFeatures |= wire_datagram;
+			}
+
+			// For testing, on a client: its datagram socket loses fLoss of what it
+			// sends and delays fReorder of the rest by up to maxDelay. The server
+			// sets its shared socket's own.
+			void SetSimulatedLoss(double fLoss, double fReorder, std::chrono::microseconds maxDelay)
+			{
+				m_fSimulatedLoss = fLoss;
+				m_fSimulatedReorder = fReorder;
+				m_simulatedDelay = maxDelay;
+			}
+
+			// How messages sent on datagram channel nChannel are delivered; both
+			// ends should agree. Every channel starts out reliable_ordered. Set
+			// before connecting.
+			void SetChannel(uint8_t nChannel, delivery mode)
+			{
+				if (nChannel < nReliableChannels)
+					m_vChannels[nChannel] = mode;
+			}
+
+			// Send()'s messages go over datagram channel 0 rather than the stream
+			// once one is negotiated; those sent before, and any reply to the
+			// handshake sent from OnClientConnect(), still go over the stream and
+			// may be overtaken. Backpressure applies as SendDatagram() says and
+			// coalescing not at all, and a datagram body can be at most
+			// nMaxDatagramBody<T>. Set before connecting.
+			void SetTransport(transport mode)
+			{
+				m_nTransport = mode;
+			}
+
+			// True once datagrams can be sent to the peer: on a client as soon as
+			// they are negotiated, on the server once the client's first datagram
+			// has shown its address
+			bool HasDatagrams() const
+			{
+				return m_bDatagramPeer.load(std::memory_order_acquire);
+			}
+
+			uint64_t GetDatagramsRead() const
+			{
+				return m_nDatagramsRead.load(std::memory_order_relaxed);
+			}
+
+			// Times a reliable datagram found the inbound queue full and was left
+			// to be resent
+			uint64_t GetDatagramsRefused() const
+			{
+				return m_nDatagramsRefused.load(std::memory_order_relaxed);
+			}
+
+			// Send msg as a single datagram, from any thread. It is not held up
+			// by anything queued on the stream, but may be lost, duplicated or
+			// reordered. Returns false if there is no datagram channel yet (see
+			// HasDatagrams()) or the body is over nMaxDatagramBody<T>.
+			bool SendUnreliable(const message<T>& msg)
+			{
+				return SendUnreliable(message_view<T>(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), msg)));
+			}
+
+			bool SendUnreliable(message<T>&& msg)
+			{
+				return SendUnreliable(message_view<T>(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), std::move(msg))));
+			}
+
+			bool SendUnreliable(message_view<T> msg)
+			{
+				if (!HasDatagrams() || !IsConnected() || msg.body.size() > nMaxDatagramBody<T>)
+					return false;
+
+				msg.header.size = uint32_t(msg.body.size());
+				asio::ip::udp::endpoint peer;
+				{
+					std::scoped_lock lock(m_muxDatagramPeer);
+					peer = m_udpPeer;
+				}
+				m_pDatagrams->Send(peer, m_nDatagramToken, m_nFraming, std::move(msg));
+				return true;
+			}
+
+			// Send msg on datagram channel nChannel (below nReliableChannels), from
+			// any thread, delivered as SetChannel() says. Reliable messages sent
+			// before the server has heard from the client wait for it. Returns
+			// false if there is no datagram channel or the body is over
+			// nMaxDatagramBody<T>.
+			//
+			// Messages waiting or unacked on the link count against the
+			// SetBackpressure() marks, or nReliableMaxQueued messages if none is
+			// set, and the policy applies when they are over: block waits for
+			// acks, except on the datagram socket's thread; disconnect closes the
+			// connection; the others drop this message, since those already
+			// numbered on an ordered channel can't be taken back.
+			bool SendDatagram(uint8_t nChannel, const message<T>& msg)
+			{
+				return SendDatagram(nChannel, message_view<T>(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), msg)));
+			}
+
+			bool SendDatagram(uint8_t nChannel, message<T>&& msg)
+			{
+				return SendDatagram(nChannel, message_view<T>(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), std::move(msg))));
+			}
+
+			bool SendDatagram(uint8_t nChannel, message_view<T> msg)
+			{
+				if (nChannel >= nReliableChannels)
+					return false;
+
+				const delivery mode = m_vChannels[nChannel];
+				if (mode == delivery::unreliable)
+					return SendUnreliable(std::move(msg));
+
+				if (!m_bDatagrams.load(std::memory_order_acquire) || !IsConnected() || msg.body.size() > nMaxDatagramBody<T>)
+					return false;
+
+				msg.header.size = uint32_t(msg.body.size());
+				const size_t nBytes = msg.size();
+				if (IsReliableOverLimit(nBytes, 1))
+				{
+					switch (m_nBackpressurePolicy)
+					{
+					case backpressure_policy::block:
+						RaiseBackpressure(backpressure_policy::block);
+						if (!m_pDatagrams->GetContext().get_executor().running_in_this_thread())
+							m_pReliable->WaitForRoom([&]() { return !IsReliableOverLimit(nBytes, 1) || !IsConnected(); });
+						if (m_pReliable->IsClosed())
+							return false;
+						break;
+
+					case backpressure_policy::disconnect:
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						Disconnect();
+						RaiseBackpressure(backpressure_policy::disconnect);
+						return false;
+
+					default:
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						RaiseBackpressure(backpressure_policy::drop_new);
+						return false;
+					}
+				}
+				else if (m_bBackpressure.load(std::memory_order_relaxed) && !IsReliableOverLimit(0, 0, 2))
+				{
+					// Re-arm the callback once the link has drained to half
+					m_bBackpressure.store(false, std::memory_order_relaxed);
+				}
+
+				m_pReliable->Admit(nBytes);
+				asio::post(m_pDatagrams->GetContext(), make_pooled_handler(
+					[pReliable = m_pReliable, nChannel, bOrdered = mode == delivery::reliable_ordered, msg = std::move(msg)]() mutable
+					{
+						pReliable->Send(nChannel, bOrdered, std::move(msg));
+					}));
+				return true;
+			}
+
+			// Reliable datagrams resent so far
+			uint64_t GetRetransmitCount() const
+			{
+				return m_pReliable ? m_pReliable->GetRetransmitCount() : 0;
+			}
+
+			// A datagram carrying this connection's token, with the token removed;
+			// called on the datagram socket's io thread
+			void ReceiveDatagram(std::span<const uint8_t> data, const asio::ip::udp::endpoint& from)
+			{
+				if (!m_bDatagrams.load(std::memory_order_acquire) || data.empty())
+					return;
+
+				const datagram_kind nKind = datagram_kind(data[0]);
+				data = data.subspan(1);
+
+				if (m_nOwnerType == owner::server)
+				{
+					// Follow the client if its address changes (a NAT rebinding, say)
+					{
+						std::scoped_lock lock(m_muxDatagramPeer);
+						m_udpPeer = from;
+					}
+					m_bDatagramPeer.store(true, std::memory_order_release);
+					m_pReliable->SetPeer(from);
+
+					if (nKind == datagram_hello)
+					{
+						m_pDatagrams->SendHello(from, m_nDatagramToken);
+						return;
+					}
+				}
+				else
+				{
+					m_bHelloAnswered = true;
+					if (nKind == datagram_hello)
+						return;
+				}
+
+				if (nKind == datagram_reliable || nKind == datagram_ack)
+				{
+					m_pReliable->Receive(nKind, data);
+					return;
+				}
+				if (nKind != datagram_message)
+					return;
+
+				message_header<T> header;
+				bool bCompressed = false;
+				const size_t nHeader = frame_header<T>::Decode(m_nFraming, false, data.data(), data.size(), header, bCompressed);
+				if (nHeader == 0 || nHeader == varint_malformed || header.size != data.size() - nHeader)
+					return;
+
+				owned_message<T> msg;
+				if (m_nOwnerType == owner::server)
+					msg.remote = this->shared_from_this();
+				msg.msg.header = header;
+				msg.msg.body.assign(data.begin() + nHeader, data.end());
+
+				// Unreliable anyway, so don't hold up the socket for a full queue
+				if (m_qMessagesIn.try_push_back(std::move(msg)))
+					m_nDatagramsRead.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// The framing agreed with the peer; fixed until the handshake is done
+			framing GetFraming() const
+			{
+				return m_nFraming;
+			}
+
+			// Bytes through the socket, headers included, safe to read from any thread
+			uint64_t GetBytesWritten() const
+			{
+				return m_nBytesWritten.load(std::memory_order_relaxed);
+			}
+
+			uint64_t GetBytesRead() const
+			{
+				return m_nBytesRead.load(std::memory_order_relaxed);
+			}
+
+			// Set before the connection starts reading. In view mode a received
+			// view keeps its part of the receive buffer alive for as long as it is
+			// held, so holding views for long ties up pool memory.
+			void SetReceiveMode(receive_mode mode)
+			{
+				m_nReceiveMode = mode;
+			}
+
+			// Read statistics, safe to read from any thread
+			uint64_t GetReadCount() const
+			{
+				return m_nReadCount.load(std::memory_order_relaxed);
+			}
+
+			uint64_t GetMessagesRead() const
+			{
+				return m_nMessagesRead.load(std::memory_order_relaxed);
 			}
 		
 		private:
 
-			void ReadHeader()
+			// Fill the receive buffer with whatever the socket has ready. One read
+			// may deliver many frames; any partial frame left at the end is slid
+			// back to the start of the buffer and completed by the next read.
+			//
+			// While views still point into the buffer it cannot be moved about, so
+			// reads carry on after the last frame instead. Once there is too little
+			// room left for that, the partial frame is moved to a fresh buffer and
+			// the old one is freed by whichever view lets go of it last.
+			void ReadMessages()
 			{
-				asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
-					[this](std::error_code ec, std::size_t length)
+				if (!m_pReadBlock)
+					m_pReadBlock = make_pool_block(ReadBlockSize());
+
+				const size_t nPending = m_nReadTail - m_nReadHead;
+				if (m_pReadBlock.use_count() == 1)
+				{
+					// Views on other threads may only just have released it
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (m_nReadHead > 0)
+						std::memmove(m_pReadBlock->pData, m_pReadBlock->pData + m_nReadHead, nPending);
+					m_nReadHead = 0;
+					m_nReadTail = nPending;
+				}
+				else
+				{
+					const size_t nFrame = HeadFrameBytes(m_pReadBlock->pData + m_nReadHead, nPending);
+					const size_t nSize = m_pReadBlock->nSize;
+					if (m_nReadHead + nFrame > nSize || nSize - m_nReadTail < nSize / 4)
+					{
+						std::shared_ptr<pool_block> pBlock = make_pool_block(ReadBlockSize());
+						std::memcpy(pBlock->pData, m_pReadBlock->pData + m_nReadHead, nPending);
+						m_pReadBlock = std::move(pBlock);
+						m_nReadHead = 0;
+						m_nReadTail = nPending;
+					}
+				}
+
+				StreamReadSome(asio::buffer(m_pReadBlock->pData + m_nReadTail, m_pReadBlock->nSize - m_nReadTail),
+					make_pooled_handler([this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							if (m_msgTemporaryIn.header.size > 0)
-							{
-								m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
-								ReadBody();
-							}
-							else
-							{
-								AddToIncomingMessageQueue();
-							}
+							m_nReadCount.fetch_add(1, std::memory_order_relaxed);
+							m_nBytesRead.fetch_add(length, std::memory_order_relaxed);
+							m_nReadTail += length;
+							ParseMessages();
 						}
 						else
 						{
-							std::cout << "Error reading header: " << ec.message() << std::endl;
-							m_socket.close();
+							std::cout << "Error reading messages: " << ec.message() << std::endl;
+							CloseSocket();
 						}
-					});
+					}));
 			}
 
-			void ReadBody()
+			// The socket's reads and writes, or the io_uring stream's if it has one
+			template <typename Handler>
+			void StreamReadSome(asio::mutable_buffer buffer, Handler&& handler)
 			{
-				asio::async_read(m_socket, asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
-					[this](std::error_code ec, std::size_t length)
+#if defined(__linux__)
+				if (m_pUring)
+					return m_pUring->AsyncReadSome(buffer, std::forward<Handler>(handler));
+#endif
+				m_socket.async_read_some(buffer, std::forward<Handler>(handler));
+			}
+
+			template <typename Handler>
+			void StreamRead(asio::mutable_buffer buffer, Handler&& handler)
+			{
+#if defined(__linux__)
+				if (m_pUring)
+					return m_pUring->AsyncRead(buffer, std::forward<Handler>(handler));
+#endif
+				asio::async_read(m_socket, buffer, std::forward<Handler>(handler));
+			}
+
+			template <typename Buffers, typename Handler>
+			void StreamWrite(const Buffers& buffers, Handler&& handler)
+			{
+#if defined(__linux__)
+				if (m_pUring)
+					return m_pUring->AsyncWrite(buffers, std::forward<Handler>(handler));
+#endif
+				asio::async_write(m_socket, buffers, std::forward<Handler>(handler));
+			}
+
+			// Compressed chunks have to fit in the receive buffer whole
+			size_t ReadBlockSize() const
+			{
+				return m_bCompression ? std::max(m_nReadBufferSize, nMaxChunkFrame) : m_nReadBufferSize;
+			}
+
+			// How many contiguous bytes the frame, or compressed chunk, at the head
+			// of the receive buffer will take; as much as it could if that is not
+			// known yet
+			size_t HeadFrameBytes(const uint8_t* pFrame, size_t nPending) const
+			{
+				if (m_bInflating)
+				{
+					if (nPending < sizeof(uint32_t))
+						return nMaxChunkFrame;
+					uint32_t nChunk;
+					std::memcpy(&nChunk, pFrame, sizeof(uint32_t));
+					return sizeof(uint32_t) + (nChunk & ~nChunkStored);
+				}
+
+				message_header<T> header;
+				bool bCompressed = false;
+				const size_t nHeader = frame_header<T>::Decode(m_nFraming, m_bCompression, pFrame, nPending, header, bCompressed);
+				if (nHeader == 0 || nHeader == varint_malformed)
+					return frame_header<T>::nMax;
+				return bCompressed ? nHeader : nHeader + header.size;
+			}
+
+			// Turn every complete header + body frame in the receive buffer into a
+			// message, then go back for more; or, if the inbound queue is full,
+			// wait for room first.
+			void ParseMessages()
+			{
+				while (m_nReadTail > m_nReadHead && !m_optPendingIn)
+				{
+					const uint8_t* pFrame = m_pReadBlock->pData + m_nReadHead;
+
+					if (m_bInflating)
+					{
+						const size_t nChunk = InflateChunk(pFrame, m_nReadTail - m_nReadHead);
+						if (nChunk == 0)
+							break;
+						if (nChunk == varint_malformed)
+						{
+							std::cout << "[" << id << "] Malformed compressed body" << std::endl;
+							CloseSocket();
+							return;
+						}
+						m_nReadHead += nChunk;
+						continue;
+					}
+
+					message_header<T> header;
+					bool bCompressed = false;
+					const size_t nHeader = frame_header<T>::Decode(m_nFraming, m_bCompression, pFrame, m_nReadTail - m_nReadHead, header, bCompressed);
+					if (nHeader == 0)
+						break;
+					if (nHeader == varint_malformed)
+					{
+						std::cout << "[" << id << "] Malformed message header" << std::endl;
+						CloseSocket();
+						return;
+					}
+
+					if (bCompressed)
+					{
+						// The chunks that follow are inflated straight into the body
+						m_pInflateBody = PrepareBody(header);
+						m_nInflateOffset = 0;
+						m_bInflating = true;
+						m_nReadHead += nHeader;
+						continue;
+					}
+
+					const size_t nAvailable = m_nReadTail - m_nReadHead - nHeader;
+					if (nAvailable < header.size)
+					{
+						if (nHeader + header.size > m_pReadBlock->nSize)
+						{
+							// The frame can never fit in the buffer, so read the rest of
+							// its body straight into a buffer of its own instead
+							uint8_t* pBody = PrepareBody(header);
+							std::memcpy(pBody, pFrame + nHeader, nAvailable);
+							m_nReadHead = m_nReadTail;
+							ReadBody(pBody, nAvailable);
+							return;
+						}
+						break;
+					}
+
+					const uint8_t* pBody = pFrame + nHeader;
+					m_nReadHead += nHeader + header.size;
+					if (m_nReceiveMode == receive_mode::view)
+					{
+						AddToIncomingMessageQueue(message_view<T>(header, { pBody, header.size }, m_pReadBlock));
+					}
+					else
+					{
+						m_msgTemporaryIn.header = header;
+						m_msgTemporaryIn.body.assign(pBody, pBody + header.size);
+						AddToIncomingMessageQueue();
+					}
+				}
+
+				if (m_optPendingIn)
+					WaitForInboundRoom();
+				else
+					ReadMessages();
+			}
+
+			// Somewhere for a body that is not taken straight from the receive
+			// buffer: m_pBodyBlock in view mode, m_msgTemporaryIn otherwise
+			uint8_t* PrepareBody(const message_header<T>& header)
+			{
+				m_msgTemporaryIn.header = header;
+				if (m_nReceiveMode == receive_mode::view)
+				{
+					m_pBodyBlock = make_pool_block(header.size);
+					return m_pBodyBlock->pData;
+				}
+
+				m_msgTemporaryIn.body.resize(header.size);
+				return m_msgTemporaryIn.body.data();
+			}
+
+			// Queue the body PrepareBody() handed out, once it is complete
+			void DeliverBody(uint8_t* pBody)
+			{
+				if (m_pBodyBlock)
+					AddToIncomingMessageQueue(message_view<T>(m_msgTemporaryIn.header,
+						{ pBody, m_msgTemporaryIn.header.size }, std::move(m_pBodyBlock)));
+				else
+					AddToIncomingMessageQueue();
+			}
+
+			// Inflate one chunk of a compressed body. Returns the bytes it took,
+			// 0 if it has not all arrived, or varint_malformed if it is corrupt.
+			size_t InflateChunk(const uint8_t* pChunk, size_t nPending)
+			{
+				if (nPending < sizeof(uint32_t))
+					return 0;
+
+				uint32_t nChunk;
+				std::memcpy(&nChunk, pChunk, sizeof(uint32_t));
+				const bool bStored = (nChunk & nChunkStored) != 0;
+				const size_t nLength = nChunk & ~nChunkStored;
+				const size_t nRaw = std::min(nCompressChunk, size_t(m_msgTemporaryIn.header.size) - m_nInflateOffset);
+
+				if (bStored ? nLength != nRaw : nLength > lz_bound(nCompressChunk))
+					return varint_malformed;
+				if (nPending < sizeof(uint32_t) + nLength)
+					return 0;
+
+				uint8_t* pOut = m_pInflateBody + m_nInflateOffset;
+				if (bStored)
+					std::memcpy(pOut, pChunk + sizeof(uint32_t), nRaw);
+				else if (lz_decompress(pChunk + sizeof(uint32_t), nLength, pOut, nRaw) != nRaw)
+					return varint_malformed;
+
+				m_nInflateOffset += nRaw;
+				if (m_nInflateOffset == m_msgTemporaryIn.header.size)
+				{
+					m_bInflating = false;
+					DeliverBody(m_pInflateBody);
+				}
+				return sizeof(uint32_t) + nLength;
+			}
+
+			// Read the remainder of an oversized body into pBody, starting at nOffset
+			void ReadBody(uint8_t* pBody, size_t nOffset)
+			{
+				StreamRead(asio::buffer(pBody + nOffset, m_msgTemporaryIn.header.size - nOffset),
+					[this, pBody](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							AddToIncomingMessageQueue();
+							m_nReadCount.fetch_add(1, std::memory_order_relaxed);
+							m_nBytesRead.fetch_add(length, std::memory_order_relaxed);
+							DeliverBody(pBody);
+							ParseMessages();
 						}
 						else
 						{
 							std::cout << "Error reading body: " << ec.message() << std::endl;
-							m_socket.close();
+							CloseSocket();
 						}
 					});
 			}
 
-			void WriteHeader()
+			// Gather as many queued messages as the limits allow and send their
+			// headers and bodies with one scatter-gather write. Messages are moved
+			// out of the queue into m_vecWriteBatch so their buffers stay valid
+			// until the write completes.
+			//
+			// A body being compressed is done a chunk at a time, and a write stops
+			// at the limits like any other, so a large body is spread over several
+			// writes and never has a whole compressed copy. It stays in
+			// m_msgCompressing until its last chunk is out.
+			void WriteMessages()
 			{
-				asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
-					[this](std::error_code ec, std::size_t length)
+				m_bWriting = true;
+				m_vecWriteBatch.clear();
+				m_vecWriteBuffers.clear();
+
+				// Buffers point into these, so they are sized before any are added
+				if (m_vecWriteHeaders.size() < m_nMaxWriteBuffers)
+					m_vecWriteHeaders.resize(m_nMaxWriteBuffers);
+				if (m_vecChunkBlocks.size() < m_nMaxWriteBuffers)
+					m_vecChunkBlocks.resize(m_nMaxWriteBuffers);
+
+				size_t nBytes = 0;
+				size_t nQueuedBytes = 0;
+				size_t nHeaders = 0;
+				size_t nChunks = 0;
+				while (nBytes < m_nMaxWriteBytes && m_vecWriteBuffers.size() + 2 <= m_nMaxWriteBuffers)
+				{
+					if (m_bCompressing)
+					{
+						nBytes += CompressChunk(nChunks++);
+						if (m_nCompressOffset == m_msgCompressing.body.size())
+						{
+							m_bCompressing = false;
+							nQueuedBytes += m_msgCompressing.size();
+							m_vecWriteBatch.push_back(std::move(m_msgCompressing));
+						}
+						continue;
+					}
+
+					if (m_deqMessagesOut.empty())
+						break;
+
+					message_view<T> msg = PopOutgoing();
+					const bool bCompress = m_bCompression && m_nCompressMin && msg.body.size() >= m_nCompressMin
+						&& msg.body.size() < nFixedCompressed;
+
+					wire_header& header = m_vecWriteHeaders[nHeaders++];
+					header.nBytes = uint8_t(frame_header<T>::Encode(m_nFraming, m_bCompression, msg.header, bCompress, header.vBytes));
+					m_vecWriteBuffers.push_back(asio::buffer(header.vBytes, header.nBytes));
+					nBytes += header.nBytes;
+
+					if (bCompress)
+					{
+						m_msgCompressing = std::move(msg);
+						m_nCompressOffset = 0;
+						m_bCompressing = true;
+						continue;
+					}
+
+					if (!msg.body.empty())
+						m_vecWriteBuffers.push_back(asio::buffer(msg.body.data(), msg.body.size()));
+					nBytes += msg.body.size();
+					nQueuedBytes += msg.size();
+					m_vecWriteBatch.push_back(std::move(msg));
+				}
+				m_nWriteBatchBytes = nQueuedBytes;
+
+				StreamWrite(m_vecWriteBuffers,
+					make_pooled_handler([this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							if (m_qMessagesOut.front().body.size() > 0)
+							m_nWriteCount.fetch_add(1, std::memory_order_relaxed);
+							m_nBytesWritten.fetch_add(length, std::memory_order_relaxed);
+							m_nMessagesWritten.fetch_add(m_vecWriteBatch.size(), std::memory_order_relaxed);
+							m_nLastWriteMessages.store(m_vecWriteBatch.size(), std::memory_order_relaxed);
+							if (!m_vecWriteBatch.empty())
+								ReleaseQueued(m_nWriteBatchBytes, m_vecWriteBatch.size());
+
+							// Anything queued while this write was in flight goes out in the next one
+							if (m_bCompressing || !m_deqMessagesOut.empty())
 							{
-								WriteBody();
+								WriteMessages();
 							}
 							else
 							{
-								m_qMessagesOut.pop_front();
-								if (!m_qMessagesOut.empty())
-									WriteHeader(); // Write next message header
+								m_vecWriteBatch.clear();
+								m_bWriting = false;
 							}
 						}
 						else
 						{
-							std::cout << "Error writing header: " << ec.message() << std::endl;
-							m_socket.close();
+							std::cout << "[" << id << "] Write Fail: " << ec.message() << "\n";
+							m_bWriting = false;
+							CloseSocket();
 						}
-					});
+					}));
 			}
 
-			void WriteBody()
+			// Compress the next chunk of m_msgCompressing into chunk block nBlock
+			// and add it to the write. Returns the bytes added.
+			size_t CompressChunk(size_t nBlock)
 			{
-				asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
-					[this](std::error_code ec, std::size_t length)
+				std::shared_ptr<pool_block>& pBlock = m_vecChunkBlocks[nBlock];
+				if (!pBlock)
+					pBlock = make_pool_block(nMaxChunkFrame);
+
+				const uint8_t* pRaw = m_msgCompressing.body.data() + m_nCompressOffset;
+				const size_t nRaw = std::min(nCompressChunk, m_msgCompressing.body.size() - m_nCompressOffset);
+				m_nCompressOffset += nRaw;
+
+				const size_t nLength = lz_compress(pRaw, nRaw, pBlock->pData + sizeof(uint32_t));
+				if (nLength < nRaw)
+				{
+					const uint32_t nChunk = uint32_t(nLength);
+					std::memcpy(pBlock->pData, &nChunk, sizeof(uint32_t));
+					m_vecWriteBuffers.push_back(asio::buffer(pBlock->pData, sizeof(uint32_t) + nLength));
+					return sizeof(uint32_t) + nLength;
+				}
+
+				// Incompressible; send it as it is, straight from the body
+				const uint32_t nChunk = uint32_t(nRaw) | nChunkStored;
+				std::memcpy(pBlock->pData, &nChunk, sizeof(uint32_t));
+				m_vecWriteBuffers.push_back(asio::buffer(pBlock->pData, sizeof(uint32_t)));
+				m_vecWriteBuffers.push_back(asio::buffer(pRaw, nRaw));
+				return sizeof(uint32_t) + nRaw;
+			}
+
+
+#if defined(__linux__)
+			// The ring is the outbound queue: it is over the mark once it can't
+			// take the frame, or would hold more than nMaxQueuedBytes with it.
+			// Under block, or with no byte limit, the sender waits for room, but
+			// not for ever: a peer that has stopped reading then loses the
+			// message, or under disconnect the link, instead of wedging the sender.
+			bool SendShared(const message_view<T>& msg)
+			{
+				const bool bWait = m_nBackpressurePolicy == backpressure_policy::block || !m_nMaxQueuedBytes;
+				const std::chrono::nanoseconds wait = bWait ? shm_send_timeout : std::chrono::nanoseconds(0);
+				if (m_pShared->Send(msg, m_nMaxQueuedBytes, wait))
+				{
+					m_nMessagesWritten.fetch_add(1, std::memory_order_relaxed);
+
+					// Re-arm the callback once the peer has caught up to half
+					const size_t nMark = m_nMaxQueuedBytes ? std::min(m_nMaxQueuedBytes, m_pShared->GetCapacity()) : m_pShared->GetCapacity();
+					if (m_bBackpressure.load(std::memory_order_relaxed) && m_pShared->GetQueuedBytes() <= nMark / 2)
+						m_bBackpressure.store(false, std::memory_order_relaxed);
+					return true;
+				}
+
+				if (!m_pShared->IsOpen())
+					return false;
+
+				m_nDropped.fetch_add(1, std::memory_order_relaxed);
+				if (m_nBackpressurePolicy == backpressure_policy::disconnect)
+				{
+					Disconnect();
+					RaiseBackpressure(backpressure_policy::disconnect);
+				}
+				else
+				{
+					RaiseBackpressure(backpressure_policy::drop_new);
+				}
+				return false;
+			}
+#endif
+
+			// Put an accepted message on the outbound queue and, if it is over a
+			// high-water mark, apply the drop_oldest or coalesce policy
+			void QueueOutgoing(message_view<T> msg, uint64_t nKey)
+			{
+				if (m_nBackpressurePolicy == backpressure_policy::coalesce && IsOverLimit(0, 0))
+				{
+					auto it = nKey ? m_mapCoalesce.find(nKey) : m_mapCoalesce.end();
+					if (it != m_mapCoalesce.end() && it->second >= m_nOutFrontSeq)
 					{
-						if (!ec)
-						{
-							m_qMessagesOut.pop_front();
+						// Newer state for the same key replaces the stale one in place
+						outgoing& queued = m_deqMessagesOut[it->second - m_nOutFrontSeq];
+						ReleaseQueued(queued.msg.size(), 1);
+						queued.msg = std::move(msg);
+					}
+					else
+					{
+						ReleaseQueued(msg.size(), 1);
+					}
+					m_nDropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
 
-							// If the queue still has messages in it, then issue the task to 
-							// send the next messages' header.
-							if (!m_qMessagesOut.empty())
-							{
-								WriteHeader();
-							}
-						}
-						else
+				if (nKey && m_nBackpressurePolicy == backpressure_policy::coalesce)
+					m_mapCoalesce[nKey] = m_nOutFrontSeq + m_deqMessagesOut.size();
+				m_deqMessagesOut.push_back({ std::move(msg), nKey });
+
+				if (m_nBackpressurePolicy == backpressure_policy::drop_oldest)
+				{
+					while (m_deqMessagesOut.size() > 1 && IsOverLimit(0, 0))
+					{
+						message_view<T> dropped = PopOutgoing();
+						ReleaseQueued(dropped.size(), 1);
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+			}
+
+			message_view<T> PopOutgoing()
+			{
+				outgoing& front = m_deqMessagesOut.front();
+				if (front.nKey)
+				{
+					auto it = m_mapCoalesce.find(front.nKey);
+					if (it != m_mapCoalesce.end() && it->second == m_nOutFrontSeq)
+						m_mapCoalesce.erase(it);
+				}
+
+				message_view<T> msg = std::move(front.msg);
+				m_deqMessagesOut.pop_front();
+				m_nOutFrontSeq++;
+				return msg;
+			}
+
+			// Would the queue be over nScale times a high-water mark with this much more in it
+			bool IsOverLimit(size_t nExtraBytes, size_t nExtraMessages, size_t nScale = 1) const
+			{
+				const size_t nMessages = m_nQueuedMessages.load(std::memory_order_relaxed);
+				if (nMessages == 0)
+					return false;
+
+				const size_t nBytes = m_nQueuedBytes.load(std::memory_order_relaxed);
+				return (m_nMaxQueuedBytes && nBytes + nExtraBytes > m_nMaxQueuedBytes * nScale)
+					|| (m_nMaxQueuedMessages && nMessages + nExtraMessages > m_nMaxQueuedMessages * nScale);
+			}
+
+			// Would the reliable link be over a high-water mark, divided by nDivisor,
+			// with this much more in it; as with the stream, one message always fits
+			bool IsReliableOverLimit(size_t nExtraBytes, size_t nExtraMessages, size_t nDivisor = 1) const
+			{
+				const size_t nMessages = m_pReliable->GetQueuedMessages();
+				if (nMessages == 0)
+					return false;
+
+				const size_t nMaxMessages = (m_nMaxQueuedBytes || m_nMaxQueuedMessages) ? m_nMaxQueuedMessages : nReliableMaxQueued;
+				return (m_nMaxQueuedBytes && m_pReliable->GetQueuedBytes() + nExtraBytes > m_nMaxQueuedBytes / nDivisor)
+					|| (nMaxMessages && nMessages + nExtraMessages > nMaxMessages / nDivisor);
+			}
+
+			// Report crossing a high-water mark once, until the queue drains
+			// again, with what was done about it
+			void RaiseBackpressure(backpressure_policy nAction)
+			{
+				if (!m_bBackpressure.exchange(true, std::memory_order_acq_rel) && m_pServer)
+					m_pServer->OnBackpressure(this->shared_from_this(), nAction);
+			}
+
+			// Account for messages that have left the queue; once it is below half
+			// of both marks, re-arm the callback. Blocked senders recheck either way.
+			void ReleaseQueued(size_t nBytes, size_t nMessages)
+			{
+				const size_t nQueuedBytes = m_nQueuedBytes.fetch_sub(nBytes, std::memory_order_relaxed) - nBytes;
+				const size_t nQueuedMessages = m_nQueuedMessages.fetch_sub(nMessages, std::memory_order_relaxed) - nMessages;
+
+				if (m_bBackpressure.load(std::memory_order_relaxed)
+					&& (!m_nMaxQueuedBytes || nQueuedBytes <= m_nMaxQueuedBytes / 2)
+					&& (!m_nMaxQueuedMessages || nQueuedMessages <= m_nMaxQueuedMessages / 2))
+					m_bBackpressure.store(false, std::memory_order_relaxed);
+
+				m_ecDrained.notify_all();
+			}
+
+			// Close the socket and wake any sender blocked on the queue
+			void CloseSocket()
+			{
+#if defined(__linux__)
+				if (m_pUring)
+					m_pUring->Close();
+#endif
+				m_socket.close();
+				m_timerHello.cancel();
+				m_timerInbound.cancel();
+				m_optPendingIn.reset();
+				if (m_pReliable)
+					asio::post(m_pDatagrams->GetContext(), [pReliable = m_pReliable]() { pReliable->Close(); });
+				m_ecDrained.notify_all();
+			}
+
+			void AddToIncomingMessageQueue()
+			{
+				// The body moves on with the message; the next one gets a fresh buffer
+				if (m_nOwnerType == owner::server)
+					QueueIncoming({ this->shared_from_this(), std::move(m_msgTemporaryIn) });
+				else
+					QueueIncoming({ nullptr, std::move(m_msgTemporaryIn) }); // Client connections don't have an owner
+				m_msgTemporaryIn.body.clear();
+			}
+
+			void AddToIncomingMessageQueue(message_view<T>&& view)
+			{
+				std::shared_ptr<connection<T>> remote = nullptr;
+				if (m_nOwnerType == owner::server)
+					remote = this->shared_from_this();
+				QueueIncoming({ std::move(remote), {}, std::move(view) });
+			}
+
+			// Waiting here for room would stall every connection on this io
+			// thread, so a message the queue can't take is held back instead, and
+			// ParseMessages() stops at it
+			void QueueIncoming(owned_message<T>&& item)
+			{
+				if (!m_qMessagesIn.try_push_back(std::move(item)))
+				{
+					m_optPendingIn.emplace(std::move(item));
+					return;
+				}
+				m_nMessagesRead.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// With the held-back message still out, the socket is not read again:
+			// retry it now and then, and carry on parsing once it is in
+			void WaitForInboundRoom()
+			{
+				m_timerInbound.expires_after(std::chrono::milliseconds(1));
+				m_timerInbound.async_wait([this](std::error_code ec)
+					{
+						if (ec || !m_optPendingIn)
+							return;
+
+						if (!m_qMessagesIn.try_push_back(std::move(*m_optPendingIn)))
 						{
-							// Sending failed, see WriteHeader() equivalent for description :P
-							std::cout << "[" << id << "] Write Body Fail.\n";
-							m_socket.close();
+							WaitForInboundRoom();
+							return;
 						}
+						m_optPendingIn.reset();
+						m_nMessagesRead.fetch_add(1, std::memory_order_relaxed);
+						ParseMessages();
 					});
 			}
 
+			// A message from the reliable link, on the datagram socket's thread,
+			// which every client's datagrams share. Waiting there for room would
+			// hold all of them up, so with the queue full msg is handed back and
+			// the link has it resent, or offers it again.
+			bool DeliverDatagram(message<T>&& msg)
+			{
+				std::shared_ptr<connection<T>> remote = nullptr;
+				if (m_nOwnerType == owner::server)
+					remote = this->shared_from_this();
+				owned_message<T> item{ std::move(remote), std::move(msg) };
+				if (!m_qMessagesIn.try_push_back(std::move(item)))
+				{
+					msg = std::move(item.msg);
+					m_nDatagramsRefused.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+
+				m_nDatagramsRead.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
 
-			void AddToIncomingMessageQueue()
+#if defined(__linux__)
+			// On the shared memory reader thread. A closing link gives up on a
+			// full queue rather than hold up Close().
+			void DeliverShared(message<T>&& msg)
 			{
+				std::shared_ptr<connection<T>> remote = nullptr;
 				if (m_nOwnerType == owner::server)
-					m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+				{
+					remote = this->weak_from_this().lock();
+					if (!remote)
+						return;
+				}
+
+				owned_message<T> item{ std::move(remote), std::move(msg) };
+				while (!m_qMessagesIn.try_push_back(std::move(item)))
+				{
+					if (m_pShared->IsClosing())
+						return;
+					std::this_thread::yield();
+				}
+				m_nMessagesRead.fetch_add(1, std::memory_order_relaxed);
+			}
+#endif
+
+			// Messages are held back until the handshake is written and, on the
+			// server, the client's reply has settled which framing to use
+			void HandshakeStepDone()
+			{
+				if (++m_nHandshakeSteps < (m_nOwnerType == owner::server ? 2 : 1))
+					return;
+
+				m_bWriting = false;
+				if (!m_deqMessagesOut.empty())
+					WriteMessages();
+			}
+
+			void SetWireFeatures(uint8_t nFeatures)
+			{
+				m_nFraming = (nFeatures & wire_compact_header) ? framing::compact : framing::fixed;
+				m_bCompression = (nFeatures & wire_compression) != 0;
+				if (m_pDatagrams && (nFeatures & wire_datagram))
+				{
+					CreateReliable();
+					m_bDatagrams.store(true, std::memory_order_release);
+				}
+			}
+
+			// The link is made before datagrams are let in, so the socket's thread
+			// always finds it. A server's may outlive the connection in a pending
+			// handler, so it only holds on weakly. A peer that stops answering
+			// takes the whole connection down with its link.
+			void CreateReliable()
+			{
+				typename reliable_link<T>::deliver_type deliver;
+				typename reliable_link<T>::dead_type dead;
+				if (m_nOwnerType == owner::server)
+				{
+					deliver = [weak = this->weak_from_this()](message<T>&& msg)
+					{
+						// A connection that has gone takes nothing more
+						auto self = weak.lock();
+						return !self || self->DeliverDatagram(std::move(msg));
+					};
+					dead = [weak = this->weak_from_this()]()
+					{
+						if (auto self = weak.lock())
+							self->Disconnect();
+					};
+				}
 				else
-					m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn }); // Client connections don't have an owner
-				
-				ReadHeader();
+				{
+					deliver = [this](message<T>&& msg) { return DeliverDatagram(std::move(msg)); };
+					dead = [this]() { Disconnect(); };
+				}
+				m_pReliable = std::make_shared<reliable_link<T>>(*m_pDatagrams, m_nDatagramToken, m_nFraming, std::move(deliver), std::move(dead));
+			}
+
+			// Client: open a socket for the datagram channel just negotiated and
+			// start saying hello from it
+			void StartDatagrams()
+			{
+				// A Unix domain socket's peer has no address to send datagrams to
+				asio::error_code ec;
+				const asio::generic::stream_protocol::endpoint remote = m_socket.remote_endpoint(ec);
+				if (ec || (remote.protocol().family() != AF_INET && remote.protocol().family() != AF_INET6))
+					return;
+
+				asio::ip::udp::endpoint server;
+				std::memcpy(server.data(), remote.data(), remote.size());
+				server.resize(remote.size());
+				try
+				{
+					m_pOwnDatagrams = std::make_unique<datagram_socket<T>>(m_asioContext, asio::ip::udp::endpoint(server.protocol(), 0),
+						[this](uint64_t nToken, std::span<const uint8_t> data, const asio::ip::udp::endpoint& from)
+						{
+							if (nToken == m_nDatagramToken)
+								ReceiveDatagram(data, from);
+						});
+				}
+				catch (std::exception& e)
+				{
+					std::cout << "Datagram socket error: " << e.what() << std::endl;
+					return;
+				}
+				m_pOwnDatagrams->SetSimulation(m_fSimulatedLoss, m_fSimulatedReorder, m_simulatedDelay);
+
+				m_pDatagrams = m_pOwnDatagrams.get();
+				m_nDatagramToken = m_nHandshakeIn & nHandshakeNonceMask;
+				{
+					std::scoped_lock lock(m_muxDatagramPeer);
+					m_udpPeer = server;
+				}
+				CreateReliable();
+				m_pReliable->SetPeer(server);
+				m_bDatagrams.store(true, std::memory_order_release);
+				m_bDatagramPeer.store(true, std::memory_order_release);
+				m_pDatagrams->Start();
+				SendHello();
+			}
+
+			void SendHello()
+			{
+				if (m_bHelloAnswered || !IsConnected() || m_nHellosSent++ >= nMaxHellos)
+					return;
+
+				m_pDatagrams->SendHello(m_udpPeer, m_nDatagramToken);
+				m_timerHello.expires_after(std::chrono::milliseconds(200));
+				m_timerHello.async_wait([this](std::error_code ec)
+					{
+						if (!ec)
+							SendHello();
+					});
 			}
 
 			uint64_t scramble(uint64_t nInput)
@@ -224,72 +1476,201 @@ namespace olc
 
 			void WriteValidation()
 			{
-				asio::async_write(m_socket, asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
+				StreamWrite(asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
 					[this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
 							if (m_nOwnerType == owner::client)
 							{
-								ReadHeader();
+								ReadMessages();
 							}
+
+							HandshakeStepDone();
 						}
 						else
 						{
 							std::cout << "Error writing validation: " << ec.message() << std::endl;
-							m_socket.close();
+							CloseSocket();
 						}
 					});
 			}
 
 			void ReadValidation(olc::net::server_interface<T>* server = nullptr)
 			{
-				asio::async_read(m_socket, asio::buffer(&m_nHandshakeIn, sizeof(uint64_t)),
+				StreamRead(asio::buffer(&m_nHandshakeIn, sizeof(uint64_t)),
 					[this, server](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
 							if (m_nOwnerType == owner::server)
 							{
-								if (m_nHandshakeIn == m_nHandshakeCheck)
+								// The client's reply is our check value with the features it
+								// accepts, out of those offered, in the top byte
+								const uint64_t nAccepted = m_nHandshakeIn ^ m_nHandshakeCheck;
+								const uint64_t nOffered = uint64_t(m_nWireFeatures) << 56;
+								if ((nAccepted & ~nOffered) == 0)
 								{
+									SetWireFeatures(uint8_t(nAccepted >> 56));
 									std::cout << "Client Validated" << std::endl;
 									server->OnClientValidated(this->shared_from_this());
 
-									ReadHeader();
+									ReadMessages();
+									HandshakeStepDone();
 								}
 								else
 								{
 									std::cout << "Client Validation Failed" << std::endl;
-									m_socket.close();
+									CloseSocket();
 								}
 							}
 							else
 							{
 								m_nHandshakeOut = scramble(m_nHandshakeIn);
+
+								// Accept whichever offered features we want, if this server
+								// offers any
+								uint8_t nAccepted = 0;
+								if (m_nHandshakeIn >> 63)
+									nAccepted = uint8_t(m_nHandshakeIn >> 56) & m_nWireFeatures & 0x7F;
+								m_nHandshakeOut ^= uint64_t(nAccepted) << 56;
+								SetWireFeatures(nAccepted);
+								if (nAccepted & wire_datagram)
+									StartDatagrams();
+
 								WriteValidation(); // Send back validation
 							}
 						}
 						else
 						{
 							std::cout << "Error reading validation: " << ec.message() << std::endl;
-							m_socket.close();
+							CloseSocket();
 						}
 					});
 			}
 
 		protected:
-			asio::ip::tcp::socket m_socket;
+			stream_socket m_socket;
 
 			asio::io_context& m_asioContext;
 
-			tsqueue<message<T>> m_qMessagesOut;
+			// Datagram channel: the server's shared socket, or the client's own
+			std::unique_ptr<datagram_socket<T>> m_pOwnDatagrams;
+			datagram_socket<T>* m_pDatagrams = nullptr;
+			uint64_t m_nDatagramToken = 0;
+			// negotiated, and the peer's address known
+			std::atomic<bool> m_bDatagrams = false;
+			std::atomic<bool> m_bDatagramPeer = false;
+			asio::ip::udp::endpoint m_udpPeer;
+			std::mutex m_muxDatagramPeer;
+			// client hellos, until the server answers one
+			asio::steady_timer m_timerHello;
+			bool m_bHelloAnswered = false;
+			int m_nHellosSent = 0;
+			static constexpr int nMaxHellos = 25;
+			double m_fSimulatedLoss = 0.0;
+			double m_fSimulatedReorder = 0.0;
+			std::chrono::microseconds m_simulatedDelay{ 0 };
+			std::atomic<uint64_t> m_nDatagramsRead = 0;
+			std::atomic<uint64_t> m_nDatagramsRefused = 0;
+			// reliable datagrams, on the socket's io thread, and each channel's delivery
+			std::shared_ptr<reliable_link<T>> m_pReliable;
+			channel_modes m_vChannels = default_channels();
+			transport m_nTransport = transport::stream;
+#if defined(__linux__)
+			// shared memory slot, if this connection uses one instead of the socket
+			std::shared_ptr<shm_link<T>> m_pShared;
+			// io_uring stream, if the server's io threads drive this connection that way
+			std::shared_ptr<uring_stream> m_pUring;
+#endif
+
+			// Outbound queue, only touched on the io thread. Entries are numbered
+			// from m_nOutFrontSeq so a coalesce key can find its entry by position.
+			struct outgoing
+			{
+				message_view<T> msg;
+				uint64_t nKey = 0;
+			};
+			std::deque<outgoing, pool_allocator<outgoing>> m_deqMessagesOut;
+			std::unordered_map<uint64_t, uint64_t> m_mapCoalesce;
+			uint64_t m_nOutFrontSeq = 0;
+
+			// Backpressure; the counters cover everything accepted by Send() and
+			// not yet written, and are updated from any thread
+			backpressure_policy m_nBackpressurePolicy = backpressure_policy::disconnect;
+			size_t m_nMaxQueuedBytes = 0;
+			size_t m_nMaxQueuedMessages = 0;
+			std::atomic<size_t> m_nQueuedBytes = 0;
+			std::atomic<size_t> m_nQueuedMessages = 0;
+			std::atomic<uint64_t> m_nDropped = 0;
+			std::atomic<bool> m_bBackpressure = false;
+			eventcount m_ecDrained;
+
+			// Messages and buffers of the write currently in flight
+			std::vector<message_view<T>> m_vecWriteBatch;
+			// async_write copies the buffer sequence, so it draws from the pool too
+			std::vector<asio::const_buffer, pool_allocator<asio::const_buffer>> m_vecWriteBuffers;
+			size_t m_nWriteBatchBytes = 0;
+			// Encoded headers and compressed chunks of the write in flight
+			struct wire_header
+			{
+				uint8_t vBytes[frame_header<T>::nMax];
+				uint8_t nBytes = 0;
+			};
+			std::vector<wire_header, pool_allocator<wire_header>> m_vecWriteHeaders;
+			std::vector<std::shared_ptr<pool_block>> m_vecChunkBlocks;
+			// Body being compressed across writes, and how far it has got
+			message_view<T> m_msgCompressing;
+			size_t m_nCompressOffset = 0;
+			bool m_bCompressing = false;
+			// Held until the handshake is done, so messages sent early (e.g. from
+			// OnClientConnect) cannot overtake it or go out in the wrong framing
+			bool m_bWriting = true;
+			int m_nHandshakeSteps = 0;
+			size_t m_nMaxWriteBytes = 64 * 1024;
+			size_t m_nMaxWriteBuffers = 64;
 
-			tsqueue<owned_message<T>>& m_qMessagesIn;
+			std::atomic<uint64_t> m_nWriteCount = 0;
+			std::atomic<uint64_t> m_nMessagesWritten = 0;
+			std::atomic<size_t> m_nLastWriteMessages = 0;
+			std::atomic<uint64_t> m_nBytesWritten = 0;
+
+			incoming_queue<T>& m_qMessagesIn;
 			message<T> m_msgTemporaryIn;
 
+			// Receive buffer; bytes in [m_nReadHead, m_nReadTail) are not yet parsed.
+			// Views share it, so it is only reused once they have all let go.
+			std::shared_ptr<pool_block> m_pReadBlock;
+			size_t m_nReadHead = 0;
+			size_t m_nReadTail = 0;
+			size_t m_nReadBufferSize = 64 * 1024;
+			receive_mode m_nReceiveMode = receive_mode::copy;
+			// Body of an oversized frame being read in view mode
+			std::shared_ptr<pool_block> m_pBodyBlock;
+			// A message the inbound queue had no room for; nothing more is read
+			// until it is in
+			std::optional<owned_message<T>> m_optPendingIn;
+			asio::steady_timer m_timerInbound;
+
+			std::atomic<uint64_t> m_nReadCount = 0;
+			std::atomic<uint64_t> m_nMessagesRead = 0;
+			std::atomic<uint64_t> m_nBytesRead = 0;
+
+			// Features we offer (server) or accept (client), and the framing agreed
+			uint8_t m_nWireFeatures = 0;
+			framing m_nFraming = framing::fixed;
+			size_t m_nCompressMin = 0;
+			bool m_bCompression = false;
+
+			// Compressed body being received, inflated chunk by chunk
+			uint8_t* m_pInflateBody = nullptr;
+			size_t m_nInflateOffset = 0;
+			bool m_bInflating = false;
+
+			static constexpr uint64_t nHandshakeNonceMask = 0x00FFFFFFFFFFFFFFull;
 			owner m_nOwnerType = owner::server;
 			uint32_t id = 0;
+			server_interface<T>* m_pServer = nullptr;
 
 			uint64_t m_nHandshakeOut = 0;
 			uint64_t m_nHandshakeIn = 0;
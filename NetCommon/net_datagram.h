@@ -0,0 +1,254 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_pool.h"
+#include "net_message.h"
+#include "net_framing.h"
+
+#include <array>
+#include <functional>
+#include <random>
+
+// Unreliable datagrams alongside a connection.
+//
+// A server that calls EnableDatagrams() opens a UDP socket on its TCP port
+// and offers datagrams in the handshake; a client that calls
+// EnableDatagrams() accepts. The server's handshake nonce is then a random
+// token, which both ends now know, and every datagram starts with it, so
+// the server can tell which connection a datagram belongs to whichever
+// address it comes from. After the token comes a datagram_kind byte:
+//
+//     uint64_t nToken
+//     uint8_t  nKind
+//     ...
+//
+// A hello has nothing more. The server can't send to a client until it has
+// seen the client's address, so once the handshake is done the client
+// sends hellos, a few times a second, until the server answers one.
+//
+// An unreliable message follows with its header, framed as the stream's
+// are (fixed or compact, as negotiated) but never compressed, and its body.
+// It may be lost, duplicated or reordered, and nothing resends it. It
+// arrives in the same incoming queue as the stream's messages, but is
+// dropped rather than waited for if that is full.
+//
+// Reliable messages and acks are laid out in net_reliable.h. Datagrams that
+// don't parse are dropped.
+
+namespace olc
+{
+	namespace net
+	{
+		enum datagram_kind : uint8_t
+		{
+			datagram_hello,
+			datagram_message,
+			datagram_reliable,
+			datagram_ack
+		};
+
+		// Largest UDP payload over IPv4
+		constexpr size_t nMaxDatagram = 65507;
+
+		// Room before the body for the kind, the reliable fields (at most 47
+		// bytes) and the message header
+		template <typename T>
+		constexpr size_t nMaxDatagramPrefix = 64 + frame_header<T>::nMax;
+
+		// Largest body a datagram can carry, whatever the framing
+		template <typename T>
+		constexpr size_t nMaxDatagramBody = nMaxDatagram - sizeof(uint64_t) - nMaxDatagramPrefix<T>;
+
+		// A UDP socket shared by the datagram channels of one server, or owned
+		// by a client's connection. Sends may come from any thread and are made
+		// on the socket's io thread; a datagram that the socket can't take at
+		// once is dropped, not queued. Received datagrams go to handler, on the
+		// io thread, with the token split off.
+		//
+		// For testing, the socket can also lose or delay some of what it sends,
+		// standing in for a bad network.
+		template <typename T>
+		class datagram_socket
+		{
+		public:
+			using handler_type = std::function<void(uint64_t nToken, std::span<const uint8_t> data, const asio::ip::udp::endpoint& from)>;
+
+			datagram_socket(asio::io_context& asioContext, const asio::ip::udp::endpoint& local, handler_type handler)
+				: m_asioContext(asioContext), m_socket(asioContext, local), m_handler(std::move(handler)), m_vecReceive(nMaxDatagram)
+			{
+				m_socket.non_blocking(true);
+			}
+
+			datagram_socket(const datagram_socket&) = delete;
+			datagram_socket& operator=(const datagram_socket&) = delete;
+
+			void Start()
+			{
+				Receive();
+			}
+
+			asio::io_context& GetContext()
+			{
+				return m_asioContext;
+			}
+
+			// Lose fLoss of all datagrams sent, and hold back fReorder of the rest
+			// for up to maxDelay so later ones overtake them. Set before Start().
+			void SetSimulation(double fLoss, double fReorder, std::chrono::microseconds maxDelay)
+			{
+				m_fLoss = fLoss;
+				m_fReorder = fReorder;
+				m_maxDelay = maxDelay;
+			}
+
+			// An unreliable message, from any thread
+			void Send(const asio::ip::udp::endpoint& peer, uint64_t nToken, framing mode, message_view<T> msg)
+			{
+				asio::post(m_asioContext, make_pooled_handler(
+					[this, peer, nToken, mode, msg = std::move(msg)]()
+					{
+						uint8_t vPrefix[1 + frame_header<T>::nMax] = { datagram_message };
+						const size_t nHeader = frame_header<T>::Encode(mode, false, msg.header, false, vPrefix + 1);
+						Write(peer, nToken, std::span<const uint8_t>(vPrefix, 1 + nHeader), msg.body);
+					}));
+			}
+
+			void SendHello(const asio::ip::udp::endpoint& peer, uint64_t nToken)
+			{
+				asio::post(m_asioContext, [this, peer, nToken]()
+					{
+						const uint8_t nKind = datagram_hello;
+						Write(peer, nToken, std::span<const uint8_t>(&nKind, 1), {});
+					});
+			}
+
+			// Send the token, prefix and body as one datagram now; only on the
+			// socket's io thread
+			void Write(const asio::ip::udp::endpoint& peer, uint64_t nToken, std::span<const uint8_t> prefix, std::span<const uint8_t> body)
+			{
+				if (m_fLoss > 0.0 || m_fReorder > 0.0)
+				{
+					if (Chance(m_fLoss))
+					{
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					if (Chance(m_fReorder))
+					{
+						Delay(peer, nToken, prefix, body);
+						return;
+					}
+				}
+
+				const std::array<asio::const_buffer, 3> buffers =
+				{
+					asio::buffer(&nToken, sizeof(nToken)),
+					asio::buffer(prefix.data(), prefix.size()),
+					asio::buffer(body.data(), body.size())
+				};
+
+				asio::error_code ec;
+				m_socket.send_to(buffers, peer, 0, ec);
+				if (ec)
+					m_nDropped.fetch_add(1, std::memory_order_relaxed);
+				else
+					m_nSent.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// Datagrams sent, and ones the socket would not take or simulated loss
+			// dropped
+			uint64_t GetSentCount() const
+			{
+				return m_nSent.load(std::memory_order_relaxed);
+			}
+
+			uint64_t GetDroppedCount() const
+			{
+				return m_nDropped.load(std::memory_order_relaxed);
+			}
+
+			asio::ip::udp::endpoint GetLocalEndpoint() const
+			{
+				return m_socket.local_endpoint();
+			}
+
+		private:
+			bool Chance(double fProbability)
+			{
+				return fProbability > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(m_rng) < fProbability;
+			}
+
+			// Send a copy of the datagram after a random delay
+			void Delay(const asio::ip::udp::endpoint& peer, uint64_t nToken, std::span<const uint8_t> prefix, std::span<const uint8_t> body)
+			{
+				struct delayed
+				{
+					asio::steady_timer timer;
+					asio::ip::udp::endpoint peer;
+					std::vector<uint8_t> vecBytes;
+				};
+
+				auto pDelayed = std::make_shared<delayed>(delayed{ asio::steady_timer(m_asioContext), peer, {} });
+				pDelayed->vecBytes.resize(sizeof(nToken) + prefix.size() + body.size());
+				std::memcpy(pDelayed->vecBytes.data(), &nToken, sizeof(nToken));
+				if (!prefix.empty())
+					std::memcpy(pDelayed->vecBytes.data() + sizeof(nToken), prefix.data(), prefix.size());
+				if (!body.empty())
+					std::memcpy(pDelayed->vecBytes.data() + sizeof(nToken) + prefix.size(), body.data(), body.size());
+
+				const auto nDelay = std::uniform_int_distribution<int64_t>(0, m_maxDelay.count())(m_rng);
+				pDelayed->timer.expires_after(std::chrono::microseconds(nDelay));
+				pDelayed->timer.async_wait([this, pDelayed](std::error_code ec)
+					{
+						if (ec || !m_socket.is_open())
+							return;
+						asio::error_code ecSend;
+						m_socket.send_to(asio::buffer(pDelayed->vecBytes), pDelayed->peer, 0, ecSend);
+						if (ecSend)
+							m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						else
+							m_nSent.fetch_add(1, std::memory_order_relaxed);
+					});
+			}
+
+			void Receive()
+			{
+				m_socket.async_receive_from(asio::buffer(m_vecReceive), m_endpointFrom,
+					[this](std::error_code ec, std::size_t length)
+					{
+						// Closed along with the server or client
+						if (!m_socket.is_open())
+							return;
+
+						// Other errors (an ICMP unreachable from an earlier send, say)
+						// only concern that datagram
+						if (!ec && length >= sizeof(uint64_t))
+						{
+							uint64_t nToken;
+							std::memcpy(&nToken, m_vecReceive.data(), sizeof(nToken));
+							m_handler(nToken, std::span<const uint8_t>(m_vecReceive.data() + sizeof(nToken), length - sizeof(nToken)), m_endpointFrom);
+						}
+
+						Receive();
+					});
+			}
+
+		private:
+			asio::io_context& m_asioContext;
+			asio::ip::udp::socket m_socket;
+			handler_type m_handler;
+
+			std::vector<uint8_t> m_vecReceive;
+			asio::ip::udp::endpoint m_endpointFrom;
+
+			std::atomic<uint64_t> m_nSent = 0;
+			std::atomic<uint64_t> m_nDropped = 0;
+
+			// simulated network, used only on the io thread
+			double m_fLoss = 0.0;
+			double m_fReorder = 0.0;
+			std::chrono::microseconds m_maxDelay{ 0 };
+			std::minstd_rand m_rng{ std::random_device{}() };
+		};
+	}
+}
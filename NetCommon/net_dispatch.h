@@ -0,0 +1,259 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_pool.h"
+#include "mpsc_ring_queue.h"
+
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+// Runs message handlers for different connections in parallel while each
+// connection's messages are still handled one at a time, in arrival order.
+//
+// Every connection has a mailbox. A mailbox is scheduled onto at most one
+// worker at a time, so its messages can never run concurrently or out of
+// order. Mailboxes start on the worker their connection ID hashes to, and
+// idle workers steal from busy ones. A worker handles at most nQuantum
+// messages from a mailbox before sending it to the back of its queue, so a
+// client that floods the server only ever gets its turn, and the other
+// connections on that worker keep being served in between.
+
+namespace olc
+{
+	namespace net
+	{
+		template <typename T>
+		class parallel_dispatcher
+		{
+		public:
+			using handler_type = std::function<void(owned_message<T>&)>;
+
+			// As many as the inbound queue holds, so one connection's mailbox
+			// never outgrows the ring it is fed from
+			static constexpr size_t nDefaultMaxBacklog = mpsc_ring_queue<owned_message<T>>::nDefaultCapacity;
+
+			// nMaxBacklog caps how many undelivered messages one connection may
+			// have waiting; anything beyond that is dropped and counted. 0 turns
+			// the cap off, leaving a connection's mailbox to grow for as long as
+			// its handlers fall behind.
+			parallel_dispatcher(size_t nWorkers, handler_type handler, size_t nQuantum = 32, size_t nMaxBacklog = nDefaultMaxBacklog)
+				: m_handler(std::move(handler)), m_nQuantum(std::max<size_t>(nQuantum, 1)), m_nMaxBacklog(nMaxBacklog)
+			{
+				nWorkers = std::max<size_t>(nWorkers, 1);
+				m_vecWorkers.reserve(nWorkers);
+				for (size_t i = 0; i < nWorkers; i++)
+					m_vecWorkers.push_back(std::make_unique<worker>());
+
+				for (size_t i = 0; i < nWorkers; i++)
+					m_vecWorkers[i]->thread = std::thread([this, i]() { WorkerLoop(i); });
+			}
+
+			parallel_dispatcher(const parallel_dispatcher&) = delete;
+
+			// Stops the workers; messages not yet handled are discarded
+			~parallel_dispatcher()
+			{
+				{
+					std::scoped_lock lock(m_muxWake);
+					m_bStop = true;
+				}
+				m_cvWake.notify_all();
+
+				for (auto& w : m_vecWorkers)
+					if (w->thread.joinable()) w->thread.join();
+			}
+
+			// Hand a message to its connection's mailbox. Must only be called from
+			// one thread (the one draining the inbound queue).
+			void Dispatch(owned_message<T>&& msg)
+			{
+				const uint32_t nID = msg.remote ? msg.remote->GetID() : 0;
+
+				std::shared_ptr<mailbox>& box = m_mapMailboxes[nID];
+				if (!box)
+					box = std::allocate_shared<mailbox>(pool_allocator<mailbox>());
+
+				bool bSchedule = false;
+				{
+					std::scoped_lock lock(box->mux);
+					if (m_nMaxBacklog && box->queue.size() >= m_nMaxBacklog)
+					{
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+
+					box->queue.push_back(std::move(msg));
+					bSchedule = !box->bScheduled;
+					box->bScheduled = true;
+				}
+
+				if (bSchedule)
+					Submit(box, nID % m_vecWorkers.size());
+
+				if (++m_nDispatched % 4096 == 0)
+					SweepMailboxes();
+			}
+
+			size_t GetWorkerCount() const
+			{
+				return m_vecWorkers.size();
+			}
+
+			uint64_t GetDroppedCount() const
+			{
+				return m_nDropped.load(std::memory_order_relaxed);
+			}
+
+		private:
+			struct mailbox
+			{
+				std::mutex mux;
+				std::deque<owned_message<T>, pool_allocator<owned_message<T>>> queue;
+				bool bScheduled = false;
+			};
+
+			struct worker
+			{
+				std::mutex mux;
+				std::deque<std::shared_ptr<mailbox>> tasks;
+				std::thread thread;
+			};
+
+			void Submit(std::shared_ptr<mailbox> box, size_t nWorker)
+			{
+				{
+					std::scoped_lock lock(m_vecWorkers[nWorker]->mux);
+					m_vecWorkers[nWorker]->tasks.push_back(std::move(box));
+				}
+
+				{
+					std::scoped_lock lock(m_muxWake);
+					m_nQueuedTasks++;
+				}
+				m_cvWake.notify_one();
+			}
+
+			// Own queue first, oldest task first; otherwise steal the newest task
+			// from another worker
+			std::shared_ptr<mailbox> TakeTask(size_t nWorker)
+			{
+				std::shared_ptr<mailbox> box;
+				{
+					worker& self = *m_vecWorkers[nWorker];
+					std::scoped_lock lock(self.mux);
+					if (!self.tasks.empty())
+					{
+						box = std::move(self.tasks.front());
+						self.tasks.pop_front();
+						return box;
+					}
+				}
+
+				for (size_t i = 1; i < m_vecWorkers.size(); i++)
+				{
+					worker& victim = *m_vecWorkers[(nWorker + i) % m_vecWorkers.size()];
+					std::scoped_lock lock(victim.mux);
+					if (!victim.tasks.empty())
+					{
+						box = std::move(victim.tasks.back());
+						victim.tasks.pop_back();
+						return box;
+					}
+				}
+
+				return nullptr;
+			}
+
+			void WorkerLoop(size_t nWorker)
+			{
+				while (true)
+				{
+					std::shared_ptr<mailbox> box = TakeTask(nWorker);
+					if (!box)
+					{
+						std::unique_lock<std::mutex> lock(m_muxWake);
+						m_cvWake.wait(lock, [this]() { return m_bStop || m_nQueuedTasks > 0; });
+						if (m_bStop)
+							return;
+						continue;
+					}
+
+					{
+						std::scoped_lock lock(m_muxWake);
+						m_nQueuedTasks--;
+					}
+
+					RunMailbox(box, nWorker);
+				}
+			}
+
+			void RunMailbox(std::shared_ptr<mailbox>& box, size_t nWorker)
+			{
+				for (size_t n = 0; n < m_nQuantum; n++)
+				{
+					owned_message<T> msg;
+					{
+						std::scoped_lock lock(box->mux);
+						if (box->queue.empty())
+						{
+							box->bScheduled = false;
+							return;
+						}
+						msg = std::move(box->queue.front());
+						box->queue.pop_front();
+					}
+
+					m_handler(msg);
+				}
+
+				// Quantum used up; give the other connections a turn
+				{
+					std::scoped_lock lock(box->mux);
+					if (box->queue.empty())
+					{
+						box->bScheduled = false;
+						return;
+					}
+				}
+				Submit(std::move(box), nWorker);
+			}
+
+			// Forget idle mailboxes so connections that have gone away don't pile
+			// up; a live connection just gets a fresh one with its next message
+			void SweepMailboxes()
+			{
+				for (auto it = m_mapMailboxes.begin(); it != m_mapMailboxes.end();)
+				{
+					std::unique_lock<std::mutex> lock(it->second->mux);
+					const bool bIdle = !it->second->bScheduled && it->second->queue.empty();
+					lock.unlock();
+
+					if (bIdle)
+						it = m_mapMailboxes.erase(it);
+					else
+						++it;
+				}
+			}
+
+		private:
+			handler_type m_handler;
+			size_t m_nQuantum;
+			size_t m_nMaxBacklog;
+
+			std::vector<std::unique_ptr<worker>> m_vecWorkers;
+
+			// Only touched by the dispatching thread
+			std::unordered_map<uint32_t, std::shared_ptr<mailbox>> m_mapMailboxes;
+			uint64_t m_nDispatched = 0;
+
+			std::mutex m_muxWake;
+			std::condition_variable m_cvWake;
+			int64_t m_nQueuedTasks = 0;
+			bool m_bStop = false;
+
+			std::atomic<uint64_t> m_nDropped = 0;
+		};
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// An eventcount: lets a consumer sleep until a lock-free queue has
+// something in it, without a mutex on the producer side.
+//
+// A consumer that finds nothing to do first spins for a while, which costs
+// no syscalls on either side. If that runs out it registers as a waiter,
+// checks its condition once more and parks on the epoch counter (a futex on
+// Linux, WaitOnAddress on Windows, through std::atomic::wait). A producer
+// only touches the epoch and makes the wake syscall when it sees a
+// registered waiter, so pushes into a queue whose consumer is busy or
+// spinning stay syscall free.
+//
+// The waiter count and the queue contents are checked in opposite orders
+// by the two sides with a full fence in between, so either the producer
+// sees the waiter and bumps the epoch, or the consumer sees the item before
+// it parks. A wakeup can never fall between the check and the sleep.
+
+namespace olc {
+    namespace net {
+
+        inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            asm volatile("yield");
+#endif
+        }
+
+        class eventcount {
+        public:
+            eventcount() = default;
+            eventcount(const eventcount&) = delete;
+            eventcount& operator=(const eventcount&) = delete;
+
+            // How long a consumer spins before parking. Zero parks straight away.
+            void set_spin(std::chrono::nanoseconds spin) {
+                m_nSpinNs.store(uint64_t(spin.count()), std::memory_order_relaxed);
+                m_nSpinBudgetNs.store(uint64_t(spin.count()), std::memory_order_relaxed);
+            }
+
+            std::chrono::nanoseconds spin() const {
+                return std::chrono::nanoseconds(m_nSpinNs.load(std::memory_order_relaxed));
+            }
+
+            // Producer side: call after making the condition true
+            void notify_one() {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_nWaiters.load(std::memory_order_relaxed) != 0) {
+                    m_nEpoch.fetch_add(1, std::memory_order_release);
+                    m_nEpoch.notify_one();
+                }
+            }
+
+            void notify_all() {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_nWaiters.load(std::memory_order_relaxed) != 0) {
+                    m_nEpoch.fetch_add(1, std::memory_order_release);
+                    m_nEpoch.notify_all();
+                }
+            }
+
+            // Consumer side: return once ready() is true
+            template<typename Pred>
+            void wait(Pred&& ready) {
+                if (ready())
+                    return;
+
+                if (spin_until(ready))
+                    return;
+
+                while (true) {
+                    m_nWaiters.fetch_add(1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    const uint32_t nKey = m_nEpoch.load(std::memory_order_acquire);
+
+                    if (ready()) {
+                        m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+                        return;
+                    }
+
+                    m_nEpoch.wait(nKey, std::memory_order_acquire);
+                    m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+
+                    if (ready())
+                        return;
+                }
+            }
+
+        private:
+            // Spin for the current budget. The budget adapts: a spin that ends
+            // in a park halves it, a spin that finds work restores it, so a
+            // consumer whose producers have gone quiet stops burning a core
+            // while a busy one keeps its low latency.
+            template<typename Pred>
+            bool spin_until(Pred& ready) {
+                const uint64_t nBudget = m_nSpinBudgetNs.load(std::memory_order_relaxed);
+                if (nBudget == 0)
+                    return false;
+
+                const auto tEnd = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nBudget);
+                for (uint32_t n = 1;; n++) {
+                    cpu_relax();
+                    if (ready()) {
+                        m_nSpinBudgetNs.store(m_nSpinNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        return true;
+                    }
+                    if ((n & 63) == 0) {
+                        if (std::chrono::steady_clock::now() >= tEnd)
+                            break;
+                        std::this_thread::yield();
+                    }
+                }
+
+                const uint64_t nMin = m_nSpinNs.load(std::memory_order_relaxed) / 16;
+                m_nSpinBudgetNs.store(std::max(nBudget / 2, nMin), std::memory_order_relaxed);
+                return false;
+            }
+
+            std::atomic<uint32_t> m_nEpoch{ 0 };
+            std::atomic<uint32_t> m_nWaiters{ 0 };
+            std::atomic<uint64_t> m_nSpinNs{ 50000 };
+            std::atomic<uint64_t> m_nSpinBudgetNs{ 50000 };
+        };
+
+    }
+} // namespace olc::net
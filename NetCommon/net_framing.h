@@ -0,0 +1,165 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_lz.h"
+
+// How message headers look on the wire.
+//
+// The fixed framing sends message_header<T> as it is in memory: the ID,
+// then the body length as a uint32_t. The compact framing sends the ID and
+// the body length as LEB128 varints instead, so a message with a small ID
+// and a body under 128 bytes has a two byte header.
+//
+// Compact framing is negotiated in the connection handshake; see
+// connection::SetFraming. Peers that don't know about it keep using the
+// fixed framing, which stays the default.
+//
+// If compression is negotiated as well (connection::SetCompression), each
+// header also carries a compressed flag: the top bit of the fixed size
+// field, or the low bit of the compact length varint. A compressed frame's
+// header gives the uncompressed body length, and the body follows as a run
+// of chunks, each covering up to nCompressChunk bytes of the original:
+//
+//     uint32_t nLength   low 31 bits: bytes that follow; top bit: stored raw
+//     uint8_t  data[nLength]
+//
+// Chunks are compressed with net_lz.h independently of each other, so the
+// sender compresses a large body a chunk at a time as it writes it and the
+// receiver inflates each one as it arrives; neither holds a compressed
+// copy of the whole body.
+
+namespace olc
+{
+	namespace net
+	{
+		enum class framing
+		{
+			fixed,
+			compact
+		};
+
+		// Optional wire features, offered by the server in its handshake and
+		// accepted by the client in its reply. Seven bits are available.
+		enum wire_feature : uint8_t
+		{
+			wire_compact_header = 0x01,
+			wire_compression = 0x02,
+			wire_datagram = 0x04
+		};
+
+		constexpr size_t nCompressChunk = 32 * 1024;
+		constexpr uint32_t nChunkStored = 0x80000000u;
+
+		// Compressed flag in the size field of a fixed header
+		constexpr uint32_t nFixedCompressed = 0x80000000u;
+
+		// Largest chunk on the wire, with its length prefix
+		constexpr size_t nMaxChunkFrame = sizeof(uint32_t) + lz_bound(nCompressChunk);
+
+		// Longest varint a uint64_t can need
+		constexpr size_t nMaxVarint = 10;
+
+		inline size_t put_varint(uint8_t* pData, uint64_t nValue)
+		{
+			size_t n = 0;
+			while (nValue >= 0x80)
+			{
+				pData[n++] = uint8_t(nValue) | 0x80;
+				nValue >>= 7;
+			}
+			pData[n++] = uint8_t(nValue);
+			return n;
+		}
+
+		// Bytes consumed; 0 if pData holds only part of a varint, and
+		// varint_malformed if it is longer than any uint64_t could need
+		constexpr size_t varint_malformed = size_t(-1);
+
+		inline size_t get_varint(const uint8_t* pData, size_t nAvailable, uint64_t& nValue)
+		{
+			nValue = 0;
+			for (size_t n = 0; n < nMaxVarint; n++)
+			{
+				if (n == nAvailable)
+					return 0;
+
+				nValue |= uint64_t(pData[n] & 0x7F) << (7 * n);
+				if (!(pData[n] & 0x80))
+					return n + 1;
+			}
+			return varint_malformed;
+		}
+
+		template <typename T>
+		struct frame_header
+		{
+			static_assert(sizeof(T) <= sizeof(uint64_t), "compact framing needs an ID of at most 64 bits");
+
+			// Longest compact header: a full width ID and a 33 bit length
+			static constexpr size_t nMaxCompact = nMaxVarint + 5;
+
+			// Longest header in either framing
+			static constexpr size_t nMax = std::max(nMaxCompact, sizeof(message_header<T>));
+
+			// With bFlags (compression negotiated) the header also carries
+			// bCompressed. Returns the bytes written to pData.
+			static size_t Encode(framing mode, bool bFlags, const message_header<T>& header, bool bCompressed, uint8_t* pData)
+			{
+				if (mode == framing::fixed)
+				{
+					message_header<T> wire = header;
+					if (bFlags && bCompressed)
+						wire.size |= nFixedCompressed;
+					std::memcpy(pData, &wire, sizeof(message_header<T>));
+					return sizeof(message_header<T>);
+				}
+
+				uint64_t nID = 0;
+				std::memcpy(&nID, &header.id, sizeof(T));
+				const size_t n = put_varint(pData, nID);
+				const uint64_t nSize = bFlags ? (uint64_t(header.size) << 1) | (bCompressed ? 1 : 0) : header.size;
+				return n + put_varint(pData + n, nSize);
+			}
+
+			// Bytes the header took; 0 if it is not all there yet, and
+			// varint_malformed if it can't be a header
+			static size_t Decode(framing mode, bool bFlags, const uint8_t* pData, size_t nAvailable, message_header<T>& header, bool& bCompressed)
+			{
+				bCompressed = false;
+				if (mode == framing::fixed)
+				{
+					if (nAvailable < sizeof(message_header<T>))
+						return 0;
+					std::memcpy(&header, pData, sizeof(message_header<T>));
+					if (bFlags)
+					{
+						bCompressed = (header.size & nFixedCompressed) != 0;
+						header.size &= ~nFixedCompressed;
+					}
+					return sizeof(message_header<T>);
+				}
+
+				uint64_t nID = 0, nSize = 0;
+				const size_t nIDBytes = get_varint(pData, nAvailable, nID);
+				if (nIDBytes == 0 || nIDBytes == varint_malformed)
+					return nIDBytes;
+
+				const size_t nSizeBytes = get_varint(pData + nIDBytes, nAvailable - nIDBytes, nSize);
+				if (nSizeBytes == 0 || nSizeBytes == varint_malformed)
+					return nSizeBytes;
+				if (bFlags)
+				{
+					bCompressed = (nSize & 1) != 0;
+					nSize >>= 1;
+				}
+				if (nSize > UINT32_MAX || (sizeof(T) < sizeof(uint64_t) && (nID >> (8 * sizeof(T))) != 0))
+					return varint_malformed;
+
+				std::memcpy(&header.id, &nID, sizeof(T));
+				header.size = uint32_t(nSize);
+				return nIDBytes + nSizeBytes;
+			}
+		};
+	}
+}
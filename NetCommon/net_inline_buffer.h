@@ -0,0 +1,193 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_pool.h"
+
+// A byte buffer for message bodies that keeps up to nInline bytes inside
+// the object itself and only allocates, from Alloc, once the body outgrows
+// that. Most traffic is pings and small state updates, which then never
+// allocate at all.
+//
+// It offers the parts of std::vector<uint8_t> that message bodies use
+// (data, size, resize, assign, clear, reserve, push_back, iteration), with
+// the same growth and zero-fill behaviour. Moving a spilled buffer steals
+// its allocation; moving an inline one copies at most nInline bytes.
+
+namespace olc
+{
+	namespace net
+	{
+		template <size_t nInline = 64, typename Alloc = pool_allocator<uint8_t>>
+		class inline_buffer
+		{
+			static_assert(nInline > 0, "use std::vector for buffers without inline storage");
+			static_assert(std::allocator_traits<Alloc>::is_always_equal::value,
+				"moves hand allocations between buffers, so every Alloc must be interchangeable");
+
+			using traits = std::allocator_traits<Alloc>;
+
+		public:
+			using value_type = uint8_t;
+			using size_type = size_t;
+			using iterator = uint8_t*;
+			using const_iterator = const uint8_t*;
+			using allocator_type = Alloc;
+
+			inline_buffer() = default;
+
+			explicit inline_buffer(const Alloc& alloc)
+				: m_alloc(alloc)
+			{}
+
+			inline_buffer(const inline_buffer& other)
+				: m_alloc(traits::select_on_container_copy_construction(other.m_alloc))
+			{
+				assign(other.begin(), other.end());
+			}
+
+			inline_buffer(inline_buffer&& other) noexcept
+				: m_alloc(other.m_alloc)
+			{
+				Steal(other);
+			}
+
+			inline_buffer& operator=(const inline_buffer& other)
+			{
+				if (this != &other)
+					assign(other.begin(), other.end());
+				return *this;
+			}
+
+			inline_buffer& operator=(inline_buffer&& other) noexcept
+			{
+				if (this != &other)
+				{
+					Release();
+					Steal(other);
+				}
+				return *this;
+			}
+
+			~inline_buffer()
+			{
+				Release();
+			}
+
+			uint8_t* data() { return m_pData; }
+			const uint8_t* data() const { return m_pData; }
+			size_t size() const { return m_nSize; }
+			size_t capacity() const { return m_nCapacity; }
+			bool empty() const { return m_nSize == 0; }
+
+			// True while the body still fits in the object
+			bool is_inline() const { return m_pData == m_vInline; }
+
+			iterator begin() { return m_pData; }
+			iterator end() { return m_pData + m_nSize; }
+			const_iterator begin() const { return m_pData; }
+			const_iterator end() const { return m_pData + m_nSize; }
+
+			uint8_t& operator[](size_t i) { return m_pData[i]; }
+			const uint8_t& operator[](size_t i) const { return m_pData[i]; }
+
+			Alloc get_allocator() const { return m_alloc; }
+
+			void reserve(size_t nCapacity)
+			{
+				if (nCapacity > m_nCapacity)
+					Grow(nCapacity);
+			}
+
+			// New bytes are zeroed, as with std::vector
+			void resize(size_t nSize)
+			{
+				if (nSize > m_nCapacity)
+					Grow(std::max(nSize, m_nCapacity * 2));
+				if (nSize > m_nSize)
+					std::memset(m_pData + m_nSize, 0, nSize - m_nSize);
+				m_nSize = nSize;
+			}
+
+			void push_back(uint8_t nByte)
+			{
+				if (m_nSize == m_nCapacity)
+					Grow(m_nCapacity * 2);
+				m_pData[m_nSize++] = nByte;
+			}
+
+			// Copy nBytes onto the end without zero-filling first
+			void append(const void* pSrc, size_t nBytes)
+			{
+				if (nBytes == 0)
+					return;
+				if (m_nSize + nBytes > m_nCapacity)
+					Grow(std::max(m_nSize + nBytes, m_nCapacity * 2));
+				std::memcpy(m_pData + m_nSize, pSrc, nBytes);
+				m_nSize += nBytes;
+			}
+
+			// Keeps any allocation for reuse
+			void clear()
+			{
+				m_nSize = 0;
+			}
+
+			template <typename InputIt>
+			void assign(InputIt first, InputIt last)
+			{
+				const size_t nSize = size_t(std::distance(first, last));
+				if (nSize > m_nCapacity)
+				{
+					m_nSize = 0;
+					Grow(nSize);
+				}
+				std::copy(first, last, m_pData);
+				m_nSize = nSize;
+			}
+
+		private:
+			void Grow(size_t nCapacity)
+			{
+				uint8_t* pData = traits::allocate(m_alloc, nCapacity);
+				if (m_nSize)
+					std::memcpy(pData, m_pData, m_nSize);
+				Release();
+				m_pData = pData;
+				m_nCapacity = nCapacity;
+			}
+
+			void Release()
+			{
+				if (!is_inline())
+					traits::deallocate(m_alloc, m_pData, m_nCapacity);
+				m_pData = m_vInline;
+				m_nCapacity = nInline;
+			}
+
+			// Take other's contents, leaving it empty and inline
+			void Steal(inline_buffer& other)
+			{
+				if (other.is_inline())
+				{
+					std::memcpy(m_vInline, other.m_vInline, other.m_nSize);
+				}
+				else
+				{
+					m_pData = other.m_pData;
+					m_nCapacity = other.m_nCapacity;
+					other.m_pData = other.m_vInline;
+					other.m_nCapacity = nInline;
+				}
+				m_nSize = other.m_nSize;
+				other.m_nSize = 0;
+			}
+
+		private:
+			uint8_t* m_pData = m_vInline;
+			size_t m_nSize = 0;
+			size_t m_nCapacity = nInline;
+			Alloc m_alloc;
+			uint8_t m_vInline[nInline];
+		};
+	}
+}
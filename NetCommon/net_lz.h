@@ -0,0 +1,215 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// A small LZ77 block codec in the LZ4 block format, so there is no
+// compression library to build or ship. It favours speed over ratio: one
+// hash probe per position, greedy matches, no entropy coding. That still
+// shrinks typical game state (runs of zeros, repeated records, slowly
+// changing values) several times over, at hundreds of MB/s each way.
+//
+// Blocks are at most lz_max_block bytes, so match offsets fit in 16 bits
+// and the hash table fits on the stack. Decompression checks every length
+// and offset against both buffers, so a corrupt block fails instead of
+// reading or writing out of bounds.
+
+namespace olc
+{
+	namespace net
+	{
+		constexpr size_t lz_max_block = 64 * 1024 - 1;
+
+		// Worst case compressed size of nBytes of input
+		constexpr size_t lz_bound(size_t nBytes)
+		{
+			return nBytes + nBytes / 255 + 16;
+		}
+
+		namespace detail
+		{
+			constexpr size_t nLzMinMatch = 4;
+			constexpr size_t nLzLastLiterals = 5;  // a block always ends in literals...
+			constexpr size_t nLzMatchLimit = 12;   // ...and no match starts this close to the end
+			constexpr unsigned nLzHashBits = 12;
+
+			inline uint32_t LzRead32(const uint8_t* p)
+			{
+				uint32_t n;
+				std::memcpy(&n, p, sizeof(n));
+				return n;
+			}
+
+			inline uint64_t LzRead64(const uint8_t* p)
+			{
+				uint64_t n;
+				std::memcpy(&n, p, sizeof(n));
+				return n;
+			}
+
+			inline uint32_t LzHash(uint32_t nSequence)
+			{
+				return (nSequence * 2654435761u) >> (32 - nLzHashBits);
+			}
+
+			inline uint8_t* LzWriteLength(uint8_t* pOut, size_t nLength)
+			{
+				while (nLength >= 255)
+				{
+					*pOut++ = 255;
+					nLength -= 255;
+				}
+				*pOut++ = uint8_t(nLength);
+				return pOut;
+			}
+
+			inline uint8_t* LzWriteSequence(uint8_t* pOut, const uint8_t* pLiterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+			{
+				uint8_t* pToken = pOut++;
+				*pToken = uint8_t((nLiterals < 15 ? nLiterals : 15) << 4);
+				if (nLiterals >= 15)
+					pOut = LzWriteLength(pOut, nLiterals - 15);
+				std::memcpy(pOut, pLiterals, nLiterals);
+				pOut += nLiterals;
+
+				if (nMatch)
+				{
+					*pOut++ = uint8_t(nOffset);
+					*pOut++ = uint8_t(nOffset >> 8);
+					const size_t nCode = nMatch - nLzMinMatch;
+					*pToken |= uint8_t(nCode < 15 ? nCode : 15);
+					if (nCode >= 15)
+						pOut = LzWriteLength(pOut, nCode - 15);
+				}
+				return pOut;
+			}
+		}
+
+		// Compress nBytes (at most lz_max_block) from pIn into pOut, which must
+		// hold lz_bound(nBytes). Returns the compressed size.
+		inline size_t lz_compress(const uint8_t* pIn, size_t nBytes, uint8_t* pOut)
+		{
+			using namespace detail;
+
+			uint8_t* const pOutStart = pOut;
+			const uint8_t* pAnchor = pIn;
+
+			if (nBytes > nLzMatchLimit)
+			{
+				uint16_t vTable[1 << nLzHashBits] = {};
+				const uint8_t* const pLimit = pIn + nBytes - nLzMatchLimit;
+
+				// Position 0 and an empty slot look the same, so start at 1
+				const uint8_t* p = pIn + 1;
+				while (p < pLimit)
+				{
+					const uint32_t nSequence = LzRead32(p);
+					const uint32_t nHash = LzHash(nSequence);
+					const uint8_t* pCandidate = pIn + vTable[nHash];
+					vTable[nHash] = uint16_t(p - pIn);
+
+					if (pCandidate == pIn || LzRead32(pCandidate) != nSequence)
+					{
+						p++;
+						continue;
+					}
+
+					// Extend the match forwards, stopping short of the tail
+					const uint8_t* const pMatchEnd = pIn + nBytes - nLzLastLiterals;
+					size_t nMatch = nLzMinMatch;
+					while (p + nMatch + sizeof(uint64_t) <= pMatchEnd)
+					{
+						const uint64_t nDiff = LzRead64(p + nMatch) ^ LzRead64(pCandidate + nMatch);
+						if (nDiff)
+						{
+							nMatch += size_t(std::countr_zero(nDiff)) / 8; // first differing byte, little endian
+							break;
+						}
+						nMatch += sizeof(uint64_t);
+					}
+					while (p + nMatch < pMatchEnd && p[nMatch] == pCandidate[nMatch])
+						nMatch++;
+
+					pOut = LzWriteSequence(pOut, pAnchor, size_t(p - pAnchor), size_t(p - pCandidate), nMatch);
+					p += nMatch;
+					pAnchor = p;
+				}
+			}
+
+			pOut = detail::LzWriteSequence(pOut, pAnchor, size_t(pIn + nBytes - pAnchor), 0, 0);
+			return size_t(pOut - pOutStart);
+		}
+
+		// Decompress a block into pOut, which has room for nCapacity bytes.
+		// Returns the decompressed size, or 0 if the block is corrupt or does
+		// not fit.
+		inline size_t lz_decompress(const uint8_t* pIn, size_t nBytes, uint8_t* pOut, size_t nCapacity)
+		{
+			const uint8_t* const pInEnd = pIn + nBytes;
+			uint8_t* const pOutStart = pOut;
+			uint8_t* const pOutEnd = pOut + nCapacity;
+
+			auto ReadLength = [&](size_t& nLength)
+			{
+				uint8_t nByte;
+				do
+				{
+					if (pIn == pInEnd)
+						return false;
+					nByte = *pIn++;
+					nLength += nByte;
+				} while (nByte == 255);
+				return true;
+			};
+
+			while (pIn < pInEnd)
+			{
+				const uint8_t nToken = *pIn++;
+
+				size_t nLiterals = nToken >> 4;
+				if (nLiterals == 15 && !ReadLength(nLiterals))
+					return 0;
+				if (nLiterals > size_t(pInEnd - pIn) || nLiterals > size_t(pOutEnd - pOut))
+					return 0;
+				std::memcpy(pOut, pIn, nLiterals);
+				pIn += nLiterals;
+				pOut += nLiterals;
+
+				// The last sequence has no match
+				if (pIn == pInEnd)
+					break;
+
+				if (pInEnd - pIn < 2)
+					return 0;
+				const size_t nOffset = size_t(pIn[0]) | (size_t(pIn[1]) << 8);
+				pIn += 2;
+
+				size_t nMatch = nToken & 15;
+				if (nMatch == 15 && !ReadLength(nMatch))
+					return 0;
+				nMatch += detail::nLzMinMatch;
+
+				if (nOffset == 0 || nOffset > size_t(pOut - pOutStart) || nMatch > size_t(pOutEnd - pOut))
+					return 0;
+
+				// A match may overlap its own output (a run), which needs a
+				// forward bytewise copy
+				const uint8_t* pMatch = pOut - nOffset;
+				if (nOffset >= nMatch)
+				{
+					std::memcpy(pOut, pMatch, nMatch);
+				}
+				else
+				{
+					for (size_t i = 0; i < nMatch; i++)
+						pOut[i] = pMatch[i];
+				}
+				pOut += nMatch;
+			}
+
+			return size_t(pOut - pOutStart);
+		}
+	}
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "net_common.h"
+#include "net_pool.h"
+#include "net_inline_buffer.h"
 
 namespace olc
 {
@@ -12,62 +14,116 @@ namespace olc
 			uint32_t size = 0;
 		};
 
-		template <typename T>
+		// Bodies of up to nInlineBytes are stored inside the message itself, so
+		// small messages never allocate. Larger ones spill to Alloc, by default
+		// the shared slab pool, so steady-state traffic does not touch malloc.
+		template <typename T, typename Alloc = pool_allocator<uint8_t>, size_t nInlineBytes = 64>
 		struct message
 		{
 			message_header<T> header{};
-			std::vector<uint8_t> body;
+			inline_buffer<nInlineBytes, Alloc> body;
 
 			size_t size() const
 			{
 				return sizeof(message_header<T>) + body.size();
 			}
 
-			friend std::ostream& operator<<(std::ostream& os, const message<T>& msg)
+			friend std::ostream& operator<<(std::ostream& os, const message& msg)
 			{
 				os << "ID: " << static_cast<int>(msg.header.id) << ", Size: " << msg.header.size;
 				return os;
 			}
 
 			template<typename DataType>
-			friend message<T>& operator << (message<T>& msg, const DataType& data)
+			friend message& operator << (message& msg, const DataType& data)
 			{
 				static_assert(std::is_standard_layout<DataType>::value, "DataType must be standard layout type");
 				
-				size_t i = msg.body.size();
-
-				msg.body.resize(msg.body.size() + sizeof(DataType));
+				msg.body.append(&data, sizeof(DataType));
 
-				std::memcpy(msg.body.data() + i, &data, sizeof(DataType));
-
-				msg.header.size = msg.size();
+				msg.header.size = uint32_t(msg.body.size());
 
 				return msg;
 			}
 
+			// Pops from the end, so values come back in the reverse of the order
+			// they were pushed
 			template<typename DataType>
-			friend message<T>& operator >> (message<T>& msg, const DataType& data)
+			friend message& operator >> (message& msg, DataType& data)
 			{
 				static_assert(std::is_standard_layout<DataType>::value, "DataType must be standard layout type");
 
 				size_t i = msg.body.size() - sizeof(DataType);
 
-				std::memcpy(msg.body.data() + i, &data, sizeof(DataType));
+				std::memcpy(&data, msg.body.data() + i, sizeof(DataType));
+
+				msg.body.resize(i);
+
+				msg.header.size = uint32_t(msg.body.size());
+
+				return msg;
+			}
+		};
+
+		// An immutable message that can sit in many connections' outbound queues
+		// at once. The body is freed when the last write referencing it completes.
+		template <typename T>
+		using shared_message = std::shared_ptr<const message<T>>;
+
+		// A read-only message whose body lives in memory owned by something
+		// else: a pooled receive buffer, or a shared_message. Copying a view only
+		// bumps the owner's refcount, so a view can be kept, or forwarded to any
+		// number of connections, without copying the body. The memory goes back
+		// to the pool when the last view of it is released.
+		template <typename T>
+		struct message_view
+		{
+			message_header<T> header{};
+			std::span<const uint8_t> body;
+			std::shared_ptr<const void> owner;
+
+			message_view() = default;
+
+			message_view(const message_header<T>& h, std::span<const uint8_t> b, std::shared_ptr<const void> pOwner)
+				: header(h), body(b), owner(std::move(pOwner))
+			{}
+
+			// View the body of a shared message, keeping the message alive
+			explicit message_view(shared_message<T> msg)
+				: header(msg->header), body(msg->body.data(), msg->body.size()), owner(std::move(msg))
+			{}
 
-				msg.header.size = msg.size();
+			size_t size() const
+			{
+				return sizeof(message_header<T>) + body.size();
+			}
 
+			// An owning copy, for handlers that need to keep or modify it
+			message<T> to_message() const
+			{
+				message<T> msg;
+				msg.header = header;
+				msg.body.assign(body.begin(), body.end());
 				return msg;
 			}
+
+			friend std::ostream& operator<<(std::ostream& os, const message_view& msg)
+			{
+				os << "ID: " << static_cast<int>(msg.header.id) << ", Size: " << msg.header.size;
+				return os;
+			}
 		};
 
 		template <typename T>
 		class connection;
 
+		// In view receive mode msg stays empty and the message arrives in view
 		template <typename T>
 		struct owned_message
 		{
 			std::shared_ptr<connection<T>> remote = nullptr;
 			message<T> msg;
+			message_view<T> view{};
 
 			friend std::ostream& operator<<(std::ostream& os, const owned_message<T>& msg)
 			{
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Forward cursors over a message body. Unlike operator<< and operator>>,
+// which push and pop at the end of the body, values are read back in the
+// order they were written.
+//
+//     {
+//         olc::net::message_writer w(msg, 4096);
+//         w << nEntity << vecPositions << sName;
+//     }
+//     olc::net::message_reader r(msg);
+//     r >> nEntity >> vecPositions >> sName;
+//     if (!r.ok()) ...
+//
+// Trivially copyable values (including std::array of them) are written as
+// their bytes. Strings, vectors and other contiguous containers get a
+// uint32_t element count followed by the elements, copied in one go when
+// the element type is trivially copyable and one by one otherwise. A
+// container too big for that count throws std::length_error.
+//
+// A writer appends to the body without zero-filling it and sets
+// header.size once, when it is finished or destroyed, so reserving enough
+// up front builds a message with a single allocation. A reader never reads
+// past the end of the body: the first read that would fails, as do all
+// after it, and ok() turns false.
+
+namespace olc
+{
+	namespace net
+	{
+		namespace detail
+		{
+			template <typename V>
+			struct is_std_array : std::false_type
+			{};
+
+			template <typename E, size_t N>
+			struct is_std_array<std::array<E, N>> : std::true_type
+			{};
+
+			template <typename V, typename = void>
+			struct is_contiguous : std::false_type
+			{};
+
+			template <typename V>
+			struct is_contiguous<V, std::void_t<decltype(std::declval<V&>().data()), decltype(std::declval<V&>().size())>>
+				: std::bool_constant<!is_std_array<V>::value>
+			{};
+
+			template <typename V, typename = void>
+			struct is_resizable : std::false_type
+			{};
+
+			template <typename V>
+			struct is_resizable<V, std::void_t<decltype(std::declval<V&>().resize(size_t(0)))>> : std::true_type
+			{};
+
+			template <typename V>
+			using element_type = std::remove_cv_t<std::remove_reference_t<decltype(*std::declval<V&>().data())>>;
+
+			// The fewest bytes a V can take on the wire, by the rules above
+			template <typename V>
+			constexpr size_t min_encoded_size()
+			{
+				if constexpr (is_contiguous<V>::value)
+					return sizeof(uint32_t);
+				else if constexpr (is_std_array<V>::value && !std::is_trivially_copyable_v<V>)
+					return std::tuple_size_v<V> * min_encoded_size<typename V::value_type>();
+				else
+					return sizeof(V);
+			}
+		}
+
+		template <typename Message>
+		class message_writer
+		{
+		public:
+			// Reserves room for nReserve more bytes; anything already in the body
+			// is kept and written after
+			explicit message_writer(Message& msg, size_t nReserve = 0)
+				: m_msg(msg)
+			{
+				if (nReserve)
+					m_msg.body.reserve(m_msg.body.size() + nReserve);
+			}
+
+			message_writer(const message_writer&) = delete;
+			message_writer& operator=(const message_writer&) = delete;
+
+			~message_writer()
+			{
+				finish();
+			}
+
+			void reserve(size_t nBytes)
+			{
+				m_msg.body.reserve(m_msg.body.size() + nBytes);
+			}
+
+			template <typename V>
+			message_writer& write(const V& value)
+			{
+				if constexpr (detail::is_contiguous<V>::value)
+				{
+					using E = detail::element_type<V>;
+					write_count(value.size());
+					if constexpr (std::is_trivially_copyable_v<E>)
+					{
+						m_msg.body.append(value.data(), value.size() * sizeof(E));
+					}
+					else
+					{
+						for (const E& element : value)
+							write(element);
+					}
+				}
+				else if constexpr (detail::is_std_array<V>::value && !std::is_trivially_copyable_v<V>)
+				{
+					for (const auto& element : value)
+						write(element);
+				}
+				else
+				{
+					static_assert(std::is_trivially_copyable_v<V>, "value is neither trivially copyable nor a contiguous container");
+					m_msg.body.append(&value, sizeof(V));
+				}
+				return *this;
+			}
+
+			message_writer& write(const char* pString)
+			{
+				return write(std::string_view(pString));
+			}
+
+			// Raw bytes, with no length prefix
+			message_writer& write_bytes(const void* pData, size_t nBytes)
+			{
+				m_msg.body.append(pData, nBytes);
+				return *this;
+			}
+
+			template <typename V>
+			message_writer& operator<<(const V& value)
+			{
+				return write(value);
+			}
+
+			message_writer& operator<<(const char* pString)
+			{
+				return write(pString);
+			}
+
+			// Set header.size to the body length; safe to call more than once
+			void finish()
+			{
+				m_msg.header.size = uint32_t(m_msg.body.size());
+			}
+
+		private:
+			void write_count(size_t nCount)
+			{
+				if (nCount > std::numeric_limits<uint32_t>::max())
+					throw std::length_error("message_writer: container has more than 2^32 - 1 elements");
+				const uint32_t nPrefix = uint32_t(nCount);
+				m_msg.body.append(&nPrefix, sizeof(nPrefix));
+			}
+
+		private:
+			Message& m_msg;
+		};
+
+		class message_reader
+		{
+		public:
+			explicit message_reader(std::span<const uint8_t> body)
+				: m_body(body)
+			{}
+
+			template <typename T, typename Alloc, size_t nInlineBytes>
+			explicit message_reader(const message<T, Alloc, nInlineBytes>& msg)
+				: m_body(msg.body.data(), msg.body.size())
+			{}
+
+			template <typename T>
+			explicit message_reader(const message_view<T>& msg)
+				: m_body(msg.body)
+			{}
+
+			// False once any read has run past the end of the body
+			bool ok() const
+			{
+				return !m_bFailed;
+			}
+
+			size_t remaining() const
+			{
+				return m_body.size() - m_nPos;
+			}
+
+			template <typename V>
+			bool read(V& value)
+			{
+				if constexpr (detail::is_contiguous<V>::value)
+				{
+					static_assert(detail::is_resizable<V>::value, "can only read into containers that can be resized");
+
+					using E = detail::element_type<V>;
+					uint32_t nCount = 0;
+					if (!read_bytes(&nCount, sizeof(nCount)))
+						return false;
+
+					// Reject counts the rest of the body could not hold before
+					// allocating anything for them
+					constexpr size_t nMinBytes = std::max<size_t>(detail::min_encoded_size<E>(), 1);
+					if (size_t(nCount) > remaining() / nMinBytes)
+						return Fail();
+
+					value.resize(nCount);
+					if constexpr (std::is_trivially_copyable_v<E>)
+					{
+						return read_bytes(value.data(), size_t(nCount) * sizeof(E));
+					}
+					else
+					{
+						for (E& element : value)
+							if (!read(element))
+								return false;
+						return true;
+					}
+				}
+				else if constexpr (detail::is_std_array<V>::value && !std::is_trivially_copyable_v<V>)
+				{
+					for (auto& element : value)
+						if (!read(element))
+							return false;
+					return true;
+				}
+				else
+				{
+					static_assert(std::is_trivially_copyable_v<V>, "value is neither trivially copyable nor a contiguous container");
+					return read_bytes(&value, sizeof(V));
+				}
+			}
+
+			bool read_bytes(void* pData, size_t nBytes)
+			{
+				if (m_bFailed || nBytes > remaining())
+					return Fail();
+
+				if (nBytes)
+					std::memcpy(pData, m_body.data() + m_nPos, nBytes);
+				m_nPos += nBytes;
+				return true;
+			}
+
+			template <typename V>
+			message_reader& operator>>(V& value)
+			{
+				read(value);
+				return *this;
+			}
+
+		private:
+			bool Fail()
+			{
+				m_bFailed = true;
+				return false;
+			}
+
+		private:
+			std::span<const uint8_t> m_body;
+			size_t m_nPos = 0;
+			bool m_bFailed = false;
+		};
+	}
+}
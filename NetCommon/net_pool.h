@@ -0,0 +1,378 @@
+#pragma once
+
+#include "net_common.h"
+
+#include <cstddef>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// A size-class slab pool for message bodies and queue nodes.
+//
+// Each thread keeps a small cache of free blocks per size class, so the
+// common allocate/free pair touches no shared state. Blocks freed on a
+// different thread from the one that allocated them (io thread allocates a
+// body, Update() thread frees it) overflow from that thread's cache into a
+// central list, where the allocating thread picks them up again in batches.
+// Slabs are carved into blocks on demand and never returned to the system,
+// so once a workload has warmed up it does no malloc at all.
+
+namespace olc
+{
+	namespace net
+	{
+		struct pool_stats
+		{
+			uint64_t nHits = 0;      // allocations served from the thread cache
+			uint64_t nMisses = 0;    // allocations that had to refill from the central lists
+			uint64_t nSlabs = 0;     // slabs requested from the system
+			uint64_t nOversize = 0;  // allocations too large for any size class
+		};
+
+		class slab_pool
+		{
+		public:
+			static constexpr size_t nMinBlock = 16;
+			static constexpr size_t nMaxBlock = 64 * 1024;
+			static constexpr size_t nClasses = 13; // 16 bytes .. 64 KB in powers of two
+			static constexpr size_t nSlabSize = 2 * 1024 * 1024;
+			static_assert(nMinBlock % alignof(std::max_align_t) == 0, "blocks must stay aligned to max_align_t");
+
+			// The pool lives for the whole process; it is deliberately never
+			// destroyed so blocks freed during static destruction stay valid.
+			static slab_pool& instance()
+			{
+				static slab_pool* pool = new slab_pool();
+				return *pool;
+			}
+
+			// Back new slabs with huge pages where the platform supports it
+			// (Linux MAP_HUGETLB). Falls back to normal pages if none are reserved.
+			void UseHugePages(bool bEnable)
+			{
+				m_bHugePages.store(bEnable, std::memory_order_relaxed);
+			}
+
+			// Blocks are aligned to max_align_t: slabs are, and every block
+			// size is a multiple of nMinBlock
+			void* allocate(size_t nBytes)
+			{
+				if (nBytes > nMaxBlock)
+				{
+					m_nOversize.fetch_add(1, std::memory_order_relaxed);
+					return ::operator new(nBytes);
+				}
+
+				const size_t nClass = SizeClass(nBytes);
+				thread_cache& cache = LocalCache();
+				free_block* block = cache.lists[nClass].pHead;
+				if (block)
+				{
+					cache.lists[nClass].pHead = block->pNext;
+					cache.lists[nClass].nCount--;
+					if (++cache.nHits == nStatsFlush)
+						cache.Flush(*this);
+					return block;
+				}
+
+				m_nMisses.fetch_add(1, std::memory_order_relaxed);
+				Refill(cache.lists[nClass], nClass);
+				block = cache.lists[nClass].pHead;
+				cache.lists[nClass].pHead = block->pNext;
+				cache.lists[nClass].nCount--;
+				return block;
+			}
+
+			void deallocate(void* p, size_t nBytes)
+			{
+				if (!p)
+					return;
+
+				if (nBytes > nMaxBlock)
+				{
+					::operator delete(p);
+					return;
+				}
+
+				const size_t nClass = SizeClass(nBytes);
+				thread_cache& cache = LocalCache();
+				free_list& list = cache.lists[nClass];
+
+				free_block* block = static_cast<free_block*>(p);
+				block->pNext = list.pHead;
+				list.pHead = block;
+				if (++list.nCount > CacheLimit(nClass))
+					Release(list, nClass, list.nCount / 2);
+			}
+
+			pool_stats stats() const
+			{
+				pool_stats s;
+				s.nHits = m_nHits.load(std::memory_order_relaxed);
+				s.nMisses = m_nMisses.load(std::memory_order_relaxed);
+				s.nSlabs = m_nSlabs.load(std::memory_order_relaxed);
+				s.nOversize = m_nOversize.load(std::memory_order_relaxed);
+				return s;
+			}
+
+		private:
+			struct free_block
+			{
+				free_block* pNext;
+			};
+
+			struct free_list
+			{
+				free_block* pHead = nullptr;
+				size_t nCount = 0;
+			};
+
+			struct central_list
+			{
+				std::mutex mux;
+				free_list list;
+			};
+
+			static constexpr uint64_t nStatsFlush = 1024;
+
+			struct thread_cache
+			{
+				free_list lists[nClasses];
+				uint64_t nHits = 0;
+
+				void Flush(slab_pool& pool)
+				{
+					pool.m_nHits.fetch_add(nHits, std::memory_order_relaxed);
+					nHits = 0;
+				}
+
+				~thread_cache()
+				{
+					slab_pool& pool = slab_pool::instance();
+					Flush(pool);
+					for (size_t i = 0; i < nClasses; i++)
+						pool.Release(lists[i], i, lists[i].nCount);
+				}
+			};
+
+			slab_pool() = default;
+
+			static thread_cache& LocalCache()
+			{
+				thread_local thread_cache cache;
+				return cache;
+			}
+
+			static size_t SizeClass(size_t nBytes)
+			{
+				size_t nClass = 0;
+				size_t nBlock = nMinBlock;
+				while (nBlock < nBytes)
+				{
+					nBlock <<= 1;
+					nClass++;
+				}
+				return nClass;
+			}
+
+			static size_t BlockSize(size_t nClass)
+			{
+				return nMinBlock << nClass;
+			}
+
+			// Keep up to 256 KB of each class per thread, but at least a few blocks
+			static size_t CacheLimit(size_t nClass)
+			{
+				return std::max<size_t>(256 * 1024 / BlockSize(nClass), 8);
+			}
+
+			// Move a batch of blocks from the central list (or a fresh slab) into
+			// the thread's list
+			void Refill(free_list& local, size_t nClass)
+			{
+				const size_t nBatch = CacheLimit(nClass) / 2;
+				{
+					std::scoped_lock lock(m_central[nClass].mux);
+					free_list& central = m_central[nClass].list;
+					while (central.pHead && local.nCount < nBatch)
+					{
+						free_block* block = central.pHead;
+						central.pHead = block->pNext;
+						central.nCount--;
+						block->pNext = local.pHead;
+						local.pHead = block;
+						local.nCount++;
+					}
+				}
+
+				if (local.nCount > 0)
+					return;
+
+				std::scoped_lock lock(m_muxSlab);
+				const size_t nBlock = BlockSize(nClass);
+				for (size_t i = 0; i < nBatch; i++)
+				{
+					if (m_nSlabUsed + nBlock > nSlabSize || !m_pSlab)
+					{
+						m_pSlab = static_cast<uint8_t*>(AllocateSlab());
+						m_nSlabUsed = 0;
+					}
+
+					free_block* block = reinterpret_cast<free_block*>(m_pSlab + m_nSlabUsed);
+					m_nSlabUsed += nBlock;
+					block->pNext = local.pHead;
+					local.pHead = block;
+					local.nCount++;
+				}
+			}
+
+			// Hand nBlocks from a thread's list back to the central list
+			void Release(free_list& local, size_t nClass, size_t nBlocks)
+			{
+				if (nBlocks == 0)
+					return;
+
+				free_block* first = local.pHead;
+				free_block* last = first;
+				for (size_t i = 1; i < nBlocks; i++)
+					last = last->pNext;
+
+				local.pHead = last->pNext;
+				local.nCount -= nBlocks;
+
+				std::scoped_lock lock(m_central[nClass].mux);
+				free_list& central = m_central[nClass].list;
+				last->pNext = central.pHead;
+				central.pHead = first;
+				central.nCount += nBlocks;
+			}
+
+			void* AllocateSlab()
+			{
+				m_nSlabs.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+				if (m_bHugePages.load(std::memory_order_relaxed))
+				{
+					void* p = mmap(nullptr, nSlabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+					if (p != MAP_FAILED)
+						return p;
+				}
+#endif
+				return ::operator new(nSlabSize);
+			}
+
+		private:
+			central_list m_central[nClasses];
+
+			std::mutex m_muxSlab;
+			uint8_t* m_pSlab = nullptr;
+			size_t m_nSlabUsed = 0;
+
+			std::atomic<bool> m_bHugePages = false;
+
+			std::atomic<uint64_t> m_nHits = 0;
+			std::atomic<uint64_t> m_nMisses = 0;
+			std::atomic<uint64_t> m_nSlabs = 0;
+			std::atomic<uint64_t> m_nOversize = 0;
+		};
+
+		// Standard allocator over the shared slab pool. Stateless, so any two
+		// instances compare equal and containers can swap/move freely.
+		template <typename U>
+		struct pool_allocator
+		{
+			using value_type = U;
+
+			pool_allocator() noexcept = default;
+
+			template <typename V>
+			pool_allocator(const pool_allocator<V>&) noexcept {}
+
+			// Pool blocks are aligned to max_align_t; over-aligned types go
+			// to the aligned operator new instead
+			static constexpr bool bOverAligned = alignof(U) > alignof(std::max_align_t);
+
+			U* allocate(size_t n)
+			{
+				if constexpr (bOverAligned)
+					return static_cast<U*>(::operator new(n * sizeof(U), std::align_val_t{ alignof(U) }));
+				else
+					return static_cast<U*>(slab_pool::instance().allocate(n * sizeof(U)));
+			}
+
+			void deallocate(U* p, size_t n) noexcept
+			{
+				if constexpr (bOverAligned)
+					::operator delete(p, n * sizeof(U), std::align_val_t{ alignof(U) });
+				else
+					slab_pool::instance().deallocate(p, n * sizeof(U));
+			}
+
+			template <typename V>
+			bool operator==(const pool_allocator<V>&) const noexcept { return true; }
+
+			template <typename V>
+			bool operator!=(const pool_allocator<V>&) const noexcept { return false; }
+		};
+
+		// Wraps a completion handler so asio allocates its operation state from
+		// the pool. asio recycles handler memory on its own threads, but a post
+		// from any other thread would otherwise go to operator new every time.
+		template <typename Handler>
+		struct pooled_handler
+		{
+			using allocator_type = pool_allocator<uint8_t>;
+
+			Handler handler;
+
+			allocator_type get_allocator() const noexcept
+			{
+				return allocator_type();
+			}
+
+			template <typename... Args>
+			void operator()(Args&&... args)
+			{
+				handler(std::forward<Args>(args)...);
+			}
+		};
+
+		template <typename Handler>
+		pooled_handler<std::decay_t<Handler>> make_pooled_handler(Handler&& handler)
+		{
+			return { std::forward<Handler>(handler) };
+		}
+
+		// A refcounted block of pool memory. Receive buffers are made of these
+		// so message views can keep the bytes they point into alive.
+		struct pool_block
+		{
+			uint8_t* pData = nullptr;
+			size_t nSize = 0;
+
+			explicit pool_block(size_t nBytes)
+				: pData(pool_allocator<uint8_t>().allocate(nBytes)), nSize(nBytes)
+			{}
+
+			pool_block(const pool_block&) = delete;
+			pool_block& operator=(const pool_block&) = delete;
+
+			~pool_block()
+			{
+				pool_allocator<uint8_t>().deallocate(pData, nSize);
+			}
+		};
+
+		inline std::shared_ptr<pool_block> make_pool_block(size_t nBytes)
+		{
+			return std::allocate_shared<pool_block>(pool_allocator<pool_block>(), nBytes);
+		}
+
+		inline pool_stats GetPoolStats()
+		{
+			return slab_pool::instance().stats();
+		}
+	}
+}
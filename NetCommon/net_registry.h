@@ -0,0 +1,194 @@
+#pragma once
+
+#include "net_common.h"
+
+// Connections by client ID. IDs map to positions in a dense array through
+// an open-addressing table (linear probing, Fibonacci hashing, no
+// tombstones), so lookup, insert and erase are O(1) and iterating walks
+// one contiguous array of pointers, which keeps broadcasts cheap at tens
+// of thousands of clients. Erasing moves the last entry into the hole, so
+// iteration order is not insertion order.
+//
+// ID 0 marks an empty slot and cannot be stored. Not thread safe; the
+// server guards it with m_muxConnections.
+
+namespace olc
+{
+	namespace net
+	{
+		template <typename T>
+		class connection_registry
+		{
+		public:
+			using value_type = std::shared_ptr<connection<T>>;
+
+			connection_registry()
+			{
+				Rehash(64);
+			}
+
+			size_t size() const
+			{
+				return m_vecValues.size();
+			}
+
+			bool empty() const
+			{
+				return m_vecValues.empty();
+			}
+
+			auto begin() { return m_vecValues.begin(); }
+			auto end() { return m_vecValues.end(); }
+			auto begin() const { return m_vecValues.begin(); }
+			auto end() const { return m_vecValues.end(); }
+
+			// Returns false if the ID is already present
+			bool insert(uint32_t nID, value_type client)
+			{
+				if ((m_vecValues.size() + 1) * 2 > m_vecSlots.size())
+					Rehash(m_vecSlots.size() * 2);
+
+				size_t i = Home(nID);
+				while (m_vecSlots[i].nID != 0)
+				{
+					if (m_vecSlots[i].nID == nID)
+						return false;
+					i = (i + 1) & m_nMask;
+				}
+
+				m_vecSlots[i] = { nID, uint32_t(m_vecValues.size()) };
+				m_vecIDs.push_back(nID);
+				m_vecValues.push_back(std::move(client));
+				return true;
+			}
+
+			// nullptr if there is no such client
+			value_type find(uint32_t nID) const
+			{
+				const size_t i = FindSlot(nID);
+				return i == npos ? nullptr : m_vecValues[m_vecSlots[i].nIndex];
+			}
+
+			bool contains(uint32_t nID) const
+			{
+				return FindSlot(nID) != npos;
+			}
+
+			// Returns false if the ID was not present
+			bool erase(uint32_t nID)
+			{
+				const size_t i = FindSlot(nID);
+				if (i == npos)
+					return false;
+
+				RemoveAt(m_vecSlots[i].nIndex, i);
+				return true;
+			}
+
+			// Remove every client for which pred(client) is true in one pass; pred
+			// may act on the clients it keeps. Returns how many were removed.
+			template <typename Pred>
+			size_t erase_if(Pred&& pred)
+			{
+				size_t nRemoved = 0;
+				for (size_t n = 0; n < m_vecValues.size();)
+				{
+					if (pred(m_vecValues[n]))
+					{
+						// The last entry moves into n, so look at n again
+						RemoveAt(n, FindSlot(m_vecIDs[n]));
+						nRemoved++;
+					}
+					else
+					{
+						n++;
+					}
+				}
+				return nRemoved;
+			}
+
+		private:
+			struct slot
+			{
+				uint32_t nID = 0;
+				uint32_t nIndex = 0;
+			};
+
+			static constexpr size_t npos = size_t(-1);
+
+			size_t Home(uint32_t nID) const
+			{
+				return size_t((uint64_t(nID) * 0x9E3779B97F4A7C15ull) >> m_nShift);
+			}
+
+			size_t FindSlot(uint32_t nID) const
+			{
+				if (nID == 0)
+					return npos;
+
+				for (size_t i = Home(nID); m_vecSlots[i].nID != 0; i = (i + 1) & m_nMask)
+				{
+					if (m_vecSlots[i].nID == nID)
+						return i;
+				}
+				return npos;
+			}
+
+			// Remove the value at nIndex, whose table slot is nSlot
+			void RemoveAt(size_t nIndex, size_t nSlot)
+			{
+				// Fill the hole in the dense arrays with the last entry
+				const size_t nLast = m_vecValues.size() - 1;
+				if (nIndex != nLast)
+				{
+					m_vecValues[nIndex] = std::move(m_vecValues[nLast]);
+					m_vecIDs[nIndex] = m_vecIDs[nLast];
+					m_vecSlots[FindSlot(m_vecIDs[nIndex])].nIndex = uint32_t(nIndex);
+				}
+				m_vecValues.pop_back();
+				m_vecIDs.pop_back();
+
+				// Shift later members of the probe run back so lookups never need
+				// to step over a tombstone
+				size_t i = nSlot;
+				for (size_t j = (i + 1) & m_nMask; m_vecSlots[j].nID != 0; j = (j + 1) & m_nMask)
+				{
+					const size_t k = Home(m_vecSlots[j].nID);
+					const bool bMovable = (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+					if (bMovable)
+					{
+						m_vecSlots[i] = m_vecSlots[j];
+						i = j;
+					}
+				}
+				m_vecSlots[i] = slot{};
+			}
+
+			void Rehash(size_t nSlots)
+			{
+				m_nShift = 64;
+				for (size_t n = nSlots; n > 1; n >>= 1)
+					m_nShift--;
+				m_nMask = nSlots - 1;
+
+				m_vecSlots.assign(nSlots, slot{});
+				for (size_t n = 0; n < m_vecIDs.size(); n++)
+				{
+					size_t i = Home(m_vecIDs[n]);
+					while (m_vecSlots[i].nID != 0)
+						i = (i + 1) & m_nMask;
+					m_vecSlots[i] = { m_vecIDs[n], uint32_t(n) };
+				}
+			}
+
+		private:
+			std::vector<slot> m_vecSlots;
+			size_t m_nMask = 0;
+			unsigned m_nShift = 0;
+
+			// Dense arrays, indexed together
+			std::vector<value_type> m_vecValues;
+			std::vector<uint32_t> m_vecIDs;
+		};
+	}
+}
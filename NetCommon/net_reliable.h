@@ -0,0 +1,651 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_framing.h"
+#include "net_datagram.h"
+#include "net_eventcount.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+
+// Reliable datagrams: sequencing, selective acks, retransmission and
+// per-channel ordering on top of the datagram channel in net_datagram.h.
+// A packet lost on the TCP stream holds up every byte behind it until it
+// is resent, at least 200ms later on Linux; here it holds up only the
+// messages on its own channel, and is resent within a few round trips.
+//
+// Each reliable datagram carries one message, numbered in a sequence of
+// its own per direction, and the sender's view of the other direction:
+//
+//     uint64_t nToken
+//     uint8_t  nKind          datagram_reliable
+//     uint32_t nAckBase       every packet before this one has arrived...
+//     uint8_t  nAckWords      (0 to 4)
+//     uint64_t vAckBits[nAckWords]  ...and so has nAckBase + 1 + i, for each bit i set
+//     uint32_t nSeq
+//     uint8_t  nChannel       top bit set if ordered
+//     uint32_t nChannelSeq    ordered only
+//     header, body            as an unreliable message
+//
+// A datagram_ack has only the ack fields, and goes out when a packet has
+// arrived and nothing is being sent back to carry them. Up to
+// nReliableWindow packets may be unacked; later messages wait at the
+// sender. A packet is resent once three later ones are acked, or when its
+// timeout runs out: the smoothed round trip plus four deviations, as TCP
+// computes it but with a 4ms floor, doubling with each resend.
+//
+// Every message is delivered once. On an ordered channel, in the order it
+// was sent on that channel; on an unordered one, as soon as it arrives.
+// Delivery may refuse a message (its queue is full): one that was next in
+// line is then treated as never having arrived, so it goes unacked and the
+// sender resends it; one already held for ordering is offered again shortly.
+//
+// A link counts what it holds, waiting or unacked, so the connection can
+// bound it (see connection::SendDatagram). One whose oldest packet has
+// timed out nMaxSilentTimeouts times in a row, with nothing at all heard
+// from the peer meanwhile, gives up: it closes and reports the peer dead.
+
+namespace olc
+{
+	namespace net
+	{
+		enum class delivery
+		{
+			unreliable,      // sent once, may be lost or reordered
+			reliable,        // resent until acked, delivered as it arrives
+			reliable_ordered // resent until acked, delivered in order within its channel
+		};
+
+		constexpr size_t nReliableChannels = 16;
+		constexpr uint32_t nReliableWindow = 256;
+
+		// Messages a link may hold, waiting or unacked, when the connection
+		// sets no high-water mark of its own: the inbound ring's capacity
+		constexpr size_t nReliableMaxQueued = 16384;
+
+		using channel_modes = std::array<delivery, nReliableChannels>;
+
+		// Every channel reliable and ordered, like the stream
+		inline channel_modes default_channels()
+		{
+			channel_modes vChannels;
+			vChannels.fill(delivery::reliable_ordered);
+			return vChannels;
+		}
+
+		// The reliable state of one datagram channel, both directions. Lives on
+		// the datagram socket's io thread: every call but the constructor must
+		// be made there, except the statistics, Admit() and WaitForRoom().
+		// Messages that arrive go to deliver, which returns false, leaving the
+		// message alone, if it can't take it yet; dead is called once if the
+		// peer stops answering.
+		template <typename T>
+		class reliable_link : public std::enable_shared_from_this<reliable_link<T>>
+		{
+		public:
+			using deliver_type = std::function<bool(message<T>&&)>;
+			using dead_type = std::function<void()>;
+			using clock = std::chrono::steady_clock;
+
+			reliable_link(datagram_socket<T>& socket, uint64_t nToken, framing mode, deliver_type deliver, dead_type dead)
+				: m_socket(socket), m_nToken(nToken), m_nFraming(mode), m_deliver(std::move(deliver)), m_dead(std::move(dead)),
+				m_vecSent(nReliableWindow), m_timer(socket.GetContext()), m_vecReceived(nReliableWindow),
+				m_timerRedeliver(socket.GetContext())
+			{}
+
+			// Where to send; nothing goes out until this is known
+			void SetPeer(const asio::ip::udp::endpoint& peer)
+			{
+				m_peer = peer;
+				if (!m_bPeer)
+				{
+					m_bPeer = true;
+					FillWindow();
+					ArmTimer();
+				}
+			}
+
+			// Count a message about to be posted to Send(), from any thread
+			void Admit(size_t nBytes)
+			{
+				m_nQueuedBytes.fetch_add(nBytes, std::memory_order_relaxed);
+				m_nQueuedMessages.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// Block until ready() holds, rechecked as messages are acked, or the
+			// link closes. Never on the socket's thread, which does the acking.
+			template<typename Pred>
+			void WaitForRoom(Pred&& ready)
+			{
+				m_ecReleased.wait([&]() { return m_bClosed.load(std::memory_order_acquire) || ready(); });
+			}
+
+			// msg must have been Admit()ted
+			void Send(uint8_t nChannel, bool bOrdered, message_view<T> msg)
+			{
+				if (m_bClosed)
+				{
+					Release(msg.size(), 1);
+					return;
+				}
+
+				m_deqPending.push_back({ std::move(msg), bOrdered ? m_vChannelSeqOut[nChannel]++ : 0, nChannel, bOrdered });
+				FillWindow();
+				ArmTimer();
+			}
+
+			// A datagram_reliable or datagram_ack, after its kind byte
+			void Receive(datagram_kind nKind, std::span<const uint8_t> data)
+			{
+				if (m_bClosed)
+					return;
+
+				// Anything from the peer, even a duplicate, shows it is still there
+				m_nSilentTimeouts = 0;
+
+				const uint8_t* p = data.data();
+				const uint8_t* const pEnd = p + data.size();
+				auto Get = [&](auto& value)
+				{
+					if (size_t(pEnd - p) < sizeof(value))
+						return false;
+					std::memcpy(&value, p, sizeof(value));
+					p += sizeof(value);
+					return true;
+				};
+
+				uint32_t nAckBase;
+				uint8_t nAckWords;
+				uint64_t vAckBits[nAckWordsMax] = {};
+				if (!Get(nAckBase) || !Get(nAckWords) || nAckWords > nAckWordsMax)
+					return;
+				for (uint8_t i = 0; i < nAckWords; i++)
+				{
+					if (!Get(vAckBits[i]))
+						return;
+				}
+
+				if (nKind == datagram_reliable)
+				{
+					uint32_t nSeq;
+					uint8_t nChannel;
+					uint32_t nChannelSeq = 0;
+					if (!Get(nSeq) || !Get(nChannel))
+						return;
+					const bool bOrdered = (nChannel & 0x80) != 0;
+					nChannel &= 0x7F;
+					if (nChannel >= nReliableChannels || (bOrdered && !Get(nChannelSeq)))
+						return;
+
+					message_header<T> header;
+					bool bCompressed = false;
+					const size_t nHeader = frame_header<T>::Decode(m_nFraming, false, p, size_t(pEnd - p), header, bCompressed);
+					if (nHeader == 0 || nHeader == varint_malformed || header.size != size_t(pEnd - p) - nHeader)
+						return;
+
+					OnAcks(nAckBase, vAckBits, nAckWords);
+					OnPacket(nSeq, nChannel, bOrdered, nChannelSeq, header, std::span<const uint8_t>(p + nHeader, pEnd));
+				}
+				else
+				{
+					OnAcks(nAckBase, vAckBits, nAckWords);
+				}
+
+				FillWindow();
+				ArmTimer();
+			}
+
+			// Stop sending and let go of everything queued
+			void Close()
+			{
+				if (m_bClosed)
+					return;
+
+				m_bClosed.store(true, std::memory_order_release);
+				m_timer.cancel();
+				m_timerRedeliver.cancel();
+
+				size_t nBytes = 0;
+				size_t nMessages = 0;
+				for (auto& waiting : m_deqPending)
+				{
+					nBytes += waiting.msg.size();
+					nMessages++;
+				}
+				m_deqPending.clear();
+				for (uint32_t nSeq = m_nSendBase; nSeq != m_nNextSeq; nSeq++)
+				{
+					sent& slot = m_vecSent[nSeq % nReliableWindow];
+					if (!slot.bAcked)
+					{
+						nBytes += slot.msg.size();
+						nMessages++;
+					}
+					slot.msg = {};
+				}
+				for (auto& channel : m_vecChannelsIn)
+					channel.mapHeld.clear();
+				Release(nBytes, nMessages);
+			}
+
+			bool IsClosed() const
+			{
+				return m_bClosed.load(std::memory_order_acquire);
+			}
+
+			// Statistics, safe to read from any thread
+			uint64_t GetRetransmitCount() const
+			{
+				return m_nRetransmits.load(std::memory_order_relaxed);
+			}
+
+			// Smoothed round trip in microseconds, 0 before the first sample
+			int64_t GetRtt() const
+			{
+				return m_nRttUs.load(std::memory_order_relaxed);
+			}
+
+			// Messages held, waiting for the window or unacked, and their bytes
+			size_t GetQueuedMessages() const
+			{
+				return m_nQueuedMessages.load(std::memory_order_relaxed);
+			}
+
+			size_t GetQueuedBytes() const
+			{
+				return m_nQueuedBytes.load(std::memory_order_relaxed);
+			}
+
+		private:
+			static constexpr size_t nAckWordsMax = nReliableWindow / 64;
+			static constexpr int64_t nMinRtoUs = 4000;
+			static constexpr int64_t nMaxRtoUs = 1000000;
+			static constexpr int64_t nInitialRtoUs = 100000;
+			static constexpr uint32_t nFastResendAfter = 3;
+			// With the backoff, some 4s on a loopback and 17s at the initial timeout
+			static constexpr uint32_t nMaxSilentTimeouts = 20;
+
+			struct pending
+			{
+				message_view<T> msg;
+				uint32_t nChannelSeq;
+				uint8_t nChannel;
+				bool bOrdered;
+			};
+
+			struct sent
+			{
+				message_view<T> msg;
+				clock::time_point tSent;
+				clock::time_point tDue;
+				uint32_t nChannelSeq = 0;
+				uint32_t nSends = 0;
+				uint8_t nChannel = 0;
+				bool bOrdered = false;
+				bool bAcked = true;
+				bool bFastResent = false;
+			};
+
+			struct channel_in
+			{
+				uint32_t nNext = 0;
+				std::map<uint32_t, message<T>> mapHeld;
+			};
+
+			static uint8_t* Put(uint8_t* p, uint32_t nValue)
+			{
+				std::memcpy(p, &nValue, sizeof(nValue));
+				return p + sizeof(nValue);
+			}
+
+			bool InFlight(uint32_t nSeq) const
+			{
+				return int32_t(nSeq - m_nSendBase) >= 0 && int32_t(m_nNextSeq - nSeq) > 0;
+			}
+
+			// Move waiting messages into the window, as far as it allows
+			void FillWindow()
+			{
+				if (!m_bPeer)
+					return;
+
+				while (!m_deqPending.empty() && m_nNextSeq - m_nSendBase < nReliableWindow)
+				{
+					pending& next = m_deqPending.front();
+					const uint32_t nSeq = m_nNextSeq++;
+					sent& slot = m_vecSent[nSeq % nReliableWindow];
+					slot = sent{ std::move(next.msg), {}, {}, next.nChannelSeq, 0, next.nChannel, next.bOrdered, false, false };
+					m_deqPending.pop_front();
+					Transmit(nSeq);
+				}
+			}
+
+			uint8_t* WriteAcks(uint8_t* p)
+			{
+				p = Put(p, m_nRecvBase);
+
+				uint64_t vBits[nAckWordsMax] = {};
+				uint8_t nWords = 0;
+				for (uint32_t i = 1; int32_t(m_nRecvHigh - (m_nRecvBase + i)) >= 0 && i < nReliableWindow; i++)
+				{
+					if (m_vecReceived[(m_nRecvBase + i) % nReliableWindow])
+					{
+						vBits[(i - 1) / 64] |= uint64_t(1) << ((i - 1) % 64);
+						nWords = uint8_t((i - 1) / 64 + 1);
+					}
+				}
+
+				*p++ = nWords;
+				std::memcpy(p, vBits, nWords * sizeof(uint64_t));
+				return p + nWords * sizeof(uint64_t);
+			}
+
+			void Transmit(uint32_t nSeq)
+			{
+				sent& slot = m_vecSent[nSeq % nReliableWindow];
+
+				uint8_t vPrefix[nMaxDatagramPrefix<T>];
+				uint8_t* p = vPrefix;
+				*p++ = datagram_reliable;
+				p = WriteAcks(p);
+				p = Put(p, nSeq);
+				*p++ = uint8_t(slot.nChannel | (slot.bOrdered ? 0x80 : 0));
+				if (slot.bOrdered)
+					p = Put(p, slot.nChannelSeq);
+				p += frame_header<T>::Encode(m_nFraming, false, slot.msg.header, false, p);
+
+				m_socket.Write(m_peer, m_nToken, std::span<const uint8_t>(vPrefix, size_t(p - vPrefix)), slot.msg.body);
+				m_bAckPending = false;
+
+				const clock::time_point tNow = clock::now();
+				slot.tSent = tNow;
+				slot.tDue = tNow + std::chrono::microseconds(std::min(m_nRtoUs << std::min<uint32_t>(slot.nSends, 6), nMaxRtoUs));
+				slot.nSends++;
+			}
+
+			void Retransmit(uint32_t nSeq)
+			{
+				Transmit(nSeq);
+				m_nRetransmits.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void SampleRtt(clock::duration rtt)
+			{
+				const int64_t nRtt = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+				if (m_nSrttUs == 0)
+				{
+					m_nSrttUs = std::max<int64_t>(nRtt, 1);
+					m_nRttVarUs = nRtt / 2;
+				}
+				else
+				{
+					m_nRttVarUs = (3 * m_nRttVarUs + std::abs(m_nSrttUs - nRtt)) / 4;
+					m_nSrttUs = std::max<int64_t>((7 * m_nSrttUs + nRtt) / 8, 1);
+				}
+				m_nRtoUs = std::clamp(m_nSrttUs + 4 * m_nRttVarUs, nMinRtoUs, nMaxRtoUs);
+				m_nRttUs.store(m_nSrttUs, std::memory_order_relaxed);
+			}
+
+			void Acked(uint32_t nSeq, clock::time_point tNow)
+			{
+				sent& slot = m_vecSent[nSeq % nReliableWindow];
+				if (slot.bAcked)
+					return;
+
+				// Only a packet sent once says how long the round trip took
+				if (slot.nSends == 1)
+					SampleRtt(tNow - slot.tSent);
+				slot.bAcked = true;
+				Release(slot.msg.size(), 1);
+				slot.msg = {};
+			}
+
+			void Release(size_t nBytes, size_t nMessages)
+			{
+				m_nQueuedBytes.fetch_sub(nBytes, std::memory_order_relaxed);
+				m_nQueuedMessages.fetch_sub(nMessages, std::memory_order_relaxed);
+				m_ecReleased.notify_all();
+			}
+
+			void OnAcks(uint32_t nAckBase, const uint64_t* pBits, uint8_t nWords)
+			{
+				// Acks for packets not sent yet are bogus
+				if (int32_t(nAckBase - m_nNextSeq) > 0)
+					return;
+
+				const clock::time_point tNow = clock::now();
+				bool bAny = false;
+				uint32_t nHighest = 0;
+				for (uint32_t nSeq = m_nSendBase; int32_t(nAckBase - nSeq) > 0; nSeq++)
+				{
+					Acked(nSeq, tNow);
+					bAny = true;
+					nHighest = nSeq;
+				}
+				for (uint32_t i = 0; i < uint32_t(nWords) * 64; i++)
+				{
+					const uint32_t nSeq = nAckBase + 1 + i;
+					if ((pBits[i / 64] >> (i % 64) & 1) && InFlight(nSeq))
+					{
+						Acked(nSeq, tNow);
+						bAny = true;
+						nHighest = nSeq;
+					}
+				}
+
+				while (m_nSendBase != m_nNextSeq && m_vecSent[m_nSendBase % nReliableWindow].bAcked)
+					m_nSendBase++;
+
+				// Packets that later ones have overtaken are most likely lost
+				if (bAny)
+				{
+					for (uint32_t nSeq = m_nSendBase; int32_t(nHighest - nSeq) >= int32_t(nFastResendAfter); nSeq++)
+					{
+						sent& slot = m_vecSent[nSeq % nReliableWindow];
+						if (!slot.bAcked && !slot.bFastResent)
+						{
+							slot.bFastResent = true;
+							Retransmit(nSeq);
+						}
+					}
+				}
+			}
+
+			void OnPacket(uint32_t nSeq, uint8_t nChannel, bool bOrdered, uint32_t nChannelSeq, const message_header<T>& header, std::span<const uint8_t> body)
+			{
+				// Ack duplicates too: it was the ack that went missing
+				ScheduleAck();
+
+				const int32_t nAhead = int32_t(nSeq - m_nRecvBase);
+				if (nAhead < 0 || nAhead >= int32_t(nReliableWindow) || m_vecReceived[nSeq % nReliableWindow])
+					return;
+
+				message<T> msg;
+				msg.header = header;
+				msg.body.assign(body.begin(), body.end());
+
+				channel_in& channel = m_vecChannelsIn[nChannel];
+				if (bOrdered && nChannelSeq != channel.nNext)
+				{
+					// Held back behind a gap; one already delivered is just acked
+					if (int32_t(nChannelSeq - channel.nNext) > 0)
+						channel.mapHeld.emplace(nChannelSeq, std::move(msg));
+				}
+				else if (!m_deliver(std::move(msg)))
+				{
+					// Not taken, so not acked either: the sender will resend it
+					return;
+				}
+				else if (bOrdered)
+				{
+					channel.nNext++;
+					DeliverHeld(channel);
+				}
+
+				m_vecReceived[nSeq % nReliableWindow] = 1;
+				if (int32_t(nSeq - m_nRecvHigh) > 0)
+					m_nRecvHigh = nSeq;
+				while (m_vecReceived[m_nRecvBase % nReliableWindow])
+				{
+					m_vecReceived[m_nRecvBase % nReliableWindow] = 0;
+					m_nRecvBase++;
+				}
+			}
+
+			// Deliver what was held for a channel and is now next in line. These
+			// were acked when they arrived, so if delivery refuses one it stays
+			// held and is offered again a little later.
+			void DeliverHeld(channel_in& channel)
+			{
+				for (auto it = channel.mapHeld.begin(); it != channel.mapHeld.end() && it->first == channel.nNext; it = channel.mapHeld.erase(it))
+				{
+					if (!m_deliver(std::move(it->second)))
+					{
+						RetryHeld();
+						return;
+					}
+					channel.nNext++;
+				}
+			}
+
+			void RetryHeld()
+			{
+				if (m_bRedeliverArmed)
+					return;
+
+				m_bRedeliverArmed = true;
+				m_timerRedeliver.expires_after(std::chrono::milliseconds(1));
+				m_timerRedeliver.async_wait([self = this->shared_from_this()](std::error_code ec)
+					{
+						self->m_bRedeliverArmed = false;
+						if (ec || self->m_bClosed)
+							return;
+						for (auto& channel : self->m_vecChannelsIn)
+							self->DeliverHeld(channel);
+					});
+			}
+
+			// Ack everything that arrived in this turn of the io loop at once,
+			// unless a reliable packet going out carries the acks first
+			void ScheduleAck()
+			{
+				if (m_bAckPending)
+					return;
+
+				m_bAckPending = true;
+				asio::post(m_socket.GetContext(), [self = this->shared_from_this()]()
+					{
+						if (!self->m_bAckPending || self->m_bClosed || !self->m_bPeer)
+							return;
+
+						uint8_t vPrefix[nMaxDatagramPrefix<T>];
+						uint8_t* p = vPrefix;
+						*p++ = datagram_ack;
+						p = self->WriteAcks(p);
+						self->m_socket.Write(self->m_peer, self->m_nToken, std::span<const uint8_t>(vPrefix, size_t(p - vPrefix)), {});
+						self->m_bAckPending = false;
+					});
+			}
+
+			// Keep the timer set for the earliest retransmission due
+			void ArmTimer()
+			{
+				if (m_bClosed || !m_bPeer)
+					return;
+
+				clock::time_point tNext = clock::time_point::max();
+				for (uint32_t nSeq = m_nSendBase; nSeq != m_nNextSeq; nSeq++)
+				{
+					const sent& slot = m_vecSent[nSeq % nReliableWindow];
+					if (!slot.bAcked)
+						tNext = std::min(tNext, slot.tDue);
+				}
+				if (tNext == clock::time_point::max() || (m_bTimerArmed && m_tTimer <= tNext))
+					return;
+
+				m_bTimerArmed = true;
+				m_tTimer = tNext;
+				m_timer.expires_at(tNext);
+				m_timer.async_wait([self = this->shared_from_this(), nGeneration = ++m_nTimerGeneration](std::error_code ec)
+					{
+						// A wait replaced by a sooner one is cancelled, and ignored here
+						if (ec || nGeneration != self->m_nTimerGeneration || self->m_bClosed)
+							return;
+						self->m_bTimerArmed = false;
+						self->OnTimeout();
+					});
+			}
+
+			void OnTimeout()
+			{
+				const clock::time_point tNow = clock::now();
+
+				// The oldest packet is the first to time out each round
+				const sent& oldest = m_vecSent[m_nSendBase % nReliableWindow];
+				if (m_nSendBase != m_nNextSeq && !oldest.bAcked && oldest.tDue <= tNow && ++m_nSilentTimeouts >= nMaxSilentTimeouts)
+				{
+					Close();
+					m_dead();
+					return;
+				}
+
+				for (uint32_t nSeq = m_nSendBase; nSeq != m_nNextSeq; nSeq++)
+				{
+					const sent& slot = m_vecSent[nSeq % nReliableWindow];
+					if (!slot.bAcked && slot.tDue <= tNow)
+						Retransmit(nSeq);
+				}
+				ArmTimer();
+			}
+
+		private:
+			datagram_socket<T>& m_socket;
+			const uint64_t m_nToken;
+			const framing m_nFraming;
+			deliver_type m_deliver;
+			dead_type m_dead;
+			asio::ip::udp::endpoint m_peer;
+			bool m_bPeer = false;
+			std::atomic<bool> m_bClosed = false;
+
+			// Sending: packets [m_nSendBase, m_nNextSeq) in the window, by sequence
+			// number modulo its size, and messages waiting for room
+			std::vector<sent> m_vecSent;
+			std::deque<pending> m_deqPending;
+			uint32_t m_nSendBase = 0;
+			uint32_t m_nNextSeq = 0;
+			std::array<uint32_t, nReliableChannels> m_vChannelSeqOut = {};
+			uint32_t m_nSilentTimeouts = 0;
+
+			// Admitted and not yet acked or let go, for the connection's limits
+			std::atomic<size_t> m_nQueuedBytes = 0;
+			std::atomic<size_t> m_nQueuedMessages = 0;
+			eventcount m_ecReleased;
+
+			// Round trip, RFC 6298 style
+			int64_t m_nSrttUs = 0;
+			int64_t m_nRttVarUs = 0;
+			int64_t m_nRtoUs = nInitialRtoUs;
+
+			asio::steady_timer m_timer;
+			clock::time_point m_tTimer;
+			uint64_t m_nTimerGeneration = 0;
+			bool m_bTimerArmed = false;
+
+			// Receiving: which packets from m_nRecvBase on have arrived, and each
+			// ordered channel's messages held back behind a gap
+			std::vector<uint8_t> m_vecReceived;
+			uint32_t m_nRecvBase = 0;
+			uint32_t m_nRecvHigh = 0;
+			std::array<channel_in, nReliableChannels> m_vecChannelsIn;
+			bool m_bAckPending = false;
+			asio::steady_timer m_timerRedeliver;
+			bool m_bRedeliverArmed = false;
+
+			std::atomic<uint64_t> m_nRetransmits = 0;
+			std::atomic<int64_t> m_nRttUs = 0;
+		};
+	}
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <array>
+#include <type_traits>
+
+// Typed payloads for message IDs, with the wire layout fixed at compile
+// time. A payload is a struct naming the ID it travels under:
+//
+//     struct Move
+//     {
+//         static constexpr GameMsg id = GameMsg::Move;
+//         uint32_t nEntity;
+//         float x, y;
+//     };
+//
+// A trivially copyable payload goes on the wire as its own bytes, with one
+// memcpy each way. A payload can instead list its fields, which are then
+// packed back to back in that order with no padding, each at an offset
+// known at compile time:
+//
+//         using schema = olc::net::fields<&Move::nEntity, &Move::x, &Move::y>;
+//
+// handler_table<T, Payloads...> builds, at compile time, an array of
+// decoders indexed by message ID. Dispatching a message is one bounds check
+// and one indirect call, which decodes the body and calls the handler's
+// OnPayload(client, payload) overload for that type directly.
+
+namespace olc
+{
+	namespace net
+	{
+		// Explicit wire layout of a payload; see above
+		template <auto... pMembers>
+		struct fields
+		{};
+
+		namespace detail
+		{
+			template <typename M>
+			struct member_traits;
+
+			template <typename C, typename F>
+			struct member_traits<F C::*>
+			{
+				using field = F;
+			};
+
+			template <typename P, typename = void>
+			struct has_schema : std::false_type
+			{};
+
+			template <typename P>
+			struct has_schema<P, std::void_t<typename P::schema>> : std::true_type
+			{};
+
+			template <typename S>
+			struct field_layout;
+
+			template <auto... pMembers>
+			struct field_layout<fields<pMembers...>>
+			{
+				static constexpr size_t nCount = sizeof...(pMembers);
+
+				static constexpr std::array<size_t, nCount> vSizes = { sizeof(typename member_traits<decltype(pMembers)>::field)... };
+
+				static constexpr std::array<size_t, nCount> vOffsets = []()
+				{
+					std::array<size_t, nCount> vOffsets{};
+					size_t nOffset = 0;
+					for (size_t i = 0; i < nCount; i++)
+					{
+						vOffsets[i] = nOffset;
+						nOffset += vSizes[i];
+					}
+					return vOffsets;
+				}();
+
+				static constexpr size_t nSize = (size_t(0) + ... + sizeof(typename member_traits<decltype(pMembers)>::field));
+
+				static_assert((std::is_trivially_copyable_v<typename member_traits<decltype(pMembers)>::field> && ...),
+					"schema fields must be trivially copyable");
+
+				template <typename P>
+				static void Write(uint8_t* pData, const P& payload)
+				{
+					size_t i = 0;
+					((std::memcpy(pData + vOffsets[i++], &(payload.*pMembers), sizeof(payload.*pMembers))), ...);
+				}
+
+				template <typename P>
+				static void Read(const uint8_t* pData, P& payload)
+				{
+					size_t i = 0;
+					((std::memcpy(&(payload.*pMembers), pData + vOffsets[i++], sizeof(payload.*pMembers))), ...);
+				}
+			};
+
+			// Whole-struct layout, for payloads without a schema
+			template <typename P>
+			struct struct_layout
+			{
+				static_assert(std::is_trivially_copyable_v<P>, "payloads that are not trivially copyable need a schema");
+
+				static constexpr size_t nSize = sizeof(P);
+
+				static void Write(uint8_t* pData, const P& payload)
+				{
+					std::memcpy(pData, &payload, sizeof(P));
+				}
+
+				static void Read(const uint8_t* pData, P& payload)
+				{
+					std::memcpy(&payload, pData, sizeof(P));
+				}
+			};
+
+			template <typename P, bool bSchema = has_schema<P>::value>
+			struct layout_of
+			{
+				using type = struct_layout<P>;
+			};
+
+			template <typename P>
+			struct layout_of<P, true>
+			{
+				using type = field_layout<typename P::schema>;
+			};
+		}
+
+		template <typename P>
+		using payload_layout = typename detail::layout_of<P>::type;
+
+		// Size of P on the wire
+		template <typename P>
+		inline constexpr size_t payload_size = payload_layout<P>::nSize;
+
+		// The message ID enum P travels under
+		template <typename P>
+		using payload_id_type = std::remove_cv_t<decltype(P::id)>;
+
+		// Replace msg's header and body with payload
+		template <typename P, typename T, typename Alloc, size_t nInlineBytes>
+		void encode(message<T, Alloc, nInlineBytes>& msg, const P& payload)
+		{
+			static_assert(std::is_same_v<payload_id_type<P>, T>, "payload belongs to another message type");
+
+			msg.body.resize(payload_size<P>);
+			payload_layout<P>::Write(msg.body.data(), payload);
+			msg.header.id = P::id;
+			msg.header.size = uint32_t(payload_size<P>);
+		}
+
+		template <typename P>
+		message<payload_id_type<P>> make_message(const P& payload)
+		{
+			message<payload_id_type<P>> msg;
+			encode(msg, payload);
+			return msg;
+		}
+
+		// False if the body is not exactly the size P has on the wire
+		template <typename P>
+		bool decode(std::span<const uint8_t> body, P& payload)
+		{
+			if (body.size() != payload_size<P>)
+				return false;
+
+			payload_layout<P>::Read(body.data(), payload);
+			return true;
+		}
+
+		template <typename P, typename T, typename Alloc, size_t nInlineBytes>
+		bool decode(const message<T, Alloc, nInlineBytes>& msg, P& payload)
+		{
+			return msg.header.id == P::id && decode(std::span<const uint8_t>(msg.body.data(), msg.body.size()), payload);
+		}
+
+		template <typename P, typename T>
+		bool decode(const message_view<T>& msg, P& payload)
+		{
+			return msg.header.id == P::id && decode(msg.body, payload);
+		}
+
+		// Routes messages of type T to Handler::OnPayload(client, const P&) for
+		// each P in Payloads. IDs must be distinct; the table has a slot for
+		// every ID up to the largest one, so keep the IDs dense.
+		template <typename T, typename... Payloads>
+		class handler_table
+		{
+			static_assert((std::is_same_v<payload_id_type<Payloads>, T> && ...), "every payload must use message type T");
+
+			static constexpr size_t nSlots = std::max({ size_t(0), (size_t(Payloads::id) + 1)... });
+			static_assert(nSlots <= 65536, "message IDs are too sparse for a handler table");
+
+			static constexpr bool UniqueIDs()
+			{
+				std::array<bool, nSlots> vUsed{};
+				for (size_t nID : { size_t(Payloads::id)... })
+				{
+					if (vUsed[nID])
+						return false;
+					vUsed[nID] = true;
+				}
+				return true;
+			}
+			static_assert(UniqueIDs(), "two payloads share a message ID");
+
+			using client_type = std::shared_ptr<connection<T>>;
+
+			template <typename Handler>
+			using thunk = bool (*)(Handler&, const client_type&, std::span<const uint8_t>);
+
+			template <typename Handler, typename P>
+			static bool Invoke(Handler& handler, const client_type& client, std::span<const uint8_t> body)
+			{
+				P payload;
+				if (!decode(body, payload))
+					return false;
+				handler.OnPayload(client, payload);
+				return true;
+			}
+
+			template <typename Handler>
+			static constexpr std::array<thunk<Handler>, nSlots> vTable = []()
+			{
+				std::array<thunk<Handler>, nSlots> vTable{};
+				((vTable[size_t(Payloads::id)] = &Invoke<Handler, Payloads>), ...);
+				return vTable;
+			}();
+
+		public:
+			// False if the ID has no payload or the body does not decode
+			template <typename Handler>
+			static bool dispatch(Handler& handler, const client_type& client, T id, std::span<const uint8_t> body)
+			{
+				const size_t nID = size_t(id);
+				if (nID >= nSlots || !vTable<Handler>[nID])
+					return false;
+				return vTable<Handler>[nID](handler, client, body);
+			}
+
+			template <typename Handler, typename Alloc, size_t nInlineBytes>
+			static bool dispatch(Handler& handler, const client_type& client, const message<T, Alloc, nInlineBytes>& msg)
+			{
+				return dispatch(handler, client, msg.header.id, std::span<const uint8_t>(msg.body.data(), msg.body.size()));
+			}
+
+			template <typename Handler>
+			static bool dispatch(Handler& handler, const client_type& client, const message_view<T>& msg)
+			{
+				return dispatch(handler, client, msg.header.id, msg.body);
+			}
+
+			// Either form of a queued message; see owned_message
+			template <typename Handler>
+			static bool dispatch(Handler& handler, const owned_message<T>& msg)
+			{
+				return msg.view.owner ? dispatch(handler, msg.remote, msg.view) : dispatch(handler, msg.remote, msg.msg);
+			}
+		};
+	}
+}
@@ -4,6 +4,11 @@
 #include "net_tsqueue.h"
 #include "net_message.h"
 #include "net_connection.h"
+#include "net_dispatch.h"
+#include "net_registry.h"
+#include "net_snapshot.h"
+
+#include <filesystem>
 
 namespace olc
 {
@@ -13,22 +18,133 @@ namespace olc
 		class server_interface
 		{
 		public:
-			server_interface(uint16_t port)
+			// How Update() runs OnMessage
+			enum class dispatch_mode
+			{
+				serial,   // on the thread calling Update(), in arrival order
+				parallel  // on a worker pool; in order per connection only
+			};
+
+			// How accepted connections are spread across the io contexts
+			enum class io_balance
+			{
+				round_robin,
+				least_loaded
+			};
+
+			// nIoThreads io contexts are created, each run by its own thread. A
+			// connection stays on the context it was accepted onto, so all of its
+			// handlers run on one thread and need no locking.
+			server_interface(uint16_t port, size_t nIoThreads = 1)
 				: m_asioAcceptor(m_asioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
 			{
+				// m_asioContext is context 0 and also runs the acceptor
+				m_vecContexts.push_back(&m_asioContext);
+				for (size_t i = 1; i < nIoThreads; i++)
+				{
+					m_vecExtraContexts.push_back(std::make_unique<asio::io_context>(1));
+					m_vecContexts.push_back(m_vecExtraContexts.back().get());
+				}
+
+				m_pContextLoad = std::make_unique<std::atomic<size_t>[]>(m_vecContexts.size());
+			}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+			// Listen only on a Unix domain socket at sPath, not on TCP
+			server_interface(const std::string& sPath, size_t nIoThreads = 1)
+				: m_asioAcceptor(m_asioContext)
+			{
+				m_vecContexts.push_back(&m_asioContext);
+				for (size_t i = 1; i < nIoThreads; i++)
+				{
+					m_vecExtraContexts.push_back(std::make_unique<asio::io_context>(1));
+					m_vecContexts.push_back(m_vecExtraContexts.back().get());
+				}
 
+				m_pContextLoad = std::make_unique<std::atomic<size_t>[]>(m_vecContexts.size());
+				ListenLocal(sPath);
 			}
+#endif
 
 			virtual ~server_interface()
 			{
 				Stop();
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+				if (m_pLocalAcceptor)
+				{
+					m_pLocalAcceptor->close();
+					std::error_code ec;
+					std::filesystem::remove(m_sLocalPath, ec);
+				}
+#endif
+
+				// Connections, and queued messages pointing at them, own sockets on
+				// the io contexts, which are destroyed before them
+				m_mapConnections.erase_if([](const std::shared_ptr<connection<T>>&) { return true; });
+				m_qMessagesIn.drain([](owned_message<T>&&) {});
 			}
 
 			bool Start()
 			{
 				try
 				{
-					WaitForClientConnection();
+					if (m_pDatagrams)
+					{
+						m_pDatagrams->SetSimulation(m_fSimulatedLoss, m_fSimulatedReorder, m_simulatedDelay);
+						m_pDatagrams->Start();
+					}
+
+					if (m_bShardedAcceptors && m_asioAcceptor.is_open())
+						OpenShardedAcceptors();
+
+#if defined(__linux__)
+					if (m_nIoBackend == io_backend::uring)
+						OpenRings();
+#endif
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+					if (m_pLocalAcceptor)
+					{
+						for (size_t i = 0; i < m_nAcceptsInFlight; i++)
+							WaitForLocalConnection();
+					}
+#endif
+
+#if defined(__linux__)
+					if (m_pShared)
+					{
+						m_bSharedStop = false;
+						m_threadShared = std::thread([this]() { AcceptShared(); });
+					}
+#endif
+
+#if defined(__linux__)
+					if (!m_vecUrings.empty())
+					{
+						// One multishot accept per listening socket
+						if (m_vecShardAcceptors.empty() && m_asioAcceptor.is_open())
+							AcceptThroughRing(0, m_asioAcceptor.native_handle(), false);
+						for (size_t nShard = 0; nShard < m_vecShardAcceptors.size(); nShard++)
+							AcceptThroughRing(nShard, m_vecShardAcceptors[nShard]->native_handle(), true);
+					}
+					else
+#endif
+					if (m_vecShardAcceptors.empty() && m_asioAcceptor.is_open())
+					{
+						for (size_t i = 0; i < m_nAcceptsInFlight; i++)
+							WaitForClientConnection();
+					}
+					else
+					{
+						for (size_t nShard = 0; nShard < m_vecShardAcceptors.size(); nShard++)
+							for (size_t i = 0; i < m_nAcceptsInFlight; i++)
+								WaitForShardConnection(nShard);
+					}
+
+					// Keep contexts without a pending accept alive until Stop()
+					for (auto* context : m_vecContexts)
+						m_vecWorkGuards.push_back(asio::make_work_guard(*context));
 
 					m_threadContext = std::thread([this]()
 					{
@@ -36,7 +152,13 @@ namespace olc
 						m_asioContext.run();
 					});
 
-
+					for (size_t i = 1; i < m_vecContexts.size(); i++)
+					{
+						m_vecIoThreads.emplace_back([this, i]()
+						{
+							m_vecContexts[i]->run();
+						});
+					}
 				}
 				catch (std::exception& e)
 				{
@@ -44,113 +166,737 @@ namespace olc
 					return false;
 				}
 
-				std::cout << "[SERVER] Started!\n";
+				std::cout << "[SERVER] Started with " << m_vecContexts.size() << " io thread(s)!\n";
 				return true;
 			}
 
 			void Stop()
 			{
-				m_asioContext.stop();
+				// Let handlers already running finish, and start no more
+				m_pDispatcher.reset();
+
+#if defined(__linux__)
+				if (m_threadShared.joinable())
+				{
+					m_bSharedStop = true;
+					shm_control& control = m_pShared->Control();
+					control.nAcceptEpoch.fetch_add(1, std::memory_order_release);
+					detail::ShmFutexWake(control.nAcceptEpoch);
+					m_threadShared.join();
+				}
+#endif
+
+				m_vecWorkGuards.clear();
+
+				for (auto* context : m_vecContexts)
+					context->stop();
 
 				if (m_threadContext.joinable()) m_threadContext.join();
 
+				for (auto& thread : m_vecIoThreads)
+					if (thread.joinable()) thread.join();
+				m_vecIoThreads.clear();
+
 				std::cout << "[SERVER] Stopped!\n";
 			}
 
+			// Outbound queue limits and policy given to every connection accepted
+			// from now on; see connection::SetBackpressure. 0 means no limit.
+			void SetBackpressure(backpressure_policy policy, size_t nMaxQueuedBytes, size_t nMaxQueuedMessages)
+			{
+				m_nBackpressurePolicy = policy;
+				m_nMaxQueuedBytes = nMaxQueuedBytes;
+				m_nMaxQueuedMessages = nMaxQueuedMessages;
+			}
+
+			// Receive mode given to every connection accepted from now on. In view
+			// mode messages reach OnMessageView() as views into the receive buffer
+			// rather than being copied out of it, and can be forwarded to other
+			// clients without a copy either.
+			void SetReceiveMode(receive_mode mode)
+			{
+				m_nReceiveMode = mode;
+			}
+
+			// Offer compact headers to clients accepted from now on; see
+			// connection::SetFraming
+			void SetFraming(framing mode)
+			{
+				m_nFraming = mode;
+			}
+
+			// Offer compression to clients accepted from now on; see
+			// connection::SetCompression
+			void SetCompression(size_t nMinBytes)
+			{
+				m_nCompressMin = nMinBytes;
+			}
+
+			// Start a delta-encoded snapshot stream; see net_snapshot.h. Each
+			// BroadcastSnapshot() then sends every client idSnapshot messages
+			// holding only what changed since the frame it last acknowledged,
+			// and acks arriving as idAck are consumed here rather than reaching
+			// OnMessage(). Clients get a keyframe at least every
+			// nKeyframeInterval frames, and whenever their baseline is more than
+			// nHistory frames old. Call before Start(): once the server runs, acks
+			// reach the channel from other threads, so this returns false and
+			// leaves it as it is.
+			bool EnableSnapshots(T idSnapshot, T idAck, uint32_t nKeyframeInterval = 60, size_t nHistory = 32)
+			{
+				if (m_threadContext.joinable())
+					return false;
+
+				m_pSnapshots = std::make_unique<snapshot_channel<T>>(idSnapshot, idAck, nKeyframeInterval, nHistory);
+				return true;
+			}
+
+			// Open a UDP socket on the server's port and offer clients accepted
+			// from now on a datagram channel for SendUnreliable() and
+			// SendDatagram(); see net_datagram.h and net_reliable.h. Call before
+			// Start().
+			bool EnableDatagrams()
+			{
+				// Datagrams share the TCP port
+				if (!m_asioAcceptor.is_open())
+					return false;
+
+				try
+				{
+					const asio::ip::udp::endpoint local(asio::ip::udp::v4(), m_asioAcceptor.local_endpoint().port());
+					m_pDatagrams = std::make_unique<datagram_socket<T>>(m_asioContext, local,
+						[this](uint64_t nToken, std::span<const uint8_t> data, const asio::ip::udp::endpoint& from)
+						{
+							RouteDatagram(nToken, data, from);
+						});
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "[SERVER] Datagram Exception: " << e.what() << std::endl;
+					return false;
+				}
+				return true;
+			}
+
+			// For testing: the datagram socket loses fLoss of what it sends, and
+			// delays fReorder of the rest by up to maxDelay. Call before Start().
+			void SetSimulatedLoss(double fLoss, double fReorder = 0.0, std::chrono::microseconds maxDelay = std::chrono::milliseconds(2))
+			{
+				m_fSimulatedLoss = fLoss;
+				m_fSimulatedReorder = fReorder;
+				m_simulatedDelay = maxDelay;
+			}
+
+			// Delivery of each datagram channel, and what carries Send(), for
+			// clients accepted from now on; see connection::SetChannel and
+			// connection::SetTransport
+			void SetChannel(uint8_t nChannel, delivery mode)
+			{
+				if (nChannel < nReliableChannels)
+					m_vChannels[nChannel] = mode;
+			}
+
+			void SetTransport(transport mode)
+			{
+				m_nTransport = mode;
+			}
+
+			// Drive TCP connections with epoll or io_uring; see net_uring.h. The
+			// default is epoll unless built with OLC_NET_IO_URING. Call before
+			// Start(), which falls back to epoll if the kernel lacks io_uring.
+			void SetIoBackend(io_backend backend)
+			{
+				m_nIoBackend = backend;
+			}
+
+			// The backend actually in use once started
+			io_backend GetIoBackend() const
+			{
+#if defined(__linux__)
+				if (!m_vecUrings.empty())
+					return io_backend::uring;
+#endif
+				return io_backend::epoll;
+			}
+
+			void SetIoBalance(io_balance balance)
+			{
+				m_nBalance = balance;
+			}
+
+			size_t GetIoThreadCount() const
+			{
+				return m_vecContexts.size();
+			}
+
+			// Listen with one SO_REUSEPORT acceptor per io context instead of a
+			// single shared one, each keeping nAcceptsInFlight accepts outstanding
+			// and handing its connections to its own context. The kernel spreads
+			// incoming connections across the acceptors. Must be called before
+			// Start(); where SO_REUSEPORT is unavailable the single acceptor is kept
+			// (still with nAcceptsInFlight accepts outstanding).
+			//
+			// OnClientConnect() may then be called from several io threads at once.
+			void EnableShardedAcceptors(size_t nAcceptsInFlight = 4)
+			{
+				m_bShardedAcceptors = true;
+				m_nAcceptsInFlight = std::max<size_t>(nAcceptsInFlight, 1);
+			}
+
+			// In parallel mode Update() only routes messages; OnMessage runs on
+			// nWorkers threads, concurrently for different connections but never
+			// for two messages from the same connection, which keep their order.
+			// Handlers must then be safe to run alongside each other. Call Stop()
+			// before the derived server is destroyed so no handler is left running.
+			// nMaxBacklog caps the messages one connection may have waiting for a
+			// worker, by default as many as the inbound queue holds; the rest are
+			// dropped. 0 explicitly opts out of the cap.
+			void SetDispatchMode(dispatch_mode mode, size_t nWorkers = std::thread::hardware_concurrency(), size_t nQuantum = 32, size_t nMaxBacklog = parallel_dispatcher<T>::nDefaultMaxBacklog)
+			{
+				m_pDispatcher.reset();
+				if (mode == dispatch_mode::parallel)
+				{
+					m_pDispatcher = std::make_unique<parallel_dispatcher<T>>(nWorkers,
+						[this](owned_message<T>& msg)
+						{
+							Deliver(msg);
+						}, nQuantum, nMaxBacklog);
+				}
+			}
+
 			// ASYNC
 			void WaitForClientConnection()
 			{
-				m_asioAcceptor.async_accept(
-					[this](std::error_code ec, asio::ip::tcp::socket socket)
+				// Accept straight onto the context that will own the connection
+				const size_t nContext = PickContext();
+
+				m_asioAcceptor.async_accept(*m_vecContexts[nContext],
+					[this, nContext](std::error_code ec, asio::ip::tcp::socket socket)
 					{
+						// Re-arm before doing anything slow with this connection
+						WaitForClientConnection();
+
 						if (!ec)
 						{
-							std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << std::endl;
+							AcceptConnection(std::move(socket), nContext);
+						}
+						else
+						{
+							std::cout << "[SERVER] New Connection Error: " << ec.message() << std::endl;
+						}
+					});
+			}
 
-							std::shared_ptr<connection<T>> newconn = 
-								std::make_shared<connection<T>>(connection<T>::owner::server,
-									m_asioContext, std::move(socket), m_qMessagesIn);
-							
-							if (OnClientConnect(newconn))
-							{
-								m_deqConnections.push_back(std::move(newconn));
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+			// Also accept clients on the same host through a Unix domain socket at
+			// sPath, which is replaced if it exists and removed when the server
+			// goes. They get the same handshake, framing and OnMessage() as TCP
+			// clients, but no datagram channel. Call before Start().
+			bool ListenLocal(const std::string& sPath)
+			{
+				try
+				{
+					std::error_code ec;
+					std::filesystem::remove(sPath, ec);
+					m_pLocalAcceptor = std::make_unique<asio::local::stream_protocol::acceptor>(m_asioContext, asio::local::stream_protocol::endpoint(sPath));
+					m_sLocalPath = sPath;
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "[SERVER] Local Socket Exception: " << e.what() << std::endl;
+					m_pLocalAcceptor.reset();
+					return false;
+				}
+				return true;
+			}
 
-								m_deqConnections.back()->ConnectToClient(this, nIDCounter++);
+			// ASYNC - the local acceptor, like the TCP one, accepts onto the
+			// context that will own the connection
+			void WaitForLocalConnection()
+			{
+				const size_t nContext = PickContext();
 
-								std::cout << "[" << m_deqConnections.back()->GetID() << "] Connection Approved" << std::endl;
-							}
-							else
-							{
-								std::cout << "[-----] Connection Denied" << std::endl;
-							}
+				m_pLocalAcceptor->async_accept(*m_vecContexts[nContext],
+					[this, nContext](std::error_code ec, asio::local::stream_protocol::socket socket)
+					{
+						WaitForLocalConnection();
+
+						if (!ec)
+						{
+							AcceptConnection(std::move(socket), nContext);
 						}
-						else
+						else if (m_pLocalAcceptor->is_open())
 						{
 							std::cout << "[SERVER] New Connection Error: " << ec.message() << std::endl;
 						}
-
-						WaitForClientConnection();
 					});
 			}
+#endif
 
-			void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg)
+#if defined(__linux__)
+			// Also accept clients on the same host through shared memory: see
+			// net_shm.h. /dev/shm/sName is made afresh with nSlots client slots,
+			// each with two rings of nRingBytes, and removed when the server
+			// goes. These clients get OnClientConnect(), OnMessage() and
+			// Send() like any other, but no handshake, framing, compression,
+			// backpressure policy or datagram channel. Call before Start().
+			bool ListenShared(const std::string& sName, uint32_t nSlots = 8, size_t nRingBytes = 1 << 20)
 			{
-				if (client && client->IsConnected())
+				try
 				{
-					client->Send(msg);
+					m_pShared = std::make_shared<shm_segment>(sName, nSlots, nRingBytes);
 				}
-				else
+				catch (std::exception& e)
 				{
-					OnClientDisconnect(client);
-					client.reset();
-					m_deqConnections.erase(
-						std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end());
+					std::cerr << "[SERVER] Shared Memory Exception: " << e.what() << std::endl;
+					return false;
 				}
+				return true;
 			}
 
-			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			// How long each shared memory client's reader spins before parking;
+			// longer costs CPU while idle but saves the peer a wake syscall. The
+			// default is 50us, or none on a single core.
+			void SetSharedSpin(std::chrono::nanoseconds spin)
 			{
-				bool bInvalidClientExists = false;
-				for (auto& client : m_deqConnections)
-				{
-					if (client && client->IsConnected())
+				m_sharedSpin = spin;
+			}
+#endif
+
+			// ASYNC - sharded acceptors accept onto their own context
+			void WaitForShardConnection(size_t nShard)
+			{
+				m_vecShardAcceptors[nShard]->async_accept(
+					[this, nShard](std::error_code ec, asio::ip::tcp::socket socket)
 					{
-						if (client != pIgnoreClient)
+						WaitForShardConnection(nShard);
+
+						if (!ec)
+						{
+							AcceptConnection(std::move(socket), nShard);
+						}
+						else
 						{
-							client->Send(msg);
+							std::cout << "[SERVER] New Connection Error: " << ec.message() << std::endl;
 						}
+					});
+			}
+
+			// The connection with this ID, or nullptr if there is none
+			std::shared_ptr<connection<T>> GetClient(uint32_t nID)
+			{
+				std::scoped_lock lock(m_muxConnections);
+				return m_mapConnections.find(nID);
+			}
+
+			// Returns false if the client is gone or its backpressure policy
+			// discarded the message
+			bool MessageClient(uint32_t nID, const message<T>& msg)
+			{
+				return MessageClient(GetClient(nID), msg);
+			}
+
+			bool MessageClient(uint32_t nID, message<T>&& msg)
+			{
+				return MessageClient(GetClient(nID), std::move(msg));
+			}
+
+			bool MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg)
+			{
+				return MessageClient(std::move(client), std::allocate_shared<message<T>>(pool_allocator<message<T>>(), msg));
+			}
+
+			// Takes over msg's body instead of copying it
+			bool MessageClient(std::shared_ptr<connection<T>> client, message<T>&& msg)
+			{
+				return MessageClient(std::move(client), std::allocate_shared<message<T>>(pool_allocator<message<T>>(), std::move(msg)));
+			}
+
+			bool MessageClient(std::shared_ptr<connection<T>> client, shared_message<T> msg)
+			{
+				return MessageClient(std::move(client), message_view<T>(std::move(msg)));
+			}
+
+			// Forwards a received view; the body is not copied
+			bool MessageClient(std::shared_ptr<connection<T>> client, const message_view<T>& msg)
+			{
+				if (client && client->IsConnected())
+				{
+					return client->Send(msg);
+				}
+				else if (client)
+				{
+					// Only the call that actually removes the client reports it
+					bool bRemoved = false;
+					{
+						std::scoped_lock lock(m_muxConnections);
+						bRemoved = m_mapConnections.erase(client->GetID());
 					}
-					else
+
+					if (bRemoved)
 					{
-						OnClientDisconnect(client); 
-						client.reset();
-						bInvalidClientExists = true;
+						OnClientDisconnect(client);
+						ReleaseContext(client);
 					}
 				}
+				return false;
+			}
+
+			// The message is copied once into a shared frame which every
+			// connection's outbound queue then references.
+			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			{
+				MessageAllClients(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), msg), std::move(pIgnoreClient));
+			}
+
+			// Moved rather than copied into the shared frame
+			void MessageAllClients(message<T>&& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			{
+				MessageAllClients(std::allocate_shared<message<T>>(pool_allocator<message<T>>(), std::move(msg)), std::move(pIgnoreClient));
+			}
+
+			void MessageAllClients(shared_message<T> frame, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			{
+				MessageAllClients(message_view<T>(std::move(frame)), std::move(pIgnoreClient));
+			}
 
-				if (bInvalidClientExists)
+			// Every connection's queue references the view's buffer; nothing is copied
+			void MessageAllClients(const message_view<T>& frame, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			{
+				for (auto& client : LiveClients())
 				{
-					m_deqConnections.erase(
-						std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr), m_deqConnections.end());
+					if (client != pIgnoreClient)
+						client->Send(frame);
 				}
 			}
 
+			// Publish state as the next snapshot frame and send each client its
+			// delta; returns the frame number, or 0 without EnableSnapshots()
+			uint32_t BroadcastSnapshot(std::span<const uint8_t> state)
+			{
+				if (!m_pSnapshots)
+					return 0;
+
+				const uint32_t nFrame = m_pSnapshots->Publish(state);
+
+				for (auto& client : LiveClients())
+					client->Send(m_pSnapshots->MessageFor(client->GetID()));
+				m_pSnapshots->Prune();
+				return nFrame;
+			}
+
+			// Send this client the full state in the next snapshot
+			void RequestKeyframe(uint32_t nID)
+			{
+				if (m_pSnapshots)
+					m_pSnapshots->RequestKeyframe(nID);
+			}
+
 			void Update(size_t nMaxMessages = -1, bool bWait = false)
 			{
 
 				if (bWait) m_qMessagesIn.wait();
 
-				size_t nMessageCount = 0;
-				while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty())
+				// Take everything that is ready in one pass over the ring
+				if (m_pDispatcher)
+				{
+					m_qMessagesIn.drain([this](owned_message<T>&& msg)
+						{
+							m_pDispatcher->Dispatch(std::move(msg));
+						}, nMaxMessages);
+				}
+				else
 				{
-					auto msg = m_qMessagesIn.pop_front();
+					m_qMessagesIn.drain([this](owned_message<T>&& msg)
+						{
+							Deliver(msg);
+						}, nMaxMessages);
+				}
+			}
+		
+		private:
+			// The connected clients, copied out of the registry so they can be sent
+			// to without holding its lock: under the block policy Send() may wait,
+			// and OnBackpressure() may look clients up itself. The dead are removed
+			// in the same pass and reported once the lock is released, so
+			// OnClientDisconnect() may message clients too.
+			std::vector<std::shared_ptr<connection<T>>> LiveClients()
+			{
+				std::vector<std::shared_ptr<connection<T>>> vecLive;
+				std::vector<std::shared_ptr<connection<T>>> vecDeadClients;
+				{
+					std::scoped_lock lock(m_muxConnections);
+					vecLive.reserve(m_mapConnections.size());
+					m_mapConnections.erase_if([&](std::shared_ptr<connection<T>>& client)
+						{
+							if (client->IsConnected())
+							{
+								vecLive.push_back(client);
+								return false;
+							}
+
+							vecDeadClients.push_back(client);
+							return true;
+						});
+				}
+
+				for (auto& client : vecDeadClients)
+				{
+					OnClientDisconnect(client);
+					ReleaseContext(client);
+				}
+				return vecLive;
+			}
 
+			void Deliver(owned_message<T>& msg)
+			{
+				if (m_pSnapshots)
+				{
+					const bool bView = msg.view.owner != nullptr;
+					if ((bView ? msg.view.header.id : msg.msg.header.id) == m_pSnapshots->GetAckID())
+					{
+						m_pSnapshots->Acknowledge(msg.remote->GetID(),
+							bView ? msg.view.body : std::span<const uint8_t>(msg.msg.body.data(), msg.msg.body.size()));
+						return;
+					}
+				}
+
+				if (msg.view.owner)
+					OnMessageView(msg.remote, msg.view);
+				else
 					OnMessage(msg.remote, msg.msg);
+			}
+
+			void AcceptConnection(stream_socket socket, size_t nContext)
+			{
+				std::shared_ptr<connection<T>> newconn = 
+					std::make_shared<connection<T>>(connection<T>::owner::server,
+						*m_vecContexts[nContext], std::move(socket), m_qMessagesIn);
+				AdmitConnection(newconn, nContext);
+			}
 
-					nMessageCount++;
+#if defined(__linux__)
+			// A ring per io context, or none if the kernel can't provide them
+			void OpenRings()
+			{
+				try
+				{
+					for (auto* context : m_vecContexts)
+						m_vecUrings.push_back(std::make_unique<uring_context>(*context));
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "[SERVER] io_uring unavailable, using epoll: " << e.what() << std::endl;
+					m_vecUrings.clear();
 				}
 			}
-		
+
+			// A sharded listener's clients stay on its own context
+			void AcceptThroughRing(size_t nRing, int fdListen, bool bSharded)
+			{
+				auto acceptor = std::make_shared<uring_acceptor>(*m_vecUrings[nRing], fdListen,
+					[this, nRing, bSharded](int fd)
+					{
+						const size_t nContext = bSharded ? nRing : PickContext();
+						std::shared_ptr<connection<T>> newconn =
+							std::make_shared<connection<T>>(connection<T>::owner::server,
+								*m_vecContexts[nContext], stream_socket(*m_vecContexts[nContext]), m_qMessagesIn);
+						newconn->AttachUring(std::make_shared<uring_stream>(*m_vecUrings[nContext], fd));
+						AdmitConnection(newconn, nContext);
+					});
+				acceptor->Start();
+			}
+#endif
+
+			void AdmitConnection(std::shared_ptr<connection<T>> newconn, size_t nContext)
+			{
+				newconn->SetBackpressure(m_nBackpressurePolicy, m_nMaxQueuedBytes, m_nMaxQueuedMessages);
+				newconn->SetReceiveMode(m_nReceiveMode);
+				newconn->SetFraming(m_nFraming);
+				newconn->SetCompression(m_nCompressMin);
+				newconn->SetTransport(m_nTransport);
+				for (uint8_t nChannel = 0; nChannel < nReliableChannels; nChannel++)
+					newconn->SetChannel(nChannel, m_vChannels[nChannel]);
+				if (m_pDatagrams && newconn->IsNetworked())
+					newconn->SetDatagramSocket(m_pDatagrams.get(), NewDatagramToken(newconn));
+
+				if (OnClientConnect(newconn))
+				{
+					m_pContextLoad[nContext].fetch_add(1, std::memory_order_relaxed);
+
+					const uint32_t nID = nIDCounter++;
+					{
+						std::scoped_lock lock(m_muxConnections);
+						m_mapConnections.insert(nID, newconn);
+					}
+
+					newconn->ConnectToClient(this, nID);
+
+					std::cout << "[" << nID << "] Connection Approved\n";
+				}
+				else
+				{
+					std::cout << "[-----] Connection Denied\n";
+				}
+			}
+
+#if defined(__linux__)
+			// Shared memory acceptor thread: claimed slots bump the accept epoch
+			void AcceptShared()
+			{
+				shm_control& control = m_pShared->Control();
+				while (!m_bSharedStop)
+				{
+					const uint32_t nKey = control.nAcceptEpoch.load(std::memory_order_acquire);
+					for (uint32_t i = 0; i < m_pShared->SlotCount(); i++)
+					{
+						shm_slot* pSlot = m_pShared->Slot(i);
+						const uint32_t nState = pSlot->nState.load(std::memory_order_acquire);
+						if (nState == shm_claimed)
+							AcceptSharedSlot(i);
+						else if (nState == shm_refused && !detail::ShmPidAlive(pSlot->nClientPid.load(std::memory_order_relaxed)))
+							m_pShared->Recycle(i); // refused, but the client died before taking it back
+					}
+					detail::ShmFutexWait(control.nAcceptEpoch, nKey, std::chrono::milliseconds(100));
+				}
+			}
+
+			void AcceptSharedSlot(uint32_t nSlot)
+			{
+				// Its socket is never opened; the context only anchors it
+				std::shared_ptr<connection<T>> newconn =
+					std::make_shared<connection<T>>(connection<T>::owner::server,
+						m_asioContext, stream_socket(m_asioContext), m_qMessagesIn);
+				newconn->SetBackpressure(m_nBackpressurePolicy, m_nMaxQueuedBytes, m_nMaxQueuedMessages);
+
+				shm_slot* pSlot = m_pShared->Slot(nSlot);
+				const bool bAccept = OnClientConnect(newconn);
+				uint32_t nClaimed = shm_claimed;
+				if (!pSlot->nState.compare_exchange_strong(nClaimed, bAccept ? shm_accepted : shm_refused, std::memory_order_acq_rel))
+				{
+					// The client stopped waiting, so the slot is ours to free
+					m_pShared->Recycle(nSlot);
+					std::cout << "[-----] Connection Abandoned\n";
+					return;
+				}
+				detail::ShmFutexWake(pSlot->nState);
+
+				if (bAccept)
+				{
+					m_pContextLoad[0].fetch_add(1, std::memory_order_relaxed);
+
+					const uint32_t nID = nIDCounter++;
+					{
+						std::scoped_lock lock(m_muxConnections);
+						m_mapConnections.insert(nID, newconn);
+					}
+
+					auto link = std::make_shared<shm_link<T>>(m_pShared, nSlot, true);
+					link->SetSpin(m_sharedSpin);
+					newconn->AttachShared(std::move(link), this, nID);
+					OnClientValidated(newconn);
+
+					std::cout << "[" << nID << "] Connection Approved\n";
+				}
+				else
+				{
+					std::cout << "[-----] Connection Denied\n";
+				}
+			}
+#endif
+
+			// A fresh random token for client, which then owns it until it is gone
+			uint64_t NewDatagramToken(const std::shared_ptr<connection<T>>& client)
+			{
+				std::scoped_lock lock(m_muxDatagramPeers);
+
+				// Tokens of clients that have gone are reclaimed in batches
+				if (m_mapDatagramPeers.size() >= m_nDatagramSweep)
+				{
+					std::erase_if(m_mapDatagramPeers, [](const auto& item) { return item.second.expired(); });
+					m_nDatagramSweep = std::max<size_t>(64, m_mapDatagramPeers.size() * 2);
+				}
+
+				while (true)
+				{
+					const uint64_t nToken = m_rngTokens() & 0x00FFFFFFFFFFFFFFull;
+					if (nToken && m_mapDatagramPeers.emplace(nToken, client).second)
+						return nToken;
+				}
+			}
+
+			void RouteDatagram(uint64_t nToken, std::span<const uint8_t> data, const asio::ip::udp::endpoint& from)
+			{
+				std::shared_ptr<connection<T>> client;
+				{
+					std::scoped_lock lock(m_muxDatagramPeers);
+					auto it = m_mapDatagramPeers.find(nToken);
+					if (it == m_mapDatagramPeers.end())
+						return;
+
+					client = it->second.lock();
+					if (!client)
+						m_mapDatagramPeers.erase(it);
+				}
+
+				if (client && client->IsConnected())
+					client->ReceiveDatagram(data, from);
+			}
+
+			void OpenShardedAcceptors()
+			{
+#ifdef SO_REUSEPORT
+				using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+				// Every listener, including the one opened in the constructor, has
+				// to set SO_REUSEPORT before binding, so start again from scratch
+				const asio::ip::tcp::endpoint endpoint = m_asioAcceptor.local_endpoint();
+				m_asioAcceptor.close();
+
+				for (auto* context : m_vecContexts)
+				{
+					auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(*context);
+					acceptor->open(endpoint.protocol());
+					acceptor->set_option(asio::socket_base::reuse_address(true));
+					acceptor->set_option(reuse_port(true));
+					acceptor->bind(endpoint);
+					acceptor->listen(asio::socket_base::max_listen_connections);
+					m_vecShardAcceptors.push_back(std::move(acceptor));
+				}
+#endif
+			}
+
+			size_t PickContext()
+			{
+				if (m_vecContexts.size() == 1)
+					return 0;
+
+				if (m_nBalance == io_balance::round_robin)
+					return m_nNextContext++ % m_vecContexts.size();
+
+				size_t nBest = 0;
+				for (size_t i = 1; i < m_vecContexts.size(); i++)
+				{
+					if (m_pContextLoad[i].load(std::memory_order_relaxed) < m_pContextLoad[nBest].load(std::memory_order_relaxed))
+						nBest = i;
+				}
+				return nBest;
+			}
+
+			void ReleaseContext(const std::shared_ptr<connection<T>>& client)
+			{
+				if (!client)
+					return;
+
+				for (size_t i = 0; i < m_vecContexts.size(); i++)
+				{
+					if (&client->GetContext() == m_vecContexts[i])
+					{
+						m_pContextLoad[i].fetch_sub(1, std::memory_order_relaxed);
+						break;
+					}
+				}
+			}
+
 		protected:
 			virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
 			{
@@ -167,28 +913,112 @@ namespace olc
 
 			}
 
+			// Receives messages in view mode. Copying msg keeps its body alive
+			// beyond the call; the default hands OnMessage() a copy.
+			virtual void OnMessageView(std::shared_ptr<connection<T>> client, const message_view<T>& msg)
+			{
+				OnMessage(client, msg.to_message());
+			}
+
 		public:
 			virtual void OnClientValidated(std::shared_ptr<connection<T>> client)
 			{
 
 			}
 
+			// Called when a client's outbound queue crosses a high-water mark, on
+			// whichever thread was sending; not again until the queue has drained
+			// to half. nAction is what became of the message that crossed it:
+			// drop_new if it was discarded, disconnect if the client is being
+			// closed, drop_oldest or coalesce if it was queued and older messages
+			// will make room, and block if the sender is about to wait for room.
+			virtual void OnBackpressure(std::shared_ptr<connection<T>> client, backpressure_policy nAction)
+			{
+
+			}
+
 		protected:
 			// thread safe queue forr incoming message packets from clients
-			tsqueue<owned_message<T>> m_qMessagesIn;
+			incoming_queue<T> m_qMessagesIn;
 
-			//container of active valid connections
-			std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+			// active valid connections, by ID
+			connection_registry<T> m_mapConnections;
 
 			// context and thread for asio
 			asio::io_context m_asioContext;
 			std::thread m_threadContext;
 
+			// io contexts beyond the first, and the threads that run them
+			std::vector<std::unique_ptr<asio::io_context>> m_vecExtraContexts;
+			std::vector<std::thread> m_vecIoThreads;
+
+			// every io context, m_asioContext first, with its connection count
+			std::vector<asio::io_context*> m_vecContexts;
+			std::unique_ptr<std::atomic<size_t>[]> m_pContextLoad;
+			std::vector<asio::executor_work_guard<asio::io_context::executor_type>> m_vecWorkGuards;
+			io_balance m_nBalance = io_balance::round_robin;
+			size_t m_nNextContext = 0;
+			io_backend m_nIoBackend = default_io_backend;
+#if defined(__linux__)
+			// an io_uring per io context, if that backend is in use; declared
+			// after the contexts so they are destroyed first
+			std::vector<std::unique_ptr<uring_context>> m_vecUrings;
+#endif
+
 			// needed for asio context
 			asio::ip::tcp::acceptor m_asioAcceptor;
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+			// Unix domain socket listener, if enabled
+			std::unique_ptr<asio::local::stream_protocol::acceptor> m_pLocalAcceptor;
+			std::string m_sLocalPath;
+#endif
+
+#if defined(__linux__)
+			// shared memory segment, if enabled, and the thread accepting on it
+			std::shared_ptr<shm_segment> m_pShared;
+			std::thread m_threadShared;
+			std::atomic<bool> m_bSharedStop = false;
+			std::chrono::nanoseconds m_sharedSpin = shm_default_spin();
+#endif
+
+			// UDP socket for datagram channels, if enabled, and each channel's
+			// connection by token
+			std::unique_ptr<datagram_socket<T>> m_pDatagrams;
+			std::unordered_map<uint64_t, std::weak_ptr<connection<T>>> m_mapDatagramPeers;
+			std::mutex m_muxDatagramPeers;
+			std::mt19937_64 m_rngTokens{ std::random_device{}() };
+			size_t m_nDatagramSweep = 64;
+			double m_fSimulatedLoss = 0.0;
+			double m_fSimulatedReorder = 0.0;
+			std::chrono::microseconds m_simulatedDelay{ 0 };
+			channel_modes m_vChannels = default_channels();
+			transport m_nTransport = transport::stream;
+
+			// one SO_REUSEPORT acceptor per io context, if sharding is enabled
+			std::vector<std::unique_ptr<asio::ip::tcp::acceptor>> m_vecShardAcceptors;
+			bool m_bShardedAcceptors = false;
+			size_t m_nAcceptsInFlight = 1;
+
+			// guards m_mapConnections, which acceptors on any io thread add to
+			std::mutex m_muxConnections;
+
+			// outbound limits handed to new connections
+			backpressure_policy m_nBackpressurePolicy = backpressure_policy::disconnect;
+			size_t m_nMaxQueuedBytes = 0;
+			size_t m_nMaxQueuedMessages = 0;
+			receive_mode m_nReceiveMode = receive_mode::copy;
+			framing m_nFraming = framing::fixed;
+			size_t m_nCompressMin = 0;
+
+			// delta snapshot stream, if EnableSnapshots() was called
+			std::unique_ptr<snapshot_channel<T>> m_pSnapshots;
+
+			// worker pool running OnMessage in parallel mode, null in serial mode
+			std::unique_ptr<parallel_dispatcher<T>> m_pDispatcher;
+
 			// unique ID counter for clients
-			uint32_t nIDCounter = 10000;
+			std::atomic<uint32_t> nIDCounter = 10000;
 		};
 	}
 }
\ No newline at end of file
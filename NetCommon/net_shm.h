@@ -0,0 +1,592 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_eventcount.h"
+
+// Shared memory transport for processes on the same Linux host.
+//
+// A server that calls ListenShared(name) creates /dev/shm/name holding a
+// fixed number of client slots. Each slot is a pair of single-producer,
+// single-consumer byte rings, one each way, carrying whole frames:
+//
+//     uint32_t nLength        header and body bytes
+//     message_header<T>       as in memory, size = body bytes
+//     uint8_t  body[size]
+//     padding to 8 bytes
+//
+// A client claims a free slot, wakes the server's accept thread and waits
+// for OnClientConnect() to accept or refuse it. After that each side has a
+// reader thread per slot that spins on its inbound ring for a while (see
+// SetSharedSpin) and then parks on a futex in the ring. A sender issues
+// the wake syscall only when it sees the reader parked, so a busy link
+// makes no syscalls at all. A sender whose ring is full waits for the
+// reader to catch up.
+//
+// Frames go straight into the ring from the thread calling Send(): there
+// is no framing negotiation, compression, backpressure policy or datagram
+// channel here. A side that goes away sets its bit in the slot's closed
+// word; a client that dies without doing so is noticed by its pid. The
+// slot is reused once both sides have let go of it.
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <functional>
+#include <string>
+
+namespace olc
+{
+	namespace net
+	{
+		namespace detail
+		{
+			// Shared, not private, futexes: the word is mapped by two processes
+			inline void ShmFutexWait(std::atomic<uint32_t>& word, uint32_t nExpected, std::chrono::milliseconds timeout)
+			{
+				timespec ts{ time_t(timeout.count() / 1000), long(timeout.count() % 1000) * 1000000 };
+				::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, nExpected, &ts, nullptr, 0);
+			}
+
+			inline void ShmFutexWake(std::atomic<uint32_t>& word)
+			{
+				::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+			}
+
+			// False only once the process is known to be gone; 0 means not yet set
+			inline bool ShmPidAlive(int32_t nPid)
+			{
+				return nPid <= 0 || ::kill(nPid, 0) == 0 || errno != ESRCH;
+			}
+		}
+
+		static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+			"shared memory rings need address-free atomics");
+
+		// One direction of a slot; the bytes follow elsewhere in the segment
+		struct shm_ring
+		{
+			alignas(64) std::atomic<uint64_t> nHead;  // bytes written, by the sender
+			alignas(64) std::atomic<uint64_t> nTail;  // bytes read, by the reader
+			alignas(64) std::atomic<uint32_t> nEpoch; // bumped to wake a parked reader
+			std::atomic<uint32_t> nParked;
+		};
+
+		enum shm_state : uint32_t
+		{
+			shm_free,
+			shm_claimed,
+			shm_accepted,
+			shm_refused,
+			shm_abandoned // the client gave up waiting before the server answered
+		};
+
+		enum shm_closed : uint32_t
+		{
+			shm_closed_client = 1,
+			shm_closed_server = 2
+		};
+
+		struct shm_slot
+		{
+			alignas(64) std::atomic<uint32_t> nState;
+			std::atomic<uint32_t> nClosed;
+			std::atomic<int32_t> nClientPid;
+			shm_ring vRings[2]; // client to server, server to client
+		};
+
+		struct shm_control
+		{
+			uint64_t nMagic;
+			uint32_t nSlots;
+			uint32_t nRingBytes;
+			alignas(64) std::atomic<uint32_t> nAcceptEpoch;
+			std::atomic<int32_t> nServerPid;
+		};
+
+		// A mapping of a /dev/shm segment, made by the server or opened by a
+		// client. Throws if it can't be.
+		class shm_segment
+		{
+		public:
+			static constexpr uint64_t nMagic = 0x314D485354454E4Full; // "ONETSHM1"
+
+			// Server: create name afresh, with nSlots slots of two rings of
+			// nRingBytes (rounded up to a power of two) each
+			shm_segment(const std::string& sName, uint32_t nSlots, size_t nRingBytes)
+				: m_sName(sName), m_bOwner(true)
+			{
+				size_t nRing = 4096;
+				while (nRing < nRingBytes)
+					nRing <<= 1;
+
+				::shm_unlink(sName.c_str());
+				const int fd = ::shm_open(sName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+				if (fd < 0)
+					throw std::runtime_error("shm_open " + sName + ": " + std::strerror(errno));
+
+				m_nBytes = Layout(nSlots, nRing);
+				if (::ftruncate(fd, off_t(m_nBytes)) != 0)
+				{
+					::close(fd);
+					::shm_unlink(sName.c_str());
+					throw std::runtime_error("ftruncate " + sName + ": " + std::strerror(errno));
+				}
+				Map(fd);
+
+				shm_control* pControl = ::new (m_pBase) shm_control{ 0, nSlots, uint32_t(nRing), {}, {} };
+				pControl->nServerPid.store(int32_t(::getpid()), std::memory_order_relaxed);
+				for (uint32_t i = 0; i < nSlots; i++)
+					::new (Slot(i)) shm_slot{};
+				std::atomic_thread_fence(std::memory_order_release);
+				pControl->nMagic = nMagic;
+			}
+
+			// Client: open a server's segment
+			explicit shm_segment(const std::string& sName)
+				: m_sName(sName), m_bOwner(false)
+			{
+				const int fd = ::shm_open(sName.c_str(), O_RDWR, 0);
+				if (fd < 0)
+					throw std::runtime_error("shm_open " + sName + ": " + std::strerror(errno));
+
+				struct stat st;
+				if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(shm_control))
+				{
+					::close(fd);
+					throw std::runtime_error("shm segment " + sName + " is not ready");
+				}
+				m_nBytes = size_t(st.st_size);
+				Map(fd);
+
+				const shm_control& control = Control();
+				if (control.nMagic != nMagic || Layout(control.nSlots, control.nRingBytes) != m_nBytes)
+				{
+					::munmap(m_pBase, m_nBytes);
+					throw std::runtime_error("shm segment " + sName + " is not an olc::net segment");
+				}
+			}
+
+			shm_segment(const shm_segment&) = delete;
+			shm_segment& operator=(const shm_segment&) = delete;
+
+			~shm_segment()
+			{
+				::munmap(m_pBase, m_nBytes);
+				if (m_bOwner)
+					::shm_unlink(m_sName.c_str());
+			}
+
+			shm_control& Control()
+			{
+				return *reinterpret_cast<shm_control*>(m_pBase);
+			}
+
+			uint32_t SlotCount()
+			{
+				return Control().nSlots;
+			}
+
+			size_t RingBytes()
+			{
+				return Control().nRingBytes;
+			}
+
+			shm_slot* Slot(uint32_t nSlot)
+			{
+				return reinterpret_cast<shm_slot*>(m_pBase + ControlBytes() + size_t(nSlot) * sizeof(shm_slot));
+			}
+
+			uint8_t* RingData(uint32_t nSlot, int nDirection)
+			{
+				const shm_control& control = Control();
+				return m_pBase + ControlBytes() + size_t(control.nSlots) * sizeof(shm_slot)
+					+ (size_t(nSlot) * 2 + size_t(nDirection)) * control.nRingBytes;
+			}
+
+			// Empty a slot's rings and offer it to the next client
+			void Recycle(uint32_t nSlot)
+			{
+				shm_slot* pSlot = Slot(nSlot);
+				for (shm_ring& ring : pSlot->vRings)
+				{
+					ring.nHead.store(0, std::memory_order_relaxed);
+					ring.nTail.store(0, std::memory_order_relaxed);
+					ring.nParked.store(0, std::memory_order_relaxed);
+				}
+				pSlot->nClientPid.store(0, std::memory_order_relaxed);
+				pSlot->nClosed.store(0, std::memory_order_relaxed);
+				pSlot->nState.store(shm_free, std::memory_order_release);
+			}
+
+		private:
+			static constexpr size_t ControlBytes()
+			{
+				return (sizeof(shm_control) + 63) & ~size_t(63);
+			}
+
+			static size_t Layout(uint32_t nSlots, size_t nRingBytes)
+			{
+				return ControlBytes() + size_t(nSlots) * (sizeof(shm_slot) + 2 * nRingBytes);
+			}
+
+			void Map(int fd)
+			{
+				void* p = ::mmap(nullptr, m_nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				::close(fd);
+				if (p == MAP_FAILED)
+				{
+					if (m_bOwner)
+						::shm_unlink(m_sName.c_str());
+					throw std::runtime_error("mmap " + m_sName + ": " + std::strerror(errno));
+				}
+				m_pBase = static_cast<uint8_t*>(p);
+			}
+
+		private:
+			std::string m_sName;
+			bool m_bOwner;
+			uint8_t* m_pBase = nullptr;
+			size_t m_nBytes = 0;
+		};
+
+		// Spinning only pays when the peer has a core of its own to run on
+		inline std::chrono::nanoseconds shm_default_spin()
+		{
+			return std::thread::hardware_concurrency() > 1 ? std::chrono::microseconds(50) : std::chrono::microseconds(0);
+		}
+
+		// How long a send may wait for room in a full ring before the
+		// connection's backpressure policy is applied; a healthy peer drains it
+		// far sooner
+		inline constexpr std::chrono::milliseconds shm_send_timeout{ 100 };
+
+		// One side of a slot: sends into one ring, and a reader thread passes
+		// what arrives on the other to deliver
+		template <typename T>
+		class shm_link : public std::enable_shared_from_this<shm_link<T>>
+		{
+		public:
+			using deliver_type = std::function<void(message<T>&&)>;
+
+			shm_link(std::shared_ptr<shm_segment> pSegment, uint32_t nSlot, bool bServer)
+				: m_pSegment(std::move(pSegment)), m_nSlot(nSlot), m_bServer(bServer)
+			{
+				m_pSlot = m_pSegment->Slot(nSlot);
+				m_nRingBytes = m_pSegment->RingBytes();
+				const int nOut = bServer ? 1 : 0;
+				m_pOut = &m_pSlot->vRings[nOut];
+				m_pIn = &m_pSlot->vRings[1 - nOut];
+				m_pOutData = m_pSegment->RingData(nSlot, nOut);
+				m_pInData = m_pSegment->RingData(nSlot, 1 - nOut);
+			}
+
+			shm_link(const shm_link&) = delete;
+			shm_link& operator=(const shm_link&) = delete;
+
+			~shm_link()
+			{
+				Close();
+			}
+
+			// How long the reader spins on an empty ring before parking. Set
+			// before Start().
+			void SetSpin(std::chrono::nanoseconds spin)
+			{
+				m_spin = spin;
+			}
+
+			void Start(deliver_type deliver)
+			{
+				m_deliver = std::move(deliver);
+				m_thread = std::thread([self = this->shared_from_this()]() { self->ReadLoop(); });
+			}
+
+			bool IsOpen() const
+			{
+				return !m_bClosing.load(std::memory_order_acquire) && !m_bPeerGone.load(std::memory_order_acquire)
+					&& (m_pSlot->nClosed.load(std::memory_order_acquire) & PeerBit()) == 0;
+			}
+
+			// True once this side is closing; the reader gives up waiting on a
+			// full incoming queue
+			bool IsClosing() const
+			{
+				return m_bClosing.load(std::memory_order_acquire);
+			}
+
+			// Bytes sent but not yet taken by the peer, and the most there can be
+			size_t GetQueuedBytes() const
+			{
+				return size_t(m_pOut->nHead.load(std::memory_order_relaxed) - m_pOut->nTail.load(std::memory_order_relaxed));
+			}
+
+			size_t GetCapacity() const
+			{
+				return m_nRingBytes;
+			}
+
+			// From any thread; false if the link is closed, the frame would not
+			// fit in the ring even when empty, or there was no room for it within
+			// maxWait of spinning. nMaxBytes, if not 0, caps how much of the ring
+			// may be in use, though an empty ring always takes one frame.
+			bool Send(const message_view<T>& msg, size_t nMaxBytes = 0, std::chrono::nanoseconds maxWait = std::chrono::nanoseconds(0))
+			{
+				message_header<T> header = msg.header;
+				header.size = uint32_t(msg.body.size());
+				const uint32_t nLength = uint32_t(sizeof(header) + msg.body.size());
+				const uint64_t nFrame = (sizeof(nLength) + nLength + 7) & ~uint64_t(7);
+				if (nFrame > m_nRingBytes)
+					return false;
+
+				std::scoped_lock lock(m_muxSend);
+				const uint64_t nHead = m_pOut->nHead.load(std::memory_order_relaxed);
+				const auto Full = [&]()
+				{
+					const uint64_t nUsed = nHead - m_pOut->nTail.load(std::memory_order_acquire);
+					return nUsed + nFrame > m_nRingBytes || (nMaxBytes && nUsed && nUsed + nFrame > nMaxBytes);
+				};
+
+				// A peer that has stopped reading must not hold the sender for ever
+				std::chrono::steady_clock::time_point tGiveUp;
+				for (uint32_t nSpins = 0; Full(); nSpins++)
+				{
+					if (!IsOpen())
+						return false;
+					if (nSpins < 1024)
+					{
+						cpu_relax();
+						continue;
+					}
+
+					const auto tNow = std::chrono::steady_clock::now();
+					if (nSpins == 1024)
+						tGiveUp = tNow + maxWait;
+					else if (tNow >= tGiveUp)
+						return false;
+					std::this_thread::yield();
+				}
+
+				Write(nHead, &nLength, sizeof(nLength));
+				Write(nHead + sizeof(nLength), &header, sizeof(header));
+				Write(nHead + sizeof(nLength) + sizeof(header), msg.body.data(), msg.body.size());
+				m_pOut->nHead.store(nHead + nFrame, std::memory_order_release);
+
+				// Pairs with the reader's fence between parking and its last look
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_pOut->nParked.load(std::memory_order_relaxed))
+					Wake(*m_pOut);
+				return true;
+			}
+
+			// Stop reading and tell the peer. The last side to let go, or the
+			// server if its client died, frees the slot.
+			void Close()
+			{
+				if (m_bClosing.exchange(true, std::memory_order_acq_rel))
+					return;
+
+				const uint32_t nBefore = m_pSlot->nClosed.fetch_or(MyBit(), std::memory_order_acq_rel);
+				Wake(*m_pOut);
+				Wake(*m_pIn);
+
+				// The reader may be the one letting go of the last reference
+				if (m_thread.joinable())
+				{
+					if (m_thread.get_id() == std::this_thread::get_id())
+						m_thread.detach();
+					else
+						m_thread.join();
+				}
+
+				if ((nBefore & PeerBit()) || (m_bServer && !PeerAlive()))
+					m_pSegment->Recycle(m_nSlot);
+			}
+
+		private:
+			uint32_t MyBit() const
+			{
+				return m_bServer ? shm_closed_server : shm_closed_client;
+			}
+
+			uint32_t PeerBit() const
+			{
+				return m_bServer ? shm_closed_client : shm_closed_server;
+			}
+
+			static void Wake(shm_ring& ring)
+			{
+				ring.nEpoch.fetch_add(1, std::memory_order_release);
+				detail::ShmFutexWake(ring.nEpoch);
+			}
+
+			void Write(uint64_t nPos, const void* pData, size_t nBytes)
+			{
+				const size_t nAt = size_t(nPos & (m_nRingBytes - 1));
+				const size_t nFirst = std::min(nBytes, m_nRingBytes - nAt);
+				std::memcpy(m_pOutData + nAt, pData, nFirst);
+				std::memcpy(m_pOutData, static_cast<const uint8_t*>(pData) + nFirst, nBytes - nFirst);
+			}
+
+			void Read(uint64_t nPos, void* pData, size_t nBytes)
+			{
+				const size_t nAt = size_t(nPos & (m_nRingBytes - 1));
+				const size_t nFirst = std::min(nBytes, m_nRingBytes - nAt);
+				std::memcpy(pData, m_pInData + nAt, nFirst);
+				std::memcpy(static_cast<uint8_t*>(pData) + nFirst, m_pInData, nBytes - nFirst);
+			}
+
+			bool HasFrame() const
+			{
+				return m_pIn->nHead.load(std::memory_order_acquire) != m_nTail;
+			}
+
+			// Take every whole frame in the ring; false if the peer wrote garbage.
+			// The head comes from the peer, so nothing may be read past what
+			// the ring can hold.
+			bool ReadFrames()
+			{
+				const uint64_t nHead = m_pIn->nHead.load(std::memory_order_acquire);
+				if (nHead - m_nTail > m_nRingBytes)
+					return false;
+				while (m_nTail != nHead)
+				{
+					uint32_t nLength;
+					Read(m_nTail, &nLength, sizeof(nLength));
+					const uint64_t nFrame = (sizeof(nLength) + uint64_t(nLength) + 7) & ~uint64_t(7);
+					if (nLength < sizeof(message_header<T>) || nFrame > nHead - m_nTail || nFrame > m_nRingBytes)
+						return false;
+
+					message<T> msg;
+					Read(m_nTail + sizeof(nLength), &msg.header, sizeof(msg.header));
+					if (msg.header.size != nLength - sizeof(msg.header))
+						return false;
+					msg.body.resize(msg.header.size);
+					Read(m_nTail + sizeof(nLength) + sizeof(msg.header), msg.body.data(), msg.header.size);
+
+					m_nTail += nFrame;
+					m_pIn->nTail.store(m_nTail, std::memory_order_release);
+					m_deliver(std::move(msg));
+				}
+				return true;
+			}
+
+			// A peer that died without closing leaves its pid behind
+			bool PeerAlive() const
+			{
+				if (m_pSlot->nClosed.load(std::memory_order_acquire) & PeerBit())
+					return false;
+				const int32_t nPid = m_bServer ? m_pSlot->nClientPid.load(std::memory_order_relaxed)
+					: m_pSegment->Control().nServerPid.load(std::memory_order_relaxed);
+				return detail::ShmPidAlive(nPid);
+			}
+
+			void ReadLoop()
+			{
+				m_nTail = m_pIn->nTail.load(std::memory_order_relaxed);
+				while (!IsClosing())
+				{
+					if (!ReadFrames())
+						break;
+
+					// Spin first: a busy peer never has to wake us
+					const auto tEnd = std::chrono::steady_clock::now() + m_spin;
+					for (uint32_t n = 1; !HasFrame() && !IsClosing(); n++)
+					{
+						cpu_relax();
+						if ((n & 63) == 0 && std::chrono::steady_clock::now() >= tEnd)
+							break;
+					}
+					if (HasFrame())
+						continue;
+
+					m_pIn->nParked.store(1, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					const uint32_t nKey = m_pIn->nEpoch.load(std::memory_order_acquire);
+					if (!HasFrame() && !IsClosing())
+					{
+						if (!PeerAlive())
+							break;
+						detail::ShmFutexWait(m_pIn->nEpoch, nKey, std::chrono::milliseconds(100));
+					}
+					m_pIn->nParked.store(0, std::memory_order_relaxed);
+				}
+
+				// The peer went, or wrote garbage; the slot is let go on Close()
+				m_bPeerGone.store(true, std::memory_order_release);
+			}
+
+		private:
+			std::shared_ptr<shm_segment> m_pSegment;
+			const uint32_t m_nSlot;
+			const bool m_bServer;
+			shm_slot* m_pSlot;
+			size_t m_nRingBytes;
+			shm_ring* m_pOut;
+			shm_ring* m_pIn;
+			uint8_t* m_pOutData;
+			uint8_t* m_pInData;
+
+			std::mutex m_muxSend;
+			std::atomic<bool> m_bClosing = false;
+			std::atomic<bool> m_bPeerGone = false;
+
+			// reader thread only
+			deliver_type m_deliver;
+			std::thread m_thread;
+			uint64_t m_nTail = 0;
+			std::chrono::nanoseconds m_spin = shm_default_spin();
+		};
+
+		// Client: claim a free slot in the segment and wait up to timeout for
+		// the server to accept it. Returns the slot, or -1. Whichever side moves
+		// the slot out of shm_claimed decides who recycles it: the client on
+		// refusal, the server if the client abandoned it.
+		inline int shm_claim(shm_segment& segment, std::chrono::milliseconds timeout)
+		{
+			for (uint32_t i = 0; i < segment.SlotCount(); i++)
+			{
+				shm_slot* pSlot = segment.Slot(i);
+				uint32_t nFree = shm_free;
+				if (!pSlot->nState.compare_exchange_strong(nFree, shm_claimed, std::memory_order_acq_rel))
+					continue;
+
+				pSlot->nClientPid.store(int32_t(::getpid()), std::memory_order_relaxed);
+				shm_control& control = segment.Control();
+				control.nAcceptEpoch.fetch_add(1, std::memory_order_release);
+				detail::ShmFutexWake(control.nAcceptEpoch);
+
+				const auto tEnd = std::chrono::steady_clock::now() + timeout;
+				uint32_t nState;
+				while ((nState = pSlot->nState.load(std::memory_order_acquire)) == shm_claimed)
+				{
+					if (std::chrono::steady_clock::now() >= tEnd)
+					{
+						uint32_t nClaimed = shm_claimed;
+						if (pSlot->nState.compare_exchange_strong(nClaimed, shm_abandoned, std::memory_order_acq_rel))
+							return -1;
+						// The server answered just in time
+						nState = nClaimed;
+						break;
+					}
+					detail::ShmFutexWait(pSlot->nState, shm_claimed, std::chrono::milliseconds(10));
+				}
+
+				if (nState == shm_accepted)
+					return int(i);
+				segment.Recycle(i);
+				return -1;
+			}
+			return -1;
+		}
+	}
+}
+#endif
@@ -0,0 +1,460 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_pool.h"
+#include "net_message.h"
+#include "net_message_io.h"
+#include "net_framing.h"
+
+// Delta-encoded state snapshots.
+//
+// The server publishes the whole world state, as bytes, once per tick.
+// Each client is sent the difference between that state and the last one
+// it acknowledged, so a tick in which little changed costs little to send
+// whatever the size of the state. A client with nothing acknowledged, one
+// whose baseline has aged out of the history, one that asks for it, and
+// every client once per keyframe interval, gets the full state instead.
+//
+// A delta is the state XORed with the baseline (zero extended or cut to
+// the state's length), run-length encoded as pairs of varints
+//
+//     nZeros nLiterals uint8_t[nLiterals]
+//
+// where the zero bytes are left as they are and the literal bytes are
+// XORed in; anything after the last pair is unchanged. Clients that share a
+// baseline, which is most of them on a steady server, share one encoded
+// delta: it is built once per tick per baseline and queued to all of them
+// without copying.
+//
+// Every snapshot body starts with three uint32_t: the frame number, the
+// baseline frame (0 for a keyframe) and the state length. Clients answer
+// with an ack whose body is the uint32_t frame they now hold, or 0 to ask
+// for a keyframe; snapshot_receiver decodes the one and builds the other.
+
+namespace olc
+{
+	namespace net
+	{
+		// A run of unchanged bytes shorter than this is sent as literals, so
+		// every pair after the first covers at least nDeltaMinZeros + 1 bytes
+		constexpr size_t nDeltaMinZeros = 8;
+
+		// Largest delta of an nBytes state
+		constexpr size_t delta_bound(size_t nBytes)
+		{
+			return nBytes + (nBytes / (nDeltaMinZeros + 1) + 1) * 2 * nMaxVarint;
+		}
+
+		namespace detail
+		{
+			inline uint8_t DeltaByte(const uint8_t* pBase, size_t nBase, const uint8_t* pState, size_t i)
+			{
+				return i < nBase ? uint8_t(pState[i] ^ pBase[i]) : pState[i];
+			}
+
+			// First byte at or after i that differs from the baseline
+			inline size_t DeltaSkip(const uint8_t* pBase, size_t nBase, const uint8_t* pState, size_t nState, size_t i)
+			{
+				const size_t nBoth = std::min(nBase, nState);
+				while (i + sizeof(uint64_t) <= nBoth)
+				{
+					uint64_t a, b;
+					std::memcpy(&a, pState + i, sizeof(a));
+					std::memcpy(&b, pBase + i, sizeof(b));
+					if (a != b)
+						break;
+					i += sizeof(uint64_t);
+				}
+				while (i < nState && DeltaByte(pBase, nBase, pState, i) == 0)
+					i++;
+				return i;
+			}
+		}
+
+		// Encode pState against pBase into pOut, which must hold
+		// delta_bound(nState). Returns the encoded size.
+		inline size_t delta_encode(const uint8_t* pBase, size_t nBase, const uint8_t* pState, size_t nState, uint8_t* pOut)
+		{
+			using namespace detail;
+
+			uint8_t* const pOutStart = pOut;
+			size_t i = 0;
+			while (true)
+			{
+				const size_t nStart = i;
+				i = DeltaSkip(pBase, nBase, pState, nState, i);
+				if (i == nState)
+					break;
+
+				// Literals run on until nDeltaMinZeros unchanged bytes in a row
+				const size_t nLiteral = i;
+				const size_t nBoth = std::min(nBase, nState);
+				size_t nEnd = i + 1;
+				for (size_t j = nEnd; j < nState && j - nEnd < nDeltaMinZeros; j++)
+				{
+					// Usually a whole unchanged word follows, which ends it at once
+					if (j == nEnd && j + sizeof(uint64_t) <= nBoth && std::memcmp(pState + j, pBase + j, sizeof(uint64_t)) == 0)
+						break;
+					if (DeltaByte(pBase, nBase, pState, j) != 0)
+						nEnd = j + 1;
+				}
+
+				pOut += put_varint(pOut, nLiteral - nStart);
+				pOut += put_varint(pOut, nEnd - nLiteral);
+				for (size_t j = nLiteral; j < nEnd; j++)
+					*pOut++ = DeltaByte(pBase, nBase, pState, j);
+				i = nEnd;
+			}
+			return size_t(pOut - pOutStart);
+		}
+
+		// Rebuild an nState byte state from its baseline and a delta into pOut,
+		// which must not overlap pBase. Returns false if the delta is corrupt.
+		inline bool delta_decode(const uint8_t* pBase, size_t nBase, const uint8_t* pDelta, size_t nDelta, uint8_t* pOut, size_t nState)
+		{
+			const size_t nBoth = std::min(nBase, nState);
+			if (nBoth)
+				std::memcpy(pOut, pBase, nBoth);
+			if (nState > nBoth)
+				std::memset(pOut + nBoth, 0, nState - nBoth);
+
+			size_t i = 0, nRead = 0;
+			while (nRead < nDelta)
+			{
+				uint64_t nZeros = 0, nLiterals = 0;
+				size_t n = get_varint(pDelta + nRead, nDelta - nRead, nZeros);
+				if (n == 0 || n == varint_malformed)
+					return false;
+				nRead += n;
+
+				n = get_varint(pDelta + nRead, nDelta - nRead, nLiterals);
+				if (n == 0 || n == varint_malformed)
+					return false;
+				nRead += n;
+
+				if (nZeros > nState - i || nLiterals > nState - i - nZeros || nLiterals > nDelta - nRead)
+					return false;
+
+				i += size_t(nZeros);
+				for (size_t j = 0; j < nLiterals; j++)
+					pOut[i + j] ^= pDelta[nRead + j];
+				i += size_t(nLiterals);
+				nRead += size_t(nLiterals);
+			}
+			return true;
+		}
+
+		// Length of the frame, baseline and state length fields
+		constexpr size_t nSnapshotHeader = 3 * sizeof(uint32_t);
+
+		// Largest state a snapshot_receiver takes by default. A delta of a
+		// state that grew by zeros is empty, so the length field alone says
+		// how much to allocate, and can't be trusted further than this.
+		constexpr size_t nSnapshotMaxState = 16 * 1024 * 1024;
+
+		// The server side of a snapshot stream: a history of published states
+		// and what each client has acknowledged. server_interface drives one
+		// through EnableSnapshots() and BroadcastSnapshot(). Acks may arrive on
+		// any thread.
+		template <typename T>
+		class snapshot_channel
+		{
+		public:
+			snapshot_channel(T idSnapshot, T idAck, uint32_t nKeyframeInterval, size_t nHistory)
+				: m_idSnapshot(idSnapshot), m_idAck(idAck), m_nKeyframeInterval(std::max<uint32_t>(nKeyframeInterval, 1)),
+				m_vecHistory(std::max<size_t>(nHistory, 2))
+			{}
+
+			T GetAckID() const
+			{
+				return m_idAck;
+			}
+
+			uint32_t GetFrame() const
+			{
+				std::scoped_lock lock(m_mux);
+				return m_nFrame;
+			}
+
+			// Record state as the next frame and return its number
+			uint32_t Publish(std::span<const uint8_t> state)
+			{
+				std::scoped_lock lock(m_mux);
+				m_vecEncoded.clear();
+				m_nFrame++;
+
+				// The block doubles as the keyframe's body, so a slot is only
+				// written in place once no outbound queue still holds it
+				history_entry& entry = m_vecHistory[m_nFrame % m_vecHistory.size()];
+				const size_t nBody = nSnapshotHeader + state.size();
+				if (entry.pBlock && entry.pBlock.use_count() == 1 && entry.pBlock->nSize >= nBody)
+					std::atomic_thread_fence(std::memory_order_acquire);
+				else
+					entry.pBlock = make_pool_block(nBody);
+
+				WriteHeader(entry.pBlock->pData, m_nFrame, 0, state.size());
+				if (!state.empty())
+					std::memcpy(entry.pBlock->pData + nSnapshotHeader, state.data(), state.size());
+				entry.nFrame = m_nFrame;
+				entry.nSize = state.size();
+				return m_nFrame;
+			}
+
+			// The current frame as client nID should get it
+			message_view<T> MessageFor(uint32_t nID)
+			{
+				std::scoped_lock lock(m_mux);
+				client_state& client = m_mapClients[nID];
+				client.nSeen = m_nFrame;
+
+				const history_entry* pBase = Find(client.nAcked);
+				if (!pBase || client.bKeyframeRequested || m_nFrame - client.nLastKeyframe >= m_nKeyframeInterval)
+					return Keyframe(client);
+
+				for (auto& [nBaseline, view] : m_vecEncoded)
+				{
+					if (nBaseline == client.nAcked)
+						return view.body.size() == nSnapshotHeader + Current().nSize ? Keyframe(client) : view;
+				}
+
+				message_view<T> view = Encode(*pBase);
+				m_vecEncoded.emplace_back(client.nAcked, view);
+				if (view.body.size() == nSnapshotHeader + Current().nSize)
+					return Keyframe(client);
+				return view;
+			}
+
+			// Handle an ack body from client nID
+			void Acknowledge(uint32_t nID, std::span<const uint8_t> body)
+			{
+				uint32_t nFrame = 0;
+				message_reader reader(body);
+				if (!reader.read(nFrame))
+					return;
+
+				std::scoped_lock lock(m_mux);
+				client_state& client = m_mapClients[nID];
+				if (nFrame == 0)
+					client.bKeyframeRequested = true;
+				else if (nFrame > client.nAcked && nFrame <= m_nFrame)
+					client.nAcked = nFrame;
+			}
+
+			void RequestKeyframe(uint32_t nID)
+			{
+				std::scoped_lock lock(m_mux);
+				m_mapClients[nID].bKeyframeRequested = true;
+			}
+
+			// Forget clients that were not sent the current frame
+			void Prune()
+			{
+				std::scoped_lock lock(m_mux);
+				std::erase_if(m_mapClients, [this](const auto& item) { return item.second.nSeen != m_nFrame; });
+			}
+
+		private:
+			struct history_entry
+			{
+				uint32_t nFrame = 0;
+				size_t nSize = 0;
+				std::shared_ptr<pool_block> pBlock;
+			};
+
+			struct client_state
+			{
+				uint32_t nAcked = 0;
+				uint32_t nLastKeyframe = 0;
+				uint32_t nSeen = 0;
+				bool bKeyframeRequested = false;
+			};
+
+			static void WriteHeader(uint8_t* pData, uint32_t nFrame, uint32_t nBaseline, size_t nState)
+			{
+				const uint32_t vFields[3] = { nFrame, nBaseline, uint32_t(nState) };
+				std::memcpy(pData, vFields, sizeof(vFields));
+			}
+
+			const history_entry& Current() const
+			{
+				return m_vecHistory[m_nFrame % m_vecHistory.size()];
+			}
+
+			const history_entry* Find(uint32_t nFrame) const
+			{
+				if (nFrame == 0 || m_nFrame - nFrame >= m_vecHistory.size())
+					return nullptr;
+				const history_entry& entry = m_vecHistory[nFrame % m_vecHistory.size()];
+				return entry.nFrame == nFrame ? &entry : nullptr;
+			}
+
+			message_view<T> Keyframe(client_state& client)
+			{
+				client.nLastKeyframe = m_nFrame;
+				client.bKeyframeRequested = false;
+
+				const history_entry& current = Current();
+				message_header<T> header;
+				header.id = m_idSnapshot;
+				header.size = uint32_t(nSnapshotHeader + current.nSize);
+				return message_view<T>(header, std::span<const uint8_t>(current.pBlock->pData, header.size), current.pBlock);
+			}
+
+			// The current frame against pBase; a delta no smaller than the state
+			// itself comes back as the keyframe
+			message_view<T> Encode(const history_entry& base)
+			{
+				const history_entry& current = Current();
+				m_vecScratch.resize(delta_bound(current.nSize));
+				const size_t nDelta = delta_encode(base.pBlock->pData + nSnapshotHeader, base.nSize,
+					current.pBlock->pData + nSnapshotHeader, current.nSize, m_vecScratch.data());
+
+				message_header<T> header;
+				header.id = m_idSnapshot;
+				if (nDelta >= current.nSize)
+				{
+					header.size = uint32_t(nSnapshotHeader + current.nSize);
+					return message_view<T>(header, std::span<const uint8_t>(current.pBlock->pData, header.size), current.pBlock);
+				}
+
+				header.size = uint32_t(nSnapshotHeader + nDelta);
+				std::shared_ptr<pool_block> pBlock = make_pool_block(header.size);
+				WriteHeader(pBlock->pData, m_nFrame, base.nFrame, current.nSize);
+				std::memcpy(pBlock->pData + nSnapshotHeader, m_vecScratch.data(), nDelta);
+				const std::span<const uint8_t> body(pBlock->pData, header.size);
+				return message_view<T>(header, body, std::move(pBlock));
+			}
+
+		private:
+			T m_idSnapshot;
+			T m_idAck;
+			uint32_t m_nKeyframeInterval;
+
+			uint32_t m_nFrame = 0;
+			std::vector<history_entry> m_vecHistory;
+			std::unordered_map<uint32_t, client_state> m_mapClients;
+
+			// this frame's deltas, by baseline, shared by every client on it
+			std::vector<std::pair<uint32_t, message_view<T>>> m_vecEncoded;
+			std::vector<uint8_t> m_vecScratch;
+
+			mutable std::mutex m_mux;
+		};
+
+		// The client side of a snapshot stream: rebuilds each frame from the
+		// ones it already has and says what to acknowledge.
+		//
+		//     if (msg.header.id == GameMsg::Snapshot && rx.Apply(msg))
+		//         world.Load(rx.State());
+		//     client.Send(rx.Ack());
+		template <typename T>
+		class snapshot_receiver
+		{
+		public:
+			// Keep at least as much history as the server does, and allow for
+			// the largest state it will publish
+			explicit snapshot_receiver(T idAck, size_t nHistory = 32, size_t nMaxState = nSnapshotMaxState)
+				: m_idAck(idAck), m_vecHistory(std::max<size_t>(nHistory, 2)), m_nMaxState(nMaxState)
+			{}
+
+			// True if the snapshot was applied and State() now holds it. A frame
+			// whose baseline is missing, that is corrupt or whose state would be
+			// over nMaxState is dropped, leaving State() as it was, and the next
+			// Ack() asks for a keyframe.
+			bool Apply(std::span<const uint8_t> body)
+			{
+				uint32_t nFrame = 0, nBaseline = 0, nState = 0;
+				message_reader reader(body);
+				reader >> nFrame >> nBaseline >> nState;
+				if (!reader.ok() || nFrame <= m_nFrame)
+					return false;
+				if (nState > m_nMaxState)
+					return RequestKeyframe();
+
+				const std::span<const uint8_t> payload = body.subspan(nSnapshotHeader);
+				frame& slot = m_vecHistory[nFrame % m_vecHistory.size()];
+				if (nBaseline == 0)
+				{
+					if (payload.size() != nState)
+						return RequestKeyframe();
+					slot.vecState.assign(payload.begin(), payload.end());
+				}
+				else
+				{
+					const frame* pBase = Find(nBaseline, nFrame);
+					if (!pBase)
+						return RequestKeyframe();
+
+					// Decoded aside: the slot may still hold the current state
+					m_vecScratch.resize(nState);
+					if (!delta_decode(pBase->vecState.data(), pBase->vecState.size(), payload.data(), payload.size(), m_vecScratch.data(), nState))
+						return RequestKeyframe();
+					slot.vecState.swap(m_vecScratch);
+				}
+
+				slot.nFrame = nFrame;
+				m_nFrame = nFrame;
+				m_nCurrent = nFrame % m_vecHistory.size();
+				m_bNeedKeyframe = false;
+				return true;
+			}
+
+			template <typename Message>
+			bool Apply(const Message& msg)
+			{
+				return Apply(std::span<const uint8_t>(msg.body.data(), msg.body.size()));
+			}
+
+			// The last state applied
+			std::span<const uint8_t> State() const
+			{
+				return m_vecHistory[m_nCurrent].vecState;
+			}
+
+			uint32_t Frame() const
+			{
+				return m_nFrame;
+			}
+
+			message<T> Ack() const
+			{
+				message<T> msg;
+				msg.header.id = m_idAck;
+				message_writer writer(msg);
+				writer << (m_bNeedKeyframe ? 0u : m_nFrame);
+				return msg;
+			}
+
+		private:
+			struct frame
+			{
+				uint32_t nFrame = 0;
+				std::vector<uint8_t> vecState;
+			};
+
+			bool RequestKeyframe()
+			{
+				m_bNeedKeyframe = true;
+				return false;
+			}
+
+			// The baseline for nFrame, if it is still held in a different slot
+			const frame* Find(uint32_t nBaseline, uint32_t nFrame) const
+			{
+				if (nBaseline >= nFrame || nFrame - nBaseline >= m_vecHistory.size())
+					return nullptr;
+				const frame& slot = m_vecHistory[nBaseline % m_vecHistory.size()];
+				return slot.nFrame == nBaseline ? &slot : nullptr;
+			}
+
+		private:
+			T m_idAck;
+			std::vector<frame> m_vecHistory;
+			size_t m_nMaxState;
+			std::vector<uint8_t> m_vecScratch;
+			size_t m_nCurrent = 0;
+			uint32_t m_nFrame = 0;
+			bool m_bNeedKeyframe = false;
+		};
+	}
+}
@@ -1,16 +1,30 @@
 ﻿#pragma once
 
 #include "lockfree_tsqueue.h"
-#include <condition_variable>
-#include <mutex>
+#include "mpsc_ring_queue.h"
+#include "net_eventcount.h"
+#include "net_pool.h"
 
 namespace olc {
     namespace net {
 
-        template<typename T>
+        // Alloc is handed to the underlying queue for its nodes and elements;
+        // the default draws from the shared slab pool. Queue is the lock-free
+        // backend: the unbounded MPMC lockfree_queue, or the bounded
+        // mpsc_ring_queue where there is only ever one consumer.
+        //
+        // Blocking calls spin briefly and then park on an eventcount; a push
+        // only makes a wake syscall when a consumer is actually parked.
+        template<typename T, typename Alloc = pool_allocator<T>, typename Queue = lockfree_queue<T, Alloc>>
         class tsqueue {
         public:
             tsqueue() = default;
+            explicit tsqueue(const Alloc& alloc) : m_core(alloc) {}
+
+            // Bounded backends only
+            explicit tsqueue(size_t nCapacity, const Alloc& alloc = Alloc())
+                requires std::is_constructible_v<Queue, size_t, const Alloc&>
+                : m_core(nCapacity, alloc) {}
             tsqueue(const tsqueue&) = delete;
             ~tsqueue() = default;
 
@@ -18,57 +32,79 @@ namespace olc {
 
             void push_back(const T& item) {
                 m_core.push(item);
-                cv_.notify_one();
+                m_ecReady.notify_one();
             }
             void push_back(T&& item) {
                 m_core.push(std::move(item));
-                cv_.notify_one();
+                m_ecReady.notify_one();
+            }
+
+            // Bounded backends only: returns false, leaving item alone, if the
+            // queue is full rather than waiting for room
+            bool try_push_back(T&& item)
+                requires requires (Queue& q, T&& v) { q.try_push(std::move(v)); } {
+                if (!m_core.try_push(std::move(item)))
+                    return false;
+                m_ecReady.notify_one();
+                return true;
             }
 
             // --- Inspect / pop ------------------------------
 
             // Block until there's at least one element, then return a reference.
-            // We keep a thread_local shared_ptr alive so the data in the node
-            // isn't freed until after the async_write buffer is copied.
+            // The element lives in the queue node until it is popped, so this is
+            // only meaningful when the caller is the queue's single consumer.
             const T& front() {
-                std::shared_ptr<T> sp;
-                {
-                    std::unique_lock<std::mutex> lk(mux_);
-                    cv_.wait(lk, [&] { return (bool)(sp = m_core.peek()); });
-                }
-                // stash it so it lives until the next pop()
-                thread_local std::shared_ptr<T> tl_sp;
-                tl_sp = sp;
-                return *tl_sp;
+                T* p = nullptr;
+                m_ecReady.wait([&] { return (p = m_core.peek()) != nullptr; });
+                return *p;
             }
 
-            // Remove and return the front element
+            // Remove and return the front element, blocking until there is one.
+            // Another consumer may take the element we woke for, so keep trying.
             T pop_front() {
-                std::shared_ptr<T> sp;
-                {
-                    std::unique_lock<std::mutex> lk(mux_);
-                    cv_.wait(lk, [&] { return (bool)(sp = m_core.peek()); });
-                }
-                // now pop it
-                sp = m_core.pop();
-                return std::move(*sp);
+                T item{};
+                while (!m_core.pop(item))
+                    m_ecReady.wait([&] { return !m_core.empty(); });
+                return item;
+            }
+
+            // Non-blocking pop; returns false if the queue was empty
+            bool try_pop(T& item) {
+                return m_core.pop(item);
+            }
+
+            // Non-blocking batch pop; moves up to out.size() elements into out
+            // and returns how many were taken
+            size_t pop_batch(std::span<T> out) {
+                return m_core.pop_batch(out);
+            }
+
+            // Non-blocking; hands up to nMax elements to fn(T&&) in order and
+            // returns how many were handled
+            template<typename Fn>
+            size_t drain(Fn&& fn, size_t nMax = size_t(-1)) {
+                return m_core.drain(std::forward<Fn>(fn), nMax);
             }
 
             // Non‐blocking empty test
             bool empty() const {
-                return !m_core.peek();
+                return m_core.empty();
             }
 
             // Block until non‐empty
             void wait() {
-                std::unique_lock<std::mutex> lk(mux_);
-                cv_.wait(lk, [&] { return (bool)m_core.peek(); });
+                m_ecReady.wait([&] { return !m_core.empty(); });
+            }
+
+            // How long blocking calls spin before they park the thread
+            void set_spin(std::chrono::nanoseconds spin) {
+                m_ecReady.set_spin(spin);
             }
 
         private:
-            lockfree_queue<T>       m_core;  // the lock-free MPMC queue
-            mutable std::mutex      mux_;
-            std::condition_variable cv_;
+            Queue                   m_core;     // the lock-free backend
+            eventcount              m_ecReady;  // consumers park here when m_core is empty
         };
 
     }
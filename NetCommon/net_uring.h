@@ -0,0 +1,943 @@
+#pragma once
+
+#include "net_common.h"
+
+#include <functional>
+
+// io_uring backend for a server's TCP connections on Linux.
+//
+// asio drives sockets through its epoll reactor, where every read and
+// every write is a syscall of its own. With io_backend::uring each io
+// context gets a ring instead:
+//
+//   - a multishot accept on each listening socket yields every new client
+//     from one submission
+//   - each connection keeps one multishot recv armed, which takes a buffer
+//     from the context's ring of provided buffers whenever data arrives,
+//     so a read needs no syscall of its own
+//   - writes become SENDMSG entries, and everything queued while the io
+//     thread works through its ready handlers goes to the kernel in one
+//     io_uring_enter
+//
+// Completions bump an eventfd that asio's reactor watches, so timers,
+// posted handlers, datagrams and Unix socket clients carry on through asio
+// on the same io thread. Received bytes are copied out of the provided
+// buffer into the connection's receive buffer and parsed as usual.
+//
+// The multishot recv needs Linux 6.0 or later; buffer rings and multishot
+// accept came in 5.19. Each ring tries one recv on a socket pair when it
+// is made, so a server that asks for io_uring on an older kernel says so
+// and stays on epoll.
+//
+// A connection holds at most nMaxHeldBuffers provided buffers its owner
+// hasn't read yet; past that its recv is cancelled until they are read.
+// A recv that finds no buffer free waits for one to be returned.
+
+namespace olc
+{
+	namespace net
+	{
+		// What a server's io threads drive its TCP connections with
+		enum class io_backend
+		{
+			epoll, // asio's reactor
+			uring  // io_uring where the kernel has it, else epoll
+		};
+
+		// Build with OLC_NET_IO_URING defined to make io_uring the default
+#if defined(OLC_NET_IO_URING)
+		constexpr io_backend default_io_backend = io_backend::uring;
+#else
+		constexpr io_backend default_io_backend = io_backend::epoll;
+#endif
+	}
+}
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <string>
+
+namespace olc
+{
+	namespace net
+	{
+		namespace detail
+		{
+			inline int UringSetup(unsigned nEntries, io_uring_params* pParams)
+			{
+				return int(::syscall(__NR_io_uring_setup, nEntries, pParams));
+			}
+
+			inline int UringEnter(int fd, unsigned nSubmit, unsigned nWait, unsigned nFlags)
+			{
+				return int(::syscall(__NR_io_uring_enter, fd, nSubmit, nWait, nFlags, nullptr, 0));
+			}
+
+			inline int UringRegister(int fd, unsigned nOpcode, const void* pArg, unsigned nArgs)
+			{
+				return int(::syscall(__NR_io_uring_register, fd, nOpcode, pArg, nArgs));
+			}
+		}
+
+		// Something a ring's completions are addressed to
+		struct uring_op
+		{
+			virtual void Complete(int32_t nResult, uint32_t nFlags) = 0;
+
+		protected:
+			~uring_op() = default;
+		};
+
+		// One io context's ring, with its provided buffers. Everything but
+		// construction and destruction happens on the context's thread.
+		class uring_context
+		{
+		public:
+			static constexpr unsigned nEntries = 256;
+			static constexpr unsigned nBuffers = 512;
+			static constexpr size_t nBufferBytes = 16 * 1024;
+			static constexpr uint16_t nBufferGroup = 0;
+
+			// Throws if the kernel can't give us a ring with provided buffers and
+			// multishot recv
+			explicit uring_context(asio::io_context& context)
+				: m_context(context), m_event(context)
+			{
+				io_uring_params params{};
+				params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+				params.cq_entries = nEntries * 16;
+				m_fd = detail::UringSetup(nEntries, &params);
+				if (m_fd < 0)
+					throw std::runtime_error(std::string("io_uring_setup: ") + std::strerror(errno));
+
+				try
+				{
+					Map(params);
+					RegisterBuffers();
+					ProbeMultishotRecv();
+
+					const int fdEvent = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+					if (fdEvent < 0)
+						throw std::runtime_error(std::string("eventfd: ") + std::strerror(errno));
+					m_event.assign(fdEvent);
+					if (detail::UringRegister(m_fd, IORING_REGISTER_EVENTFD, &fdEvent, 1) < 0)
+						throw std::runtime_error(std::string("io_uring eventfd: ") + std::strerror(errno));
+				}
+				catch (...)
+				{
+					Release();
+					throw;
+				}
+
+				WaitForCompletions();
+			}
+
+			uring_context(const uring_context&) = delete;
+			uring_context& operator=(const uring_context&) = delete;
+
+			// After the context has stopped. Whatever is still armed is
+			// cancelled, and waited for, so no completion outlives its target.
+			~uring_context()
+			{
+				m_bShutdown = true;
+				if (m_nInFlight > 0)
+				{
+					io_uring_sqe& sqe = Prepare(nullptr);
+					sqe.opcode = IORING_OP_ASYNC_CANCEL;
+					sqe.fd = -1;
+					sqe.cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+					Submit();
+
+					for (int i = 0; i < 1000 && m_nInFlight > 0; i++)
+					{
+						Reap();
+						if (m_nInFlight > 0)
+							std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+				}
+				Release();
+			}
+
+			asio::io_context& GetContext()
+			{
+				return m_context;
+			}
+
+			// True while the ring is being torn down; completions then reach
+			// nobody
+			bool IsShutdown() const
+			{
+				return m_bShutdown;
+			}
+
+			// A zeroed entry addressed to pOp, which goes to the kernel with
+			// every other entry prepared before the io thread next gets round
+			// to Submit()
+			io_uring_sqe& Prepare(uring_op* pOp)
+			{
+				io_uring_sqe& sqe = NextEntry(reinterpret_cast<uint64_t>(pOp));
+				if (!m_bSubmitPosted && !m_bShutdown)
+				{
+					m_bSubmitPosted = true;
+					asio::post(m_context, [this]()
+						{
+							m_bSubmitPosted = false;
+							Submit();
+						});
+				}
+				return sqe;
+			}
+
+			// Hand every prepared entry to the kernel; false if it took none
+			bool Submit()
+			{
+				const unsigned nPending = m_nSqTail - m_nSqSubmitted;
+				if (nPending == 0)
+					return true;
+
+				std::atomic_ref<unsigned>(*m_pSqTail).store(m_nSqTail, std::memory_order_release);
+				const int n = detail::UringEnter(m_fd, nPending, 0, 0);
+				if (n <= 0)
+					return false;
+				m_nSqSubmitted += unsigned(n);
+				return true;
+			}
+
+			// Multishot operations count themselves in while armed
+			void Started()
+			{
+				m_nInFlight++;
+			}
+
+			void Finished()
+			{
+				m_nInFlight--;
+			}
+
+			const uint8_t* BufferData(uint16_t nBuffer) const
+			{
+				return m_pBufferData.get() + size_t(nBuffer) * nBufferBytes;
+			}
+
+			// A completion has handed a provided buffer over
+			void TookBuffer()
+			{
+				m_nBuffersOut++;
+			}
+
+			// Give a provided buffer back for the kernel to fill again
+			void ReturnBuffer(uint16_t nBuffer)
+			{
+				io_uring_buf& buf = m_pBufRing[m_nBufTail & (nBuffers - 1)];
+				buf.addr = reinterpret_cast<uint64_t>(BufferData(nBuffer));
+				buf.len = uint32_t(nBufferBytes);
+				buf.bid = nBuffer;
+				m_nBufTail++;
+				std::atomic_ref<uint16_t>(m_pBufRing[0].resv).store(m_nBufTail, std::memory_order_release);
+
+				m_nBuffersOut--;
+				if (!m_vecBufferWaiters.empty())
+					WakeBufferWaiters();
+			}
+
+			// For a recv that failed with ENOBUFS: run retry once a buffer is
+			// back, or straight away if one already is
+			void WaitForBuffer(std::function<void()> retry)
+			{
+				m_vecBufferWaiters.push_back(std::move(retry));
+				if (m_nBuffersOut < nBuffers)
+					WakeBufferWaiters();
+			}
+
+		private:
+			io_uring_sqe& NextEntry(uint64_t nUserData)
+			{
+				while (m_nSqTail - std::atomic_ref<unsigned>(*m_pSqHead).load(std::memory_order_acquire) >= m_nSqEntries)
+				{
+					if (!Submit())
+						std::this_thread::yield();
+				}
+
+				const unsigned nIndex = m_nSqTail & m_nSqMask;
+				io_uring_sqe& sqe = m_pSqes[nIndex];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.user_data = nUserData;
+				m_pSqArray[nIndex] = nIndex;
+				m_nSqTail++;
+				return sqe;
+			}
+
+			// Whoever is waiting goes once the io thread has finished the
+			// completions in hand, which may return more
+			void WakeBufferWaiters()
+			{
+				if (m_bWakePosted || m_bShutdown)
+					return;
+
+				m_bWakePosted = true;
+				asio::post(m_context, [this]()
+					{
+						m_bWakePosted = false;
+						std::vector<std::function<void()>> vecWaiters;
+						vecWaiters.swap(m_vecBufferWaiters);
+						for (auto& retry : vecWaiters)
+							retry();
+					});
+			}
+
+			void Map(const io_uring_params& params)
+			{
+				m_nSqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				m_nCqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				const bool bSingle = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (bSingle)
+					m_nSqBytes = m_nCqBytes = std::max(m_nSqBytes, m_nCqBytes);
+
+				m_pSq = MapRing(m_nSqBytes, IORING_OFF_SQ_RING);
+				m_pCq = bSingle ? m_pSq : MapRing(m_nCqBytes, IORING_OFF_CQ_RING);
+				m_nSqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+				m_pSqes = reinterpret_cast<io_uring_sqe*>(MapRing(m_nSqesBytes, IORING_OFF_SQES));
+
+				m_pSqHead = reinterpret_cast<unsigned*>(m_pSq + params.sq_off.head);
+				m_pSqTail = reinterpret_cast<unsigned*>(m_pSq + params.sq_off.tail);
+				m_pSqArray = reinterpret_cast<unsigned*>(m_pSq + params.sq_off.array);
+				m_nSqMask = *reinterpret_cast<unsigned*>(m_pSq + params.sq_off.ring_mask);
+				m_nSqEntries = params.sq_entries;
+				m_nSqTail = m_nSqSubmitted = *m_pSqTail;
+
+				m_pCqHead = reinterpret_cast<unsigned*>(m_pCq + params.cq_off.head);
+				m_pCqTail = reinterpret_cast<unsigned*>(m_pCq + params.cq_off.tail);
+				m_nCqMask = *reinterpret_cast<unsigned*>(m_pCq + params.cq_off.ring_mask);
+				m_pCqes = reinterpret_cast<io_uring_cqe*>(m_pCq + params.cq_off.cqes);
+			}
+
+			uint8_t* MapRing(size_t nBytes, off_t nOffset)
+			{
+				void* p = ::mmap(nullptr, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, nOffset);
+				if (p == MAP_FAILED)
+					throw std::runtime_error(std::string("io_uring mmap: ") + std::strerror(errno));
+				return static_cast<uint8_t*>(p);
+			}
+
+			void RegisterBuffers()
+			{
+				m_nBufRingBytes = nBuffers * sizeof(io_uring_buf);
+				void* p = ::mmap(nullptr, m_nBufRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (p == MAP_FAILED)
+					throw std::runtime_error(std::string("io_uring buffer ring: ") + std::strerror(errno));
+				m_pBufRing = static_cast<io_uring_buf*>(p);
+				m_pBufferData = std::make_unique<uint8_t[]>(nBuffers * nBufferBytes);
+
+				io_uring_buf_reg reg{};
+				reg.ring_addr = reinterpret_cast<uint64_t>(m_pBufRing);
+				reg.ring_entries = nBuffers;
+				reg.bgid = nBufferGroup;
+				if (detail::UringRegister(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+					throw std::runtime_error(std::string("io_uring provided buffers: ") + std::strerror(errno));
+
+				m_nBuffersOut = nBuffers;
+				for (unsigned i = 0; i < nBuffers; i++)
+					ReturnBuffer(uint16_t(i));
+			}
+
+			// A kernel without multishot recv fails it with EINVAL; one with it
+			// takes the byte waiting on a socket pair and stays armed, so it is
+			// cancelled, and both completions waited for, before the ring is used
+			void ProbeMultishotRecv()
+			{
+				int vFds[2];
+				if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, vFds) < 0)
+					throw std::runtime_error(std::string("socketpair: ") + std::strerror(errno));
+
+				const uint8_t nByte = 0;
+				::send(vFds[1], &nByte, 1, MSG_NOSIGNAL);
+
+				constexpr uint64_t nRecv = 1;
+				constexpr uint64_t nCancel = 2;
+				io_uring_sqe& recv = NextEntry(nRecv);
+				recv.opcode = IORING_OP_RECV;
+				recv.fd = vFds[0];
+				recv.ioprio = IORING_RECV_MULTISHOT;
+				recv.flags = IOSQE_BUFFER_SELECT;
+				recv.buf_group = nBufferGroup;
+				Submit();
+
+				io_uring_cqe cqe = NextCompletion();
+				const bool bMultishot = cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE);
+				if (cqe.res > 0)
+				{
+					TookBuffer();
+					ReturnBuffer(uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+				}
+
+				if (cqe.flags & IORING_CQE_F_MORE)
+				{
+					io_uring_sqe& cancel = NextEntry(nCancel);
+					cancel.opcode = IORING_OP_ASYNC_CANCEL;
+					cancel.fd = -1;
+					cancel.addr = nRecv;
+					Submit();
+
+					bool bRecvDone = false;
+					bool bCancelDone = false;
+					while (!bRecvDone || !bCancelDone)
+					{
+						cqe = NextCompletion();
+						if (cqe.user_data == nCancel)
+							bCancelDone = true;
+						else if (!(cqe.flags & IORING_CQE_F_MORE))
+							bRecvDone = true;
+						if (cqe.user_data == nRecv && cqe.res > 0)
+						{
+							TookBuffer();
+							ReturnBuffer(uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+						}
+					}
+				}
+
+				::close(vFds[0]);
+				::close(vFds[1]);
+				if (!bMultishot)
+					throw std::runtime_error("io_uring: no multishot recv, which needs Linux 6.0");
+			}
+
+			// The next completion, waiting for one if need be; for use before
+			// the ring is handed to the io thread
+			io_uring_cqe NextCompletion()
+			{
+				unsigned nHead = *m_pCqHead;
+				while (nHead == std::atomic_ref<unsigned>(*m_pCqTail).load(std::memory_order_acquire))
+				{
+					if (detail::UringEnter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+						throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+				}
+				const io_uring_cqe cqe = m_pCqes[nHead & m_nCqMask];
+				std::atomic_ref<unsigned>(*m_pCqHead).store(nHead + 1, std::memory_order_release);
+				return cqe;
+			}
+
+			void Release()
+			{
+				if (m_event.is_open())
+				{
+					asio::error_code ec;
+					m_event.close(ec);
+				}
+				if (m_pBufRing)
+					::munmap(m_pBufRing, m_nBufRingBytes);
+				if (m_pSqes)
+					::munmap(m_pSqes, m_nSqesBytes);
+				if (m_pCq && m_pCq != m_pSq)
+					::munmap(m_pCq, m_nCqBytes);
+				if (m_pSq)
+					::munmap(m_pSq, m_nSqBytes);
+				::close(m_fd);
+			}
+
+			// asio only sees the eventfd go readable, so it is drained before
+			// reaping; a completion posted after the drain signals it again
+			void WaitForCompletions()
+			{
+				m_event.async_wait(asio::posix::descriptor_base::wait_read,
+					[this](asio::error_code ec)
+					{
+						if (ec)
+							return;
+						eventfd_t nSignals;
+						::eventfd_read(m_event.native_handle(), &nSignals);
+						Reap();
+						Submit();
+						WaitForCompletions();
+					});
+			}
+
+			void Reap()
+			{
+				unsigned nHead = *m_pCqHead;
+				while (nHead != std::atomic_ref<unsigned>(*m_pCqTail).load(std::memory_order_acquire))
+				{
+					const io_uring_cqe& cqe = m_pCqes[nHead & m_nCqMask];
+					uring_op* pOp = reinterpret_cast<uring_op*>(cqe.user_data);
+					const int32_t nResult = cqe.res;
+					const uint32_t nFlags = cqe.flags;
+					std::atomic_ref<unsigned>(*m_pCqHead).store(++nHead, std::memory_order_release);
+
+					if (pOp)
+						pOp->Complete(nResult, nFlags);
+				}
+			}
+
+		private:
+			asio::io_context& m_context;
+			asio::posix::stream_descriptor m_event;
+			int m_fd = -1;
+
+			uint8_t* m_pSq = nullptr;
+			uint8_t* m_pCq = nullptr;
+			io_uring_sqe* m_pSqes = nullptr;
+			size_t m_nSqBytes = 0;
+			size_t m_nCqBytes = 0;
+			size_t m_nSqesBytes = 0;
+			unsigned* m_pSqHead = nullptr;
+			unsigned* m_pSqTail = nullptr;
+			unsigned* m_pSqArray = nullptr;
+			unsigned m_nSqMask = 0;
+			unsigned m_nSqEntries = 0;
+			unsigned m_nSqTail = 0;
+			unsigned m_nSqSubmitted = 0;
+			unsigned* m_pCqHead = nullptr;
+			unsigned* m_pCqTail = nullptr;
+			unsigned m_nCqMask = 0;
+			io_uring_cqe* m_pCqes = nullptr;
+
+			// io_uring_buf_ring, addressed as its entries: the uapi header's
+			// flexible array gains an offset in C++. The tail overlays the
+			// first entry's resv.
+			io_uring_buf* m_pBufRing = nullptr;
+			size_t m_nBufRingBytes = 0;
+			std::unique_ptr<uint8_t[]> m_pBufferData;
+			uint16_t m_nBufTail = 0;
+			size_t m_nBuffersOut = 0;
+			std::vector<std::function<void()>> m_vecBufferWaiters;
+			bool m_bWakePosted = false;
+
+			bool m_bSubmitPosted = false;
+			bool m_bShutdown = false;
+			size_t m_nInFlight = 0;
+		};
+
+		// A connected socket driven through a ring, standing in for the asio
+		// socket a connection would otherwise read and write. Used on the
+		// ring's thread, apart from IsOpen(), Family() and Abandon(). Like
+		// asio, a handler waiting when the stream closes is called with
+		// operation_aborted.
+		class uring_stream : public std::enable_shared_from_this<uring_stream>
+		{
+		public:
+			using handler_type = std::function<void(asio::error_code, std::size_t)>;
+
+			// Provided buffers one stream may hold unread, a sixteenth of the ring's
+			static constexpr size_t nMaxHeldBuffers = uring_context::nBuffers / 16;
+
+			// Takes over fd
+			uring_stream(uring_context& ring, int fd)
+				: m_ring(ring), m_fd(fd), m_recv(*this), m_send(*this)
+			{
+				sockaddr_storage addr{};
+				socklen_t nLength = sizeof(addr);
+				if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &nLength) == 0)
+					m_nFamily = addr.ss_family;
+			}
+
+			uring_stream(const uring_stream&) = delete;
+			uring_stream& operator=(const uring_stream&) = delete;
+
+			~uring_stream()
+			{
+				if (m_fd >= 0)
+					::close(m_fd);
+			}
+
+			bool IsOpen() const
+			{
+				return m_bOpen.load(std::memory_order_acquire);
+			}
+
+			int Family() const
+			{
+				return m_nFamily;
+			}
+
+			// Whatever has arrived, up to the size of buffer
+			void AsyncReadSome(asio::mutable_buffer buffer, handler_type handler)
+			{
+				StartRead(buffer, false, std::move(handler));
+			}
+
+			// Exactly the size of buffer
+			void AsyncRead(asio::mutable_buffer buffer, handler_type handler)
+			{
+				StartRead(buffer, true, std::move(handler));
+			}
+
+			// All of a buffer sequence, which stays valid until the handler runs
+			template <typename Buffers>
+			void AsyncWrite(const Buffers& buffers, handler_type handler)
+			{
+				m_vecIov.clear();
+				for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers); ++it)
+				{
+					const asio::const_buffer buffer(*it);
+					if (buffer.size() > 0)
+						m_vecIov.push_back({ const_cast<void*>(buffer.data()), buffer.size() });
+				}
+				m_nIovFirst = 0;
+				m_nWritten = 0;
+				m_writeHandler = std::move(handler);
+
+				if (!IsOpen() || m_vecIov.empty())
+				{
+					asio::post(m_ring.GetContext(), [self = shared_from_this()]() { self->FinishWrite({}); });
+					return;
+				}
+				SubmitSend();
+			}
+
+			// On the ring's thread
+			void Close()
+			{
+				if (!m_bOpen.exchange(false, std::memory_order_acq_rel))
+					return;
+
+				// Wakes the recv and any send; entries naming the fd go in while
+				// it is still ours
+				::shutdown(m_fd, SHUT_RDWR);
+				m_ring.Submit();
+				::close(m_fd);
+				m_fd = -1;
+
+				for (const received& item : m_deqReceived)
+					m_ring.ReturnBuffer(item.nBuffer);
+				m_deqReceived.clear();
+
+				if (m_readHandler)
+					asio::post(m_ring.GetContext(), [self = shared_from_this()]() { self->FinishRead(); });
+			}
+
+			// From any thread, when the owner goes: nothing it handed over is
+			// called again
+			void Abandon()
+			{
+				m_bAbandoned.store(true, std::memory_order_release);
+				asio::post(m_ring.GetContext(), [self = shared_from_this()]()
+					{
+						self->Close();
+						self->m_readHandler = nullptr;
+						self->m_writeHandler = nullptr;
+					});
+			}
+
+		private:
+			struct received
+			{
+				uint16_t nBuffer;
+				uint32_t nOffset;
+				uint32_t nLength;
+			};
+
+			struct recv_op : uring_op
+			{
+				uring_stream& stream;
+				std::shared_ptr<uring_stream> pKeep;
+
+				explicit recv_op(uring_stream& s) : stream(s) {}
+
+				void Complete(int32_t nResult, uint32_t nFlags) override
+				{
+					stream.OnReceive(nResult, nFlags);
+				}
+			};
+
+			struct send_op : uring_op
+			{
+				uring_stream& stream;
+				std::shared_ptr<uring_stream> pKeep;
+
+				explicit send_op(uring_stream& s) : stream(s) {}
+
+				void Complete(int32_t nResult, uint32_t) override
+				{
+					stream.OnSend(nResult);
+				}
+			};
+
+			void StartRead(asio::mutable_buffer buffer, bool bAll, handler_type handler)
+			{
+				m_readBuffer = buffer;
+				m_nRead = 0;
+				m_bReadAll = bAll;
+				m_readHandler = std::move(handler);
+
+				// Completing here would recurse through the caller's parsing
+				if (!m_deqReceived.empty() || m_bEof || m_ecRead || !IsOpen())
+					asio::post(m_ring.GetContext(), [self = shared_from_this()]() { self->FinishRead(); });
+				else
+					ArmRecv();
+			}
+
+			// Not while the last recv is still winding down, nor while this
+			// stream waits for a buffer or already holds its share
+			void ArmRecv()
+			{
+				if (m_recv.pKeep || !IsOpen() || m_bStarved || m_deqReceived.size() >= nMaxHeldBuffers)
+					return;
+
+				io_uring_sqe& sqe = m_ring.Prepare(&m_recv);
+				sqe.opcode = IORING_OP_RECV;
+				sqe.fd = m_fd;
+				sqe.ioprio = IORING_RECV_MULTISHOT;
+				sqe.flags = IOSQE_BUFFER_SELECT;
+				sqe.buf_group = uring_context::nBufferGroup;
+				m_recv.pKeep = shared_from_this();
+				m_ring.Started();
+			}
+
+			void OnReceive(int32_t nResult, uint32_t nFlags)
+			{
+				std::shared_ptr<uring_stream> pKeep;
+				if (!(nFlags & IORING_CQE_F_MORE))
+				{
+					pKeep = std::move(m_recv.pKeep);
+					m_ring.Finished();
+					m_bRecvCancelled = false;
+				}
+
+				if (nResult > 0)
+				{
+					const uint16_t nBuffer = uint16_t(nFlags >> IORING_CQE_BUFFER_SHIFT);
+					m_ring.TookBuffer();
+					if (IsOpen() && !m_ring.IsShutdown())
+						m_deqReceived.push_back({ nBuffer, 0, uint32_t(nResult) });
+					else
+						m_ring.ReturnBuffer(nBuffer);
+
+					// Stop taking buffers once this stream holds its share unread;
+					// reading them arms the recv again
+					if (m_recv.pKeep && !m_bRecvCancelled && m_deqReceived.size() >= nMaxHeldBuffers)
+					{
+						io_uring_sqe& sqe = m_ring.Prepare(nullptr);
+						sqe.opcode = IORING_OP_ASYNC_CANCEL;
+						sqe.fd = -1;
+						sqe.addr = reinterpret_cast<uint64_t>(static_cast<uring_op*>(&m_recv));
+						m_bRecvCancelled = true;
+					}
+				}
+				else if (nResult == 0)
+					m_bEof = true;
+				else if (nResult == -ENOBUFS)
+				{
+					// Trying again at once would only fail again
+					if (!m_bStarved && !m_ring.IsShutdown())
+					{
+						m_bStarved = true;
+						m_ring.WaitForBuffer([self = shared_from_this()]()
+							{
+								self->m_bStarved = false;
+								self->FinishRead();
+							});
+					}
+				}
+				else if (nResult != -ECANCELED)
+					m_ecRead = asio::error_code(-nResult, asio::error::get_system_category());
+
+				if (!m_ring.IsShutdown())
+					FinishRead();
+			}
+
+			// Copy what has arrived into the waiting read, and complete it if
+			// that is enough
+			void FinishRead()
+			{
+				if (!m_readHandler)
+					return;
+
+				if (m_bAbandoned.load(std::memory_order_acquire))
+				{
+					m_readHandler = nullptr;
+					return;
+				}
+
+				while (m_nRead < m_readBuffer.size() && !m_deqReceived.empty())
+				{
+					received& item = m_deqReceived.front();
+					const size_t n = std::min(m_readBuffer.size() - m_nRead, size_t(item.nLength - item.nOffset));
+					std::memcpy(static_cast<uint8_t*>(m_readBuffer.data()) + m_nRead, m_ring.BufferData(item.nBuffer) + item.nOffset, n);
+					m_nRead += n;
+					item.nOffset += uint32_t(n);
+					if (item.nOffset == item.nLength)
+					{
+						m_ring.ReturnBuffer(item.nBuffer);
+						m_deqReceived.pop_front();
+					}
+				}
+
+				asio::error_code ec;
+				if (!IsOpen())
+					ec = asio::error::operation_aborted;
+				else if (m_bReadAll ? m_nRead == m_readBuffer.size() : m_nRead > 0)
+					ec = {};
+				else if (m_ecRead)
+					ec = m_ecRead;
+				else if (m_bEof)
+					ec = asio::error::eof;
+				else
+				{
+					ArmRecv();
+					return;
+				}
+
+				handler_type handler = std::move(m_readHandler);
+				m_readHandler = nullptr;
+				handler(ec, m_nRead);
+			}
+
+			void SubmitSend()
+			{
+				m_msg = {};
+				m_msg.msg_iov = m_vecIov.data() + m_nIovFirst;
+				m_msg.msg_iovlen = std::min<size_t>(m_vecIov.size() - m_nIovFirst, IOV_MAX);
+
+				io_uring_sqe& sqe = m_ring.Prepare(&m_send);
+				sqe.opcode = IORING_OP_SENDMSG;
+				sqe.fd = m_fd;
+				sqe.addr = reinterpret_cast<uint64_t>(&m_msg);
+				sqe.len = 1;
+				sqe.msg_flags = MSG_NOSIGNAL;
+				m_send.pKeep = shared_from_this();
+				m_ring.Started();
+			}
+
+			void OnSend(int32_t nResult)
+			{
+				std::shared_ptr<uring_stream> pKeep = std::move(m_send.pKeep);
+				m_ring.Finished();
+				if (m_ring.IsShutdown())
+					return;
+
+				if (nResult < 0)
+				{
+					FinishWrite(asio::error_code(-nResult, asio::error::get_system_category()));
+					return;
+				}
+
+				// A short send carries on from where it stopped
+				m_nWritten += size_t(nResult);
+				size_t nSent = size_t(nResult);
+				while (m_nIovFirst < m_vecIov.size() && nSent >= m_vecIov[m_nIovFirst].iov_len)
+					nSent -= m_vecIov[m_nIovFirst++].iov_len;
+				if (m_nIovFirst < m_vecIov.size())
+				{
+					m_vecIov[m_nIovFirst].iov_base = static_cast<uint8_t*>(m_vecIov[m_nIovFirst].iov_base) + nSent;
+					m_vecIov[m_nIovFirst].iov_len -= nSent;
+					if (IsOpen())
+					{
+						SubmitSend();
+						return;
+					}
+				}
+				FinishWrite({});
+			}
+
+			void FinishWrite(asio::error_code ec)
+			{
+				if (!m_writeHandler)
+					return;
+
+				if (m_bAbandoned.load(std::memory_order_acquire))
+				{
+					m_writeHandler = nullptr;
+					return;
+				}
+
+				if (!IsOpen())
+					ec = asio::error::operation_aborted;
+				handler_type handler = std::move(m_writeHandler);
+				m_writeHandler = nullptr;
+				handler(ec, m_nWritten);
+			}
+
+		private:
+			uring_context& m_ring;
+			int m_fd;
+			int m_nFamily = AF_UNSPEC;
+			std::atomic<bool> m_bOpen = true;
+			std::atomic<bool> m_bAbandoned = false;
+
+			recv_op m_recv;
+			bool m_bRecvCancelled = false;
+			bool m_bStarved = false;
+			std::deque<received> m_deqReceived;
+			bool m_bEof = false;
+			asio::error_code m_ecRead;
+			asio::mutable_buffer m_readBuffer;
+			size_t m_nRead = 0;
+			bool m_bReadAll = false;
+			handler_type m_readHandler;
+
+			send_op m_send;
+			std::vector<iovec> m_vecIov;
+			size_t m_nIovFirst = 0;
+			size_t m_nWritten = 0;
+			msghdr m_msg{};
+			handler_type m_writeHandler;
+		};
+
+		// A multishot accept on a listening socket that the caller keeps open,
+		// handing each new socket's fd to onAccept on the ring's thread
+		class uring_acceptor : public uring_op, public std::enable_shared_from_this<uring_acceptor>
+		{
+		public:
+			uring_acceptor(uring_context& ring, int fdListen, std::function<void(int)> onAccept)
+				: m_ring(ring), m_fdListen(fdListen), m_onAccept(std::move(onAccept))
+			{}
+
+			// On the ring's thread
+			void Start()
+			{
+				if (m_pKeep || m_ring.IsShutdown())
+					return;
+
+				io_uring_sqe& sqe = m_ring.Prepare(this);
+				sqe.opcode = IORING_OP_ACCEPT;
+				sqe.fd = m_fdListen;
+				sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+				sqe.accept_flags = SOCK_CLOEXEC;
+				m_pKeep = shared_from_this();
+				m_ring.Started();
+			}
+
+			void Complete(int32_t nResult, uint32_t nFlags) override
+			{
+				std::shared_ptr<uring_acceptor> pKeep;
+				if (!(nFlags & IORING_CQE_F_MORE))
+				{
+					pKeep = std::move(m_pKeep);
+					m_ring.Finished();
+				}
+
+				if (nResult >= 0)
+				{
+					if (m_ring.IsShutdown())
+						::close(nResult);
+					else
+						m_onAccept(nResult);
+				}
+				else if (nResult != -ECANCELED)
+				{
+					std::cout << "[SERVER] New Connection Error: " << std::strerror(-nResult) << std::endl;
+				}
+
+				// The kernel ends a multishot accept on errors and overflow
+				if (!(nFlags & IORING_CQE_F_MORE) && nResult != -ECANCELED)
+					Start();
+			}
+
+		private:
+			uring_context& m_ring;
+			int m_fdListen;
+			std::function<void(int)> m_onAccept;
+			std::shared_ptr<uring_acceptor> m_pKeep;
+		};
+	}
+}
+#endif
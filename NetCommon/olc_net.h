@@ -1,8 +1,20 @@
 #pragma once
 
 #include "net_common.h"
+#include "net_pool.h"
 #include "net_tsqueue.h"
 #include "net_message.h"
+#include "net_message_io.h"
+#include "net_lz.h"
+#include "net_framing.h"
+#include "net_datagram.h"
+#include "net_reliable.h"
+#include "net_shm.h"
+#include "net_uring.h"
 #include "net_client.h"
+#include "net_dispatch.h"
+#include "net_registry.h"
+#include "net_schema.h"
+#include "net_snapshot.h"
 #include "net_server.h"
 #include "net_connection.h"
\ No newline at end of file
@@ -29,7 +29,7 @@ public:
 
     // Expose number of active connections
     size_t GetConnectionCount() const {
-        return m_deqConnections.size();
+        return m_mapConnections.size();
     }
 
 protected:
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <chrono>
 #include <thread>
+#include <string>
 #include "olc_net.h"
 
 enum class StressMsg : uint32_t
@@ -15,9 +16,13 @@ enum class StressMsg : uint32_t
 class StressServer : public olc::net::server_interface<StressMsg>
 {
 public:
-    StressServer(uint16_t port)
-        : server_interface<StressMsg>(port)
+    StressServer(uint16_t port, size_t io_threads, bool sharded, size_t workers)
+        : server_interface<StressMsg>(port, io_threads)
     {
+        if (sharded)
+            EnableShardedAcceptors();
+        if (workers > 0)
+            SetDispatchMode(dispatch_mode::parallel, workers);
     }
 
 protected:
@@ -59,9 +64,32 @@ public:
     void PrintStats()
     {
         uint64_t count = messages_received_.exchange(0, std::memory_order_relaxed);
-        size_t clients = m_deqConnections.size();  // protected member of base
+        std::scoped_lock lock(m_muxConnections);
+        size_t clients = m_mapConnections.size();  // protected member of base
+
+        // Average number of messages carried by each socket read and write
+        uint64_t reads = 0, read = 0, writes = 0, written = 0;
+        for (auto& client : m_mapConnections)
+        {
+            if (client)
+            {
+                reads += client->GetReadCount();
+                read += client->GetMessagesRead();
+                writes += client->GetWriteCount();
+                written += client->GetMessagesWritten();
+            }
+        }
+
         std::cout << "[SERVER] Clients: " << clients
             << " | Msgs/sec: " << count
+            << " | Msgs/read: " << (reads ? double(read) / reads : 0.0)
+            << " | Msgs/write: " << (writes ? double(written) / writes : 0.0)
+            << std::endl;
+
+        olc::net::pool_stats pool = olc::net::GetPoolStats();
+        std::cout << "[SERVER] Pool hits: " << pool.nHits
+            << " | misses: " << pool.nMisses
+            << " | slabs: " << pool.nSlabs
             << std::endl;
     }
 };
@@ -69,17 +97,26 @@ public:
 int main(int argc, char* argv[])
 {
     uint16_t port = 60000;
-    if (argc == 2)
+    size_t io_threads = 1;
+    bool sharded = false;
+    size_t workers = 0;
+    if (argc >= 2)
     {
         port = static_cast<uint16_t>(std::stoi(argv[1]));
+        if (argc >= 3)
+            io_threads = static_cast<size_t>(std::stoi(argv[2]));
+        if (argc >= 4)
+            sharded = std::string(argv[3]) == "sharded";
+        if (argc >= 5)
+            workers = static_cast<size_t>(std::stoi(argv[4]));
     }
     else
     {
-        std::cout << "Usage: StressServer [port]\n"
+        std::cout << "Usage: StressServer [port] [io threads] [sharded] [dispatch workers]\n"
             << "Using default port " << port << std::endl;
     }
 
-    StressServer server(port);
+    StressServer server(port, io_threads, sharded, workers);
     if (!server.Start())
         return 1;
 
@@ -96,8 +133,6 @@ int main(int argc, char* argv[])
             server.PrintStats();
             last_print = now;
         }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
     return 0;